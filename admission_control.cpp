@@ -0,0 +1,85 @@
+#include "admission_control.h"
+#include "logger.h"
+#include <QtAlgorithms>
+
+namespace {
+
+const int MinSweep = 1024;
+const qint64 SweepInterval = 100;  // Мс; чаще таблица не вычищается, даже если переполнена
+
+} // namespace
+
+AdmissionControl::AdmissionControl(int highWatermark, int lowWatermark, int clientRate, int clientBurst)
+    : high(qMax(1, highWatermark))
+    , low(qBound(0, lowWatermark, high - 1))
+    , rate(qMax(0, clientRate))
+    , capacity(qint64(clientBurst > 0 ? clientBurst : qMax(1, clientRate)) * TokenCost)
+    , overloaded(false)
+    , sweepAt(MinSweep)
+    , sweepAfter(0)
+{
+    overflow.tokens = capacity;
+}
+
+AdmissionControl::Decision AdmissionControl::admit(const ClientKey &client, int queued, qint64 now)
+{
+    // Гистерезис: между порогами сохраняется прежнее состояние, чтобы
+    // допуск не переключался на каждой заявке
+    if (overloaded) {
+        if (queued > low) {
+            return Overloaded;
+        }
+        overloaded = false;
+        LOG_INFO("Queue drained to %1 requests, accepting new requests again", queued);
+    } else if (queued >= high) {
+        overloaded = true;
+        LOG_WARNING("Queue reached %1 requests, rejecting new requests until it drains to %2", queued, low);
+        return Overloaded;
+    }
+
+    if (rate > 0 && !takeToken(client, now)) {
+        return RateLimited;
+    }
+    return Admitted;
+}
+
+bool AdmissionControl::takeToken(const ClientKey &client, qint64 now)
+{
+    TokenBucket *bucket = buckets.find(client);
+    if (!bucket) {
+        if (buckets.size() >= sweepAt && now >= sweepAfter) {
+            evictIdle(now);
+        }
+        if (buckets.size() < MaxClients) {
+            TokenBucket full;
+            full.tokens = capacity;
+            full.updatedAt = now;
+            bucket = &buckets.findOrInsert(client, full);
+        } else {
+            // Таблица заполнена активными клиентами: пропускать новых без
+            // лимита нельзя — поток с подменёнными адресами обошёл бы его
+            LOG_SAMPLED(Logger::Warning, "Rate limit table is full, untracked clients share one bucket");
+            bucket = &overflow;
+        }
+    }
+    bucket->tokens = qMin(capacity, bucket->tokens + qMax<qint64>(0, now - bucket->updatedAt) * rate);
+    bucket->updatedAt = now;
+
+    if (bucket->tokens < TokenCost) {
+        return false;
+    }
+    bucket->tokens -= TokenCost;
+    return true;
+}
+
+void AdmissionControl::evictIdle(qint64 now)
+{
+    const qint64 perMs = rate;
+    const qint64 full = capacity;
+    buckets.removeIf([now, perMs, full](const ClientKey &, const TokenBucket &bucket) {
+        return bucket.tokens + (now - bucket.updatedAt) * perMs >= full;
+    });
+    // Следующая чистка — когда таблица снова вырастет вдвое
+    sweepAt = qBound(MinSweep, buckets.size() * 2, int(MaxClients));
+    sweepAfter = now + SweepInterval;
+}
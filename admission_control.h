@@ -0,0 +1,60 @@
+#ifndef ADMISSION_CONTROL_H
+#define ADMISSION_CONTROL_H
+
+#include "flat_hash.h"
+#include "request.h"
+
+// Допуск заявок в очередь. Очередь ограничена двумя порогами: по достижении
+// верхнего новые заявки отклоняются, пока очередь не опустится до нижнего.
+// Каждому клиенту (адрес и порт) положено ведро токенов: rate заявок в
+// секунду с запасом burst. Вёдра лежат в плоской хеш-таблице; полные вёдра
+// ничем не отличаются от отсутствующих и вычищаются при её росте. Если
+// таблица занята активными клиентами, новые делят одно общее ведро.
+// Не потокобезопасен: вызывается под блокировкой очереди.
+class AdmissionControl
+{
+public:
+    enum Decision {
+        Admitted,
+        Overloaded,   // Очередь выше верхнего порога
+        RateLimited   // Клиент исчерпал свои токены
+    };
+
+    enum {
+        MaxClients = 1 << 16   // Больше клиентов не отслеживается, новые делят общее ведро
+    };
+
+    // clientRate 0 отключает лимит клиентов; clientBurst 0 — запас в секунду работы
+    AdmissionControl(int highWatermark, int lowWatermark, int clientRate = 0, int clientBurst = 0);
+
+    // queued — заявок в очереди сейчас, now — монотонные мс
+    Decision admit(const ClientKey &client, int queued, qint64 now);
+
+    bool isOverloaded() const { return overloaded; }
+    int trackedClients() const { return buckets.size(); }
+
+private:
+    // Токены хранятся в тысячных долях: при rate заявок в секунду ведро
+    // пополняется ровно на rate тысячных за миллисекунду
+    enum { TokenCost = 1000 };
+
+    struct TokenBucket {
+        qint64 tokens = 0;
+        qint64 updatedAt = 0;
+    };
+
+    bool takeToken(const ClientKey &client, qint64 now);
+    void evictIdle(qint64 now);
+
+    int high;
+    int low;
+    qint64 rate;
+    qint64 capacity;
+    bool overloaded;
+    int sweepAt;        // Размер таблицы, при котором вычищаются полные вёдра
+    qint64 sweepAfter;  // Не раньше этого момента
+    FlatHashMap<ClientKey, TokenBucket> buckets;
+    TokenBucket overflow;  // Для клиентов, не поместившихся в таблицу
+};
+
+#endif // ADMISSION_CONTROL_H
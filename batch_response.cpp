@@ -0,0 +1,76 @@
+#include "batch_response.h"
+#include "cbor_parser.h"
+#include <cstring>
+
+namespace {
+
+// Заголовок массива CBOR длиной до 65535 элементов занимает не больше трёх байт,
+// больше элементов в одну датаграмму не помещается
+const int HeaderReserve = 3;
+
+} // namespace
+
+BatchResponse::BatchResponse(WireFormat format, int limit, DatagramSink &sink, const ClientInfo &client)
+    : format(format)
+    , limit(limit)
+    , sink(sink)
+    , client(client)
+    , count(0)
+    , total(0)
+    , datagrams(0)
+{
+    buffer.reserve(limit + HeaderReserve);
+    buffer.fill('\0', HeaderReserve);
+}
+
+void BatchResponse::append(QByteArrayView response)
+{
+    // JSON: '[' ... ']' и запятая перед каждым элементом, кроме первого;
+    // CBOR: заголовок массива, растущий с числом элементов
+    int overhead;
+    if (format == CborFormat) {
+        overhead = count + 1 < 24 ? 1 : (count + 1 <= 0xff ? 2 : HeaderReserve);
+    } else {
+        overhead = 2 + (count > 0 ? 1 : 0);
+    }
+    const qsizetype used = buffer.size() - HeaderReserve;
+    if (count > 0 && used + overhead + response.size() > limit) {
+        flush();
+    }
+
+    // Ответ больше лимита уходит один в своём массиве
+    if (format == JsonFormat && count > 0) {
+        buffer.append(',');
+    }
+    buffer.append(response.data(), response.size());
+    ++count;
+    ++total;
+}
+
+int BatchResponse::finish()
+{
+    if (count > 0) {
+        flush();
+    }
+    return datagrams;
+}
+
+void BatchResponse::flush()
+{
+    // Заголовок записывается вплотную к элементам в зарезервированное место
+    QByteArray header;
+    if (format == CborFormat) {
+        CborRpcParser::appendHead(header, 4, quint64(count));
+    } else {
+        header = "[";
+        buffer.append(']');
+    }
+    const qsizetype start = HeaderReserve - header.size();
+    memcpy(buffer.data() + start, header.constData(), size_t(header.size()));
+
+    sink.sendDatagram(QByteArrayView(buffer).sliced(start), client);
+    ++datagrams;
+
+    buffer.resize(HeaderReserve);
+    count = 0;
+}
@@ -0,0 +1,37 @@
+#ifndef BATCH_RESPONSE_H
+#define BATCH_RESPONSE_H
+
+#include <QByteArray>
+#include <QByteArrayView>
+#include "datagram.h"
+#include "wire_format.h"
+
+// Ответ на пакетный запрос: ответы на отдельные вызовы собираются в массив,
+// а когда очередной ответ не помещается в limit байт, накопленный массив
+// уходит отдельной датаграммой и начинается новый. Каждая датаграмма —
+// самостоятельный корректный массив JSON или CBOR.
+class BatchResponse
+{
+public:
+    BatchResponse(WireFormat format, int limit, DatagramSink &sink, const ClientInfo &client);
+
+    void append(QByteArrayView response);
+    // Отправляет остаток; возвращает число отправленных датаграмм
+    int finish();
+
+    int size() const { return total; }
+
+private:
+    void flush();
+
+    WireFormat format;
+    int limit;
+    DatagramSink &sink;
+    ClientInfo client;
+    QByteArray buffer;  // Перед элементами оставлено место под заголовок массива
+    int count;          // Элементов в текущем массиве
+    int total;          // Элементов всего
+    int datagrams;
+};
+
+#endif // BATCH_RESPONSE_H
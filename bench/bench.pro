@@ -0,0 +1,31 @@
+QT += core network
+
+CONFIG += c++17 console
+CONFIG -= app_bundle
+
+INCLUDEPATH += ..
+
+SOURCES += \
+    main.cpp \
+    ../cbor_parser.cpp \
+    ../configuration.cpp \
+    ../jsonrpc_parser.cpp \
+    ../request_pool.cpp \
+    ../request_scheduler.cpp \
+    ../response_encoder.cpp \
+    ../timing_wheel.cpp
+
+HEADERS += \
+    ../cbor_parser.h \
+    ../configuration.h \
+    ../flat_hash.h \
+    ../jsonrpc_parser.h \
+    ../request.h \
+    ../request_pool.h \
+    ../request_scheduler.h \
+    ../response_encoder.h \
+    ../timing_wheel.h \
+    ../wire_format.h
+
+TARGET = bench
+TEMPLATE = app
@@ -0,0 +1,488 @@
+#include <QCoreApplication>
+#include <QCommandLineParser>
+#include <QElapsedTimer>
+#include <QJsonDocument>
+#include <QJsonObject>
+#include <QPair>
+#include <QQueue>
+#include "cbor_parser.h"
+#include "configuration.h"
+#include "jsonrpc_parser.h"
+#include "request_scheduler.h"
+#include "response_encoder.h"
+#include "timing_wheel.h"
+#include <cstdio>
+#ifdef __GLIBC__
+#include <malloc.h>
+#endif
+
+// Микробенчмарки этапов обработки запроса: разбор, проверка параметров,
+// постановка в очередь и кодирование ответа. Для разбора и кодирования
+// рядом приведён вариант на QJsonDocument для сравнения. Отдельный этап
+// memory меряет, сколько кучи занимает одна ожидающая заявка, а size —
+// размер одних и тех же запросов и ответов в JSON и в CBOR.
+
+namespace {
+
+// Результаты складываются сюда, чтобы компилятор не выбросил измеряемый код
+volatile quint64 sink;
+
+int iterations = 1000000;
+int runs = 5;
+
+// Нс на операцию: лучший из runs прогонов по iterations вызовов body
+template<typename Body>
+void measure(const char *stage, const char *name, Body body)
+{
+    qint64 best = -1;
+    for (int run = 0; run < runs; ++run) {
+        QElapsedTimer timer;
+        timer.start();
+        for (int i = 0; i < iterations; ++i) {
+            body(i);
+        }
+        const qint64 elapsed = timer.nsecsElapsed();
+        if (best < 0 || elapsed < best) {
+            best = elapsed;
+        }
+    }
+    std::printf("%-10s %-32s %9.1f ns/op\n", stage, name, double(best) / iterations);
+}
+
+const QByteArray JsonRequest =
+        "{\"jsonrpc\":\"2.0\",\"method\":\"processRequest\",\"id\":\"a1b2c3\","
+        "\"params\":{\"priority\":3,\"configuration\":\"четыре строки\"}}";
+
+// Запрос в CBOR так, как его кодирует клиент: словари определённой длины.
+// params — уже закодированный словарь, пустой — без params
+QByteArray cborEnvelope(QByteArrayView method, QByteArrayView id, const QByteArray &params = QByteArray())
+{
+    QByteArray out;
+    CborRpcParser::appendHead(out, 5, params.isEmpty() ? 3 : 4);
+    CborRpcParser::appendText(out, "jsonrpc");
+    CborRpcParser::appendText(out, "2.0");
+    CborRpcParser::appendText(out, "method");
+    CborRpcParser::appendText(out, method);
+    CborRpcParser::appendText(out, "id");
+    CborRpcParser::appendText(out, id);
+    if (!params.isEmpty()) {
+        CborRpcParser::appendText(out, "params");
+        out.append(params);
+    }
+    return out;
+}
+
+QByteArray cborRequest()
+{
+    QByteArray params;
+    CborRpcParser::appendHead(params, 5, 2);
+    CborRpcParser::appendText(params, "priority");
+    CborRpcParser::appendHead(params, 0, 3);
+    CborRpcParser::appendText(params, "configuration");
+    CborRpcParser::appendText(params, "четыре строки");
+    return cborEnvelope("processRequest", "a1b2c3", params);
+}
+
+QueuedRequest sampleRequest(int i)
+{
+    QueuedRequest request = {{QHostAddress(QHostAddress::LocalHost), 50000}, QString(), 0,
+                             Grid2x2, quint8(i % 7 + 1), JsonFormat};
+    return request;
+}
+
+void benchParse()
+{
+    const QByteArray cbor = cborRequest();
+    measure("parse", "JsonRpcParser", [&](int) {
+        JsonRpcEnvelope envelope;
+        sink = sink + quint64(JsonRpcParser::parse(JsonRequest, envelope)) + quint64(envelope.method.size());
+    });
+    measure("parse", "CborRpcParser", [&](int) {
+        JsonRpcEnvelope envelope;
+        sink = sink + quint64(CborRpcParser::parse(cbor, envelope)) + quint64(envelope.method.size());
+    });
+    measure("parse", "QJsonDocument (baseline)", [&](int) {
+        const QJsonObject object = QJsonDocument::fromJson(JsonRequest).object();
+        sink = sink + quint64(object.value("method").toString().size());
+    });
+}
+
+void benchValidate()
+{
+    // Те же шаги, что в Server::handleRequest: поиск полей params,
+    // приоритет и имя конфигурации
+    JsonRpcEnvelope json;
+    JsonRpcParser::parse(JsonRequest, json);
+    const QByteArray cbor = cborRequest();
+    JsonRpcEnvelope cborEnvelope;
+    CborRpcParser::parse(cbor, cborEnvelope);
+
+    measure("validate", "JSON params", [&](int) {
+        QByteArrayView priority;
+        QByteArrayView configuration;
+        bool ok = JsonRpcParser::findMember(json.params, "priority", priority);
+        ok = ok && JsonRpcParser::findMember(json.params, "configuration", configuration);
+        const qint64 level = priority.toByteArray().toLongLong(&ok);
+        const QByteArrayView name = configuration.sliced(1, configuration.size() - 2);
+        sink = sink + quint64(level) + quint64(configurationFromText(name)) + quint64(ok);
+    });
+    measure("validate", "CBOR params", [&](int) {
+        QByteArrayView priority;
+        QByteArrayView configuration;
+        bool ok = CborRpcParser::findMember(cborEnvelope.params, "priority", priority);
+        ok = ok && CborRpcParser::findMember(cborEnvelope.params, "configuration", configuration);
+        const qint64 level = CborRpcParser::integer(priority, &ok);
+        sink = sink + quint64(level) + quint64(configurationFromText(CborRpcParser::text(configuration))) + quint64(ok);
+    });
+    measure("validate", "configurationFromText", [&](int i) {
+        static const QByteArrayView Names[] = {"одна строка", "четыре столбца", "3x3", "8х8", "9x9"};
+        sink = sink + quint64(configurationFromText(Names[i % 5]));
+    });
+}
+
+void benchEnqueue()
+{
+    // Очередь держится около Depth заявок: каждая итерация ставит одну и забирает одну
+    const int Depth = 1024;
+
+    RequestScheduler scheduler(2000);
+    for (int i = 0; i < Depth; ++i) {
+        scheduler.enqueue(sampleRequest(i), 0);
+    }
+    measure("enqueue", "RequestScheduler", [&](int i) {
+        scheduler.enqueue(sampleRequest(i), i / 1000);
+        sink = sink + scheduler.dequeue(i / 1000).priority;
+    });
+
+    QQueue<QueuedRequest> queue;
+    for (int i = 0; i < Depth; ++i) {
+        queue.enqueue(sampleRequest(i));
+    }
+    measure("enqueue", "QQueue (baseline)", [&](int i) {
+        queue.enqueue(sampleRequest(i));
+        sink = sink + queue.dequeue().priority;
+    });
+
+    // Отложенные заявки: сроки в пределах секунды, время идёт на 1 мс за 16 итераций
+    TimingWheel wheel(0);
+    QList<QueuedRequest> expired;
+    measure("enqueue", "TimingWheel schedule/advance", [&](int i) {
+        const qint64 now = i / 16;
+        wheel.schedule(sampleRequest(i), now + 1 + (i * 7919) % 1000);
+        wheel.advance(now, expired);
+        sink = sink + quint64(expired.size());
+        expired.clear();
+    });
+    wheel.clear();
+}
+
+// Байт, занятых в куче, или -1, если распределитель этого не сообщает
+qint64 heapInUse()
+{
+#ifdef __GLIBC__
+    // Крупные блоки (растущие массивы) glibc выделяет через mmap, они в hblkhd
+    const struct mallinfo2 info = mallinfo2();
+    return qint64(info.uordblks + info.hblkhd);
+#else
+    return -1;
+#endif
+}
+
+// Заявки от разных клиентов с разными id, как при реальной нагрузке
+QueuedRequest pendingRequest(int i)
+{
+    QueuedRequest request = {{QHostAddress(quint32(0x0a000000 + i % 65536)), quint16(1024 + i % 50000)},
+                             QString("req-%1").arg(i), 0, Grid2x2, quint8(i % 7 + 1), JsonFormat};
+    return request;
+}
+
+// Память на заявку после постановки iterations заявок и время на одну
+// постановку и одно извлечение
+template<typename Fill, typename Drain>
+void measureMemory(const char *name, Fill fill, Drain drain)
+{
+    const qint64 before = heapInUse();
+    QElapsedTimer timer;
+    timer.start();
+    fill();
+    const qint64 filled = timer.nsecsElapsed();
+    const qint64 used = heapInUse() - before;
+    timer.restart();
+    drain();
+    const qint64 drained = timer.nsecsElapsed();
+
+    if (before < 0) {
+        std::printf("%-10s %-32s %9s B/req", "memory", name, "n/a");
+    } else {
+        std::printf("%-10s %-32s %9.1f B/req", "memory", name, double(used) / iterations);
+    }
+    std::printf(" %7.1f ns/push %7.1f ns/pop\n", double(filled) / iterations, double(drained) / iterations);
+}
+
+void benchMemory()
+{
+    {
+        // Так очередь хранила заявки раньше: params целиком и адрес клиента
+        QQueue<QPair<QJsonObject, ClientInfo>> queue;
+        measureMemory("QJsonObject params (baseline)", [&] {
+            for (int i = 0; i < iterations; ++i) {
+                const QueuedRequest request = pendingRequest(i);
+                QJsonObject params;
+                params["priority"] = request.priority;
+                params["configuration"] = "четыре строки";
+                params["id"] = request.id;
+                queue.enqueue(qMakePair(params, request.client));
+            }
+        }, [&] {
+            while (!queue.isEmpty()) {
+                sink = sink + quint64(queue.dequeue().first.size());
+            }
+            queue.squeeze();
+        });
+    }
+    {
+        QQueue<QueuedRequest> queue;
+        measureMemory("QQueue<QueuedRequest> (baseline)", [&] {
+            for (int i = 0; i < iterations; ++i) {
+                queue.enqueue(pendingRequest(i));
+            }
+        }, [&] {
+            while (!queue.isEmpty()) {
+                sink = sink + queue.dequeue().priority;
+            }
+            queue.squeeze();
+        });
+    }
+    {
+        RequestScheduler scheduler(2000);
+        measureMemory("RequestScheduler", [&] {
+            for (int i = 0; i < iterations; ++i) {
+                scheduler.enqueue(pendingRequest(i), 0);
+            }
+        }, [&] {
+            while (!scheduler.isEmpty()) {
+                sink = sink + scheduler.dequeue(0).priority;
+            }
+            scheduler.clear();
+        });
+    }
+    {
+        TimingWheel wheel(0);
+        QList<QueuedRequest> expired;
+        measureMemory("TimingWheel", [&] {
+            for (int i = 0; i < iterations; ++i) {
+                wheel.schedule(pendingRequest(i), 1 + i % 100000);
+            }
+        }, [&] {
+            // Срабатывает порциями по миллисекунде, как в потоке времени
+            for (qint64 now = 1; !wheel.isEmpty(); ++now) {
+                wheel.advance(now, expired);
+                sink = sink + quint64(expired.size());
+                expired.clear();
+            }
+            wheel.clear();
+        });
+    }
+}
+
+void benchSerialize()
+{
+    const QByteArrayView id = "\"a1b2c3\"";
+    const QByteArray cborId = [] {
+        QByteArray out;
+        CborRpcParser::appendText(out, "a1b2c3");
+        return out;
+    }();
+
+    measure("serialize", "acknowledgement JSON", [&](int) {
+        sink = sink + quint64(ResponseEncoder::forThread().acknowledgement(id, JsonFormat).size());
+    });
+    measure("serialize", "acknowledgement CBOR", [&](int) {
+        sink = sink + quint64(ResponseEncoder::forThread().acknowledgement(cborId, CborFormat).size());
+    });
+    measure("serialize", "error JSON", [&](int) {
+        sink = sink + quint64(ResponseEncoder::forThread().error(
+                                  id, JsonRpcParser::InvalidParams, "Invalid priority", JsonFormat).size());
+    });
+    measure("serialize", "QJsonDocument (baseline)", [&](int) {
+        QJsonObject response;
+        response["jsonrpc"] = "2.0";
+        response["id"] = "a1b2c3";
+        response["result"] = "Request will be processed with ID: a1b2c3";
+        sink = sink + quint64(QJsonDocument(response).toJson(QJsonDocument::Compact).size());
+    });
+}
+
+void reportSize(const char *name, qsizetype json, qsizetype cbor)
+{
+    std::printf("%-10s %-32s %6lld B JSON %6lld B CBOR %6.1f%%\n", "size", name,
+                static_cast<long long>(json), static_cast<long long>(cbor), 100.0 * double(cbor) / double(json));
+}
+
+// Одни и те же запросы и ответы в обеих кодировках: запросы — как их
+// отправляет клиент, ответы — как их кодирует сервер
+void benchSize()
+{
+    QByteArray params;
+    qsizetype jsonTotal = 0;
+    qsizetype cborTotal = 0;
+    auto compare = [&](const char *name, const QByteArray &json, const QByteArray &cbor) {
+        reportSize(name, json.size(), cbor.size());
+        jsonTotal += json.size();
+        cborTotal += cbor.size();
+    };
+
+    compare("processRequest request", JsonRequest, cborRequest());
+
+    params.clear();
+    CborRpcParser::appendHead(params, 5, 3);
+    CborRpcParser::appendText(params, "priority");
+    CborRpcParser::appendHead(params, 0, 1);
+    CborRpcParser::appendText(params, "configuration");
+    CborRpcParser::appendText(params, "3x3");
+    CborRpcParser::appendText(params, "deadline");
+    CborRpcParser::appendHead(params, 0, 250);
+    compare("processRequest with deadline",
+            "{\"jsonrpc\":\"2.0\",\"method\":\"processRequest\",\"id\":\"a1b2c4\","
+            "\"params\":{\"priority\":1,\"configuration\":\"3x3\",\"deadline\":250}}",
+            cborEnvelope("processRequest", "a1b2c4", params));
+
+    params.clear();
+    CborRpcParser::appendHead(params, 5, 1);
+    CborRpcParser::appendText(params, "id");
+    CborRpcParser::appendText(params, "a1b2c3");
+    compare("getStatus request",
+            "{\"jsonrpc\":\"2.0\",\"method\":\"getStatus\",\"id\":\"s1\",\"params\":{\"id\":\"a1b2c3\"}}",
+            cborEnvelope("getStatus", "s1", params));
+    compare("cancelRequest request",
+            "{\"jsonrpc\":\"2.0\",\"method\":\"cancelRequest\",\"id\":\"c1\",\"params\":{\"id\":\"a1b2c3\"}}",
+            cborEnvelope("cancelRequest", "c1", params));
+
+    params.clear();
+    CborRpcParser::appendHead(params, 5, 1);
+    CborRpcParser::appendText(params, "seq");
+    CborRpcParser::appendHead(params, 0, 17);
+    compare("ackCompletions request",
+            "{\"jsonrpc\":\"2.0\",\"method\":\"ackCompletions\",\"id\":\"k1\",\"params\":{\"seq\":17}}",
+            cborEnvelope("ackCompletions", "k1", params));
+
+    // id ответа копируется из запроса в его кодировке
+    QByteArray cborId;
+    CborRpcParser::appendText(cborId, "a1b2c3");
+    const QByteArrayView jsonId = "\"a1b2c3\"";
+    ResponseEncoder &encoder = ResponseEncoder::forThread();
+
+    auto respond = [&](const char *name, auto encode) {
+        const QByteArray json = encode(jsonId, JsonFormat).toByteArray();
+        compare(name, json, encode(cborId, CborFormat).toByteArray());
+    };
+    respond("acknowledgement", [&](QByteArrayView id, WireFormat format) {
+        return encoder.acknowledgement(id, format);
+    });
+    respond("getStatus result", [&](QByteArrayView id, WireFormat format) {
+        QByteArray value;
+        ValueWriter writer(format, value);
+        writer.beginMap();
+        writer.key("status");
+        writer.text("queued");
+        writer.key("priority");
+        writer.integer(3);
+        writer.key("waitedMs");
+        writer.integer(120);
+        writer.endMap();
+        return encoder.result(id, value, format);
+    });
+    respond("cancelRequest result", [&](QByteArrayView id, WireFormat format) {
+        QByteArray value;
+        ValueWriter writer(format, value);
+        writer.beginMap();
+        writer.key("status");
+        writer.text("queued");
+        writer.key("cancelled");
+        writer.boolean(true);
+        writer.endMap();
+        return encoder.result(id, value, format);
+    });
+    respond("error", [&](QByteArrayView id, WireFormat format) {
+        return encoder.error(id, JsonRpcParser::InvalidParams, "Invalid priority", format);
+    });
+    respond("unknown method", [&](QByteArrayView id, WireFormat format) {
+        return encoder.unknownMethod(id, format);
+    });
+    // Уведомление о восьми завершённых заявках, как от CompletionNotifier
+    respond("requestsCompleted notification", [&](QByteArrayView, WireFormat format) {
+        QByteArray value;
+        ValueWriter writer(format, value);
+        writer.beginMap();
+        writer.key("seq");
+        writer.integer(17);
+        writer.key("results");
+        writer.beginArray();
+        for (int i = 0; i < 8; ++i) {
+            writer.beginMap();
+            writer.key("id");
+            writer.text(QByteArray("a1b2c") + QByteArray::number(i));
+            writer.key("configuration");
+            writer.text(configurationName(Grid2x2));
+            writer.key("waitedMs");
+            writer.integer(100 + i * 15);
+            writer.endMap();
+        }
+        writer.endArray();
+        writer.endMap();
+        return encoder.notification("requestsCompleted", value, format);
+    });
+
+    reportSize("total", jsonTotal, cborTotal);
+}
+
+} // namespace
+
+int main(int argc, char *argv[])
+{
+    QCoreApplication a(argc, argv);
+
+    QCommandLineParser parser;
+    parser.setApplicationDescription("Microbenchmarks of the request processing stages");
+    parser.addHelpOption();
+    QCommandLineOption iterationsOption("iterations", "Operations per run.", "count", "1000000");
+    parser.addOption(iterationsOption);
+    QCommandLineOption runsOption("runs", "Runs per benchmark; the fastest one is reported.", "count", "5");
+    parser.addOption(runsOption);
+    parser.addPositionalArgument("stage", "Stages to run: parse, validate, enqueue, serialize, memory, size (default: all).");
+    parser.process(a);
+
+    bool ok;
+    iterations = parser.value(iterationsOption).toInt(&ok);
+    if (!ok || iterations < 1) {
+        std::fprintf(stderr, "Invalid iteration count.\n");
+        return 1;
+    }
+    runs = parser.value(runsOption).toInt(&ok);
+    if (!ok || runs < 1) {
+        std::fprintf(stderr, "Invalid run count.\n");
+        return 1;
+    }
+
+    const QStringList stages = parser.positionalArguments();
+    auto selected = [&](const char *stage) { return stages.isEmpty() || stages.contains(QString(stage)); };
+    if (selected("parse")) {
+        benchParse();
+    }
+    if (selected("validate")) {
+        benchValidate();
+    }
+    if (selected("enqueue")) {
+        benchEnqueue();
+    }
+    if (selected("serialize")) {
+        benchSerialize();
+    }
+    if (selected("memory")) {
+        benchMemory();
+    }
+    if (selected("size")) {
+        benchSize();
+    }
+    return 0;
+}
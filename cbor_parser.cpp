@@ -0,0 +1,359 @@
+#include "cbor_parser.h"
+#include <QtEndian>
+#include <cstring>
+#include <limits>
+
+namespace {
+
+const int MaxDepth = 64;
+
+enum MajorType {
+    UnsignedInteger = 0,
+    NegativeInteger = 1,
+    ByteString = 2,
+    TextString = 3,
+    Array = 4,
+    Map = 5,
+    Tag = 6,
+    Simple = 7
+};
+
+const uchar Break = 0xff;
+const uchar SelfDescribeTag[] = {0xd9, 0xd9, 0xf7};
+
+struct Head {
+    int major;
+    quint64 value;
+    bool indefinite;
+};
+
+struct Cursor {
+    const uchar *p;
+    const uchar *end;
+};
+
+bool readHead(Cursor &c, Head &head)
+{
+    if (c.p >= c.end)
+        return false;
+    const uchar initial = *c.p++;
+    head.major = initial >> 5;
+    head.indefinite = false;
+
+    const int info = initial & 0x1f;
+    if (info < 24) {
+        head.value = quint64(info);
+        return true;
+    }
+    if (info == 31) {
+        // Неопределённая длина допустима только для строк, массивов и словарей
+        head.indefinite = true;
+        head.value = 0;
+        return head.major >= ByteString && head.major <= Map;
+    }
+    if (info > 27)
+        return false;
+
+    const int length = 1 << (info - 24);
+    if (c.end - c.p < length)
+        return false;
+    switch (length) {
+    case 1: head.value = *c.p; break;
+    case 2: head.value = qFromBigEndian<quint16>(c.p); break;
+    case 4: head.value = qFromBigEndian<quint32>(c.p); break;
+    default: head.value = qFromBigEndian<quint64>(c.p); break;
+    }
+    c.p += length;
+    return true;
+}
+
+bool skipItem(Cursor &c, int depth);
+
+bool skipBytes(Cursor &c, const Head &head)
+{
+    if (!head.indefinite) {
+        if (quint64(c.end - c.p) < head.value)
+            return false;
+        c.p += head.value;
+        return true;
+    }
+    // Последовательность фрагментов того же типа до Break
+    forever {
+        if (c.p >= c.end)
+            return false;
+        if (*c.p == Break) {
+            ++c.p;
+            return true;
+        }
+        Head chunk;
+        if (!readHead(c, chunk) || chunk.major != head.major || chunk.indefinite)
+            return false;
+        if (quint64(c.end - c.p) < chunk.value)
+            return false;
+        c.p += chunk.value;
+    }
+}
+
+bool skipContainer(Cursor &c, const Head &head, int depth)
+{
+    if (depth > MaxDepth)
+        return false;
+    const int perEntry = head.major == Map ? 2 : 1;
+    if (!head.indefinite) {
+        // Каждый элемент занимает хотя бы байт — отсекаем заведомо ложные длины
+        if (head.value > quint64(c.end - c.p))
+            return false;
+        for (quint64 i = 0; i < head.value * perEntry; ++i) {
+            if (!skipItem(c, depth))
+                return false;
+        }
+        return true;
+    }
+    forever {
+        if (c.p >= c.end)
+            return false;
+        if (*c.p == Break) {
+            ++c.p;
+            return true;
+        }
+        for (int i = 0; i < perEntry; ++i) {
+            if (!skipItem(c, depth))
+                return false;
+        }
+    }
+}
+
+bool skipItem(Cursor &c, int depth)
+{
+    Head head;
+    if (!readHead(c, head))
+        return false;
+    switch (head.major) {
+    case UnsignedInteger:
+    case NegativeInteger:
+        return true;
+    case ByteString:
+    case TextString:
+        return skipBytes(c, head);
+    case Array:
+    case Map:
+        return skipContainer(c, head, depth + 1);
+    case Tag:
+        return depth < MaxDepth && skipItem(c, depth + 1);
+    default:
+        return true;  // Простые значения и числа с плавающей точкой уже прочитаны в readHead
+    }
+}
+
+// Текстовая строка определённой длины; content — её содержимое
+bool readText(Cursor &c, QByteArrayView &content)
+{
+    Cursor probe = c;
+    Head head;
+    if (!readHead(probe, head) || head.major != TextString || head.indefinite
+            || quint64(probe.end - probe.p) < head.value)
+        return false;
+    content = QByteArrayView(reinterpret_cast<const char *>(probe.p), qsizetype(head.value));
+    c.p = probe.p + head.value;
+    return true;
+}
+
+inline int majorOf(QByteArrayView item)
+{
+    return item.isEmpty() ? -1 : uchar(item.at(0)) >> 5;
+}
+
+Cursor skipSelfDescribe(QByteArrayView data)
+{
+    Cursor c = {reinterpret_cast<const uchar *>(data.data()),
+                reinterpret_cast<const uchar *>(data.data()) + data.size()};
+    if (c.end - c.p >= 3 && memcmp(c.p, SelfDescribeTag, 3) == 0)
+        c.p += 3;
+    return c;
+}
+
+} // namespace
+
+JsonRpcParser::Error CborRpcParser::parse(QByteArrayView data, JsonRpcEnvelope &envelope)
+{
+    envelope = JsonRpcEnvelope();
+    envelope.format = CborFormat;
+
+    Cursor c = skipSelfDescribe(data);
+
+    Cursor probe = c;
+    if (!skipItem(probe, 0) || probe.p != probe.end)
+        return JsonRpcParser::ParseError;
+
+    Head head;
+    readHead(c, head);
+    if (head.major != Map)
+        return JsonRpcParser::InvalidRequest;
+
+    bool hasJsonrpc = false;
+    bool hasMethod = false;
+    bool wellTyped = true;
+
+    for (quint64 i = 0; head.indefinite || i < head.value; ++i) {
+        if (head.indefinite && *c.p == Break)
+            break;
+
+        QByteArrayView key;
+        const bool textKey = readText(c, key);
+        if (!textKey)
+            skipItem(c, 1);
+
+        const char *valueStart = reinterpret_cast<const char *>(c.p);
+        skipItem(c, 1);
+        const QByteArrayView value(valueStart, reinterpret_cast<const char *>(c.p));
+        if (!textKey)
+            continue;
+
+        const int major = majorOf(value);
+        if (key == QByteArrayView("jsonrpc")) {
+            hasJsonrpc = true;
+            envelope.jsonrpc = text(value);
+            wellTyped = wellTyped && isText(value);
+        } else if (key == QByteArrayView("method")) {
+            hasMethod = true;
+            envelope.method = text(value);
+            wellTyped = wellTyped && isText(value);
+        } else if (key == QByteArrayView("id")) {
+            if (isText(value) || isInteger(value) || isNull(value)) {
+                envelope.hasId = true;
+                envelope.id = value;
+            } else {
+                wellTyped = false;
+            }
+        } else if (key == QByteArrayView("params")) {
+            envelope.hasParams = true;
+            envelope.params = value;
+            wellTyped = wellTyped && (major == Map || major == Array);
+        }
+    }
+
+    if (!wellTyped || !hasMethod || (hasJsonrpc && envelope.jsonrpc != QByteArrayView("2.0")))
+        return JsonRpcParser::InvalidRequest;
+    return JsonRpcParser::NoError;
+}
+
+bool CborRpcParser::isBatch(QByteArrayView data)
+{
+    const Cursor c = skipSelfDescribe(data);
+    return c.p < c.end && (*c.p >> 5) == Array;
+}
+
+JsonRpcParser::Error CborRpcParser::parseBatch(QByteArrayView data, BatchElements &elements)
+{
+    elements.clear();
+    Cursor c = skipSelfDescribe(data);
+
+    Cursor probe = c;
+    if (!skipItem(probe, 0) || probe.p != probe.end)
+        return JsonRpcParser::ParseError;
+
+    Head head;
+    readHead(c, head);
+    if (head.major != Array)
+        return JsonRpcParser::InvalidRequest;
+
+    for (quint64 i = 0; head.indefinite || i < head.value; ++i) {
+        if (head.indefinite && *c.p == Break)
+            break;
+        const char *elementStart = reinterpret_cast<const char *>(c.p);
+        skipItem(c, 1);
+        elements.append(QByteArrayView(elementStart, reinterpret_cast<const char *>(c.p)));
+    }
+    return elements.isEmpty() ? JsonRpcParser::InvalidRequest : JsonRpcParser::NoError;
+}
+
+bool CborRpcParser::findMember(QByteArrayView map, QByteArrayView key, QByteArrayView &value)
+{
+    Cursor c = {reinterpret_cast<const uchar *>(map.data()),
+                reinterpret_cast<const uchar *>(map.data()) + map.size()};
+    Head head;
+    if (!readHead(c, head) || head.major != Map)
+        return false;
+
+    for (quint64 i = 0; head.indefinite || i < head.value; ++i) {
+        if (c.p >= c.end || (head.indefinite && *c.p == Break))
+            return false;
+        QByteArrayView name;
+        const bool textKey = readText(c, name);
+        if (!textKey && !skipItem(c, 1))
+            return false;
+        const char *valueStart = reinterpret_cast<const char *>(c.p);
+        if (!skipItem(c, 1))
+            return false;
+        if (textKey && name == key) {
+            value = QByteArrayView(valueStart, reinterpret_cast<const char *>(c.p));
+            return true;
+        }
+    }
+    return false;
+}
+
+bool CborRpcParser::isText(QByteArrayView item)
+{
+    // Только строки определённой длины: их содержимое непрерывно
+    return majorOf(item) == TextString && (uchar(item.at(0)) & 0x1f) != 31;
+}
+
+bool CborRpcParser::isInteger(QByteArrayView item)
+{
+    const int major = majorOf(item);
+    return major == UnsignedInteger || major == NegativeInteger;
+}
+
+QByteArrayView CborRpcParser::text(QByteArrayView item)
+{
+    Cursor c = {reinterpret_cast<const uchar *>(item.data()),
+                reinterpret_cast<const uchar *>(item.data()) + item.size()};
+    QByteArrayView content;
+    readText(c, content);
+    return content;
+}
+
+qint64 CborRpcParser::integer(QByteArrayView item, bool *ok)
+{
+    Cursor c = {reinterpret_cast<const uchar *>(item.data()),
+                reinterpret_cast<const uchar *>(item.data()) + item.size()};
+    Head head;
+    const bool valid = readHead(c, head) && (head.major == UnsignedInteger || head.major == NegativeInteger)
+            && head.value <= quint64(std::numeric_limits<qint64>::max());
+    if (ok)
+        *ok = valid;
+    if (!valid)
+        return 0;
+    // Отрицательное число кодируется как -1 - n
+    return head.major == UnsignedInteger ? qint64(head.value) : -1 - qint64(head.value);
+}
+
+void CborRpcParser::appendHead(QByteArray &out, int majorType, quint64 value)
+{
+    const uchar major = uchar(majorType << 5);
+    if (value < 24) {
+        out.append(char(major | value));
+    } else if (value <= 0xff) {
+        out.append(char(major | 24));
+        out.append(char(value));
+    } else if (value <= 0xffff) {
+        char bytes[3] = {char(major | 25)};
+        qToBigEndian<quint16>(quint16(value), bytes + 1);
+        out.append(bytes, sizeof(bytes));
+    } else if (value <= 0xffffffffu) {
+        char bytes[5] = {char(major | 26)};
+        qToBigEndian<quint32>(quint32(value), bytes + 1);
+        out.append(bytes, sizeof(bytes));
+    } else {
+        char bytes[9] = {char(major | 27)};
+        qToBigEndian<quint64>(value, bytes + 1);
+        out.append(bytes, sizeof(bytes));
+    }
+}
+
+void CborRpcParser::appendText(QByteArray &out, QByteArrayView text)
+{
+    appendHead(out, TextString, quint64(text.size()));
+    out.append(text.data(), text.size());
+}
@@ -0,0 +1,37 @@
+#ifndef CBOR_PARSER_H
+#define CBOR_PARSER_H
+
+#include <QByteArray>
+#include <QByteArrayView>
+#include "jsonrpc_parser.h"
+
+// Разбор конверта JSON-RPC, закодированного в CBOR (RFC 8949): тот же
+// JsonRpcEnvelope со срезами исходного буфера, без построения QCborValue.
+// Элементы проверяются целиком; строки неопределённой длины допустимы
+// внутри params, но не в полях конверта.
+class CborRpcParser
+{
+public:
+    static JsonRpcParser::Error parse(QByteArrayView data, JsonRpcEnvelope &envelope);
+
+    // Пакетный запрос — массив верхнего уровня
+    static bool isBatch(QByteArrayView data);
+    static JsonRpcParser::Error parseBatch(QByteArrayView data, BatchElements &elements);
+
+    // Значение ключа key в закодированном словаре map; false, если ключа нет
+    static bool findMember(QByteArrayView map, QByteArrayView key, QByteArrayView &value);
+
+    static bool isText(QByteArrayView item);
+    static bool isInteger(QByteArrayView item);
+    static bool isNull(QByteArrayView item) { return item.size() == 1 && uchar(item.at(0)) == 0xf6; }
+
+    // Содержимое текстовой строки определённой длины
+    static QByteArrayView text(QByteArrayView item);
+    static qint64 integer(QByteArrayView item, bool *ok = nullptr);
+
+    // Заголовок элемента: старший тип и длина/значение
+    static void appendHead(QByteArray &out, int majorType, quint64 value);
+    static void appendText(QByteArray &out, QByteArrayView text);
+};
+
+#endif // CBOR_PARSER_H
@@ -0,0 +1,339 @@
+#include "completion_notifier.h"
+#include "flat_hash.h"
+#include "logger.h"
+#include "metrics.h"
+#include "response_encoder.h"
+#include <QDeadlineTimer>
+#include <QMutex>
+#include <QThread>
+#include <QWaitCondition>
+#include <algorithm>
+#include <utility>
+
+namespace {
+
+// Больше стольких уведомлений не ждут подтверждения, новые сверх них уходят без повторов
+const int MaxOutstanding = 65536;
+// Запас на конверт уведомления и номер сверх самих результатов, байт
+const int EnvelopeSize = 96;
+
+struct Completion {
+    ClientInfo client;
+    QString id;
+    bool numericId;
+    Configuration configuration;
+    WireFormat format;
+    qint64 waited;
+};
+
+// Завершения одного клиента, ожидающие отправки
+struct Batch {
+    ClientInfo client;
+    ClientKey key;
+    WireFormat format = JsonFormat;
+    QByteArray results;  // Закодированные элементы массива results подряд
+    int count = 0;
+    qint64 flushAt = 0;
+};
+
+// Отправленное, но ещё не подтверждённое уведомление
+struct Outstanding {
+    ClientInfo client;
+    ClientKey key;
+    QByteArray datagram;
+    int sent = 0;
+    qint64 interval = 0;
+};
+
+struct Retry {
+    qint64 at;
+    quint64 sequence;
+
+    // Для кучи std::push_heap: наверху ближайший срок
+    bool operator<(const Retry &other) const { return at > other.at; }
+};
+
+} // namespace
+
+class CompletionNotifier::Private
+{
+public:
+    Private(DatagramSink *sink, int window, int maxSize, int retryInterval, int attempts)
+        : sink(sink), window(qMax(0, window)), maxSize(maxSize), retryInterval(qMax(1, retryInterval)),
+          attempts(qMax(1, attempts)), stopping(false), thread(nullptr), nextSequence(1)
+    {
+    }
+
+    void run();
+    void add(const Completion &completion, qint64 now);
+    void flush(int slot, qint64 now);
+    void retransmit(qint64 now);
+    qint64 nextDeadline() const;
+
+    DatagramSink *const sink;
+    const int window;
+    const int maxSize;
+    const int retryInterval;
+    const int attempts;
+
+    QMutex mutex;  // Защищает incoming, acks и stopping
+    QWaitCondition wake;
+    QList<Completion> incoming;
+    QList<std::pair<ClientKey, quint64>> acks;
+    bool stopping;
+    QThread *thread;
+    QAtomicInt waiting;  // Размер outstanding для unacknowledged()
+
+    // Дальше — только поток уведомлений
+    QList<Batch> batches;
+    FlatHashMap<ClientKey, int> batchIndex;  // Клиент -> номер в batches
+    FlatHashMap<quint64, Outstanding> outstanding;
+    QList<Retry> retries;  // Куча по сроку повтора; подтверждённые пропускаются при извлечении
+    quint64 nextSequence;
+};
+
+void CompletionNotifier::Private::add(const Completion &completion, qint64 now)
+{
+    const ClientKey key = ClientKey::of(completion.client);
+
+    QByteArray item;
+    ValueWriter writer(completion.format, item);
+    writer.beginMap();
+    writer.key("id");
+    writer.id(completion.id, completion.numericId);
+    writer.key("configuration");
+    writer.text(configurationName(completion.configuration));
+    writer.key("waitedMs");
+    writer.integer(completion.waited);
+    writer.endMap();
+
+    forever {
+        bool inserted;
+        int &slot = batchIndex.findOrInsert(key, -1, &inserted);
+        if (inserted) {
+            slot = int(batches.size());
+            Batch batch;
+            batch.client = completion.client;
+            batch.key = key;
+            batch.format = completion.format;
+            batch.flushAt = now + window;
+            batches.append(batch);
+        }
+        Batch &batch = batches[slot];
+        // В одной датаграмме — одна кодировка и не больше maxSize байт
+        if (batch.count > 0
+                && (batch.format != completion.format
+                    || batch.results.size() + item.size() + 1 + EnvelopeSize > maxSize)) {
+            flush(slot, now);
+            continue;
+        }
+        if (batch.count > 0 && batch.format == JsonFormat) {
+            batch.results.append(',');
+        }
+        batch.results.append(item);
+        ++batch.count;
+        return;
+    }
+}
+
+void CompletionNotifier::Private::flush(int slot, qint64 now)
+{
+    Batch batch = std::move(batches[slot]);
+    batchIndex.remove(batch.key);
+    if (slot != batches.size() - 1) {
+        batches[slot] = std::move(batches.last());
+        *batchIndex.find(batches[slot].key) = slot;
+    }
+    batches.removeLast();
+
+    const quint64 sequence = nextSequence++;
+    QByteArray params;
+    ValueWriter writer(batch.format, params);
+    writer.beginMap();
+    writer.key("seq");
+    writer.integer(qint64(sequence));
+    writer.key("results");
+    writer.beginArray();
+    params.append(batch.results);
+    writer.endArray();
+    writer.endMap();
+
+    const QByteArrayView datagram = ResponseEncoder::forThread().notification("requestsCompleted", params, batch.format);
+    sink->sendDatagram(datagram, batch.client);
+    Metrics::add(Metrics::CompletionsPushed, quint64(batch.count));
+
+    if (attempts > 1 && outstanding.size() < MaxOutstanding) {
+        Outstanding &entry = outstanding.findOrInsert(sequence, Outstanding());
+        entry.client = batch.client;
+        entry.key = batch.key;
+        entry.datagram = datagram.toByteArray();
+        entry.sent = 1;
+        entry.interval = retryInterval;
+        retries.append(Retry{now + retryInterval, sequence});
+        std::push_heap(retries.begin(), retries.end());
+    }
+}
+
+void CompletionNotifier::Private::retransmit(qint64 now)
+{
+    while (!retries.isEmpty() && retries.first().at <= now) {
+        std::pop_heap(retries.begin(), retries.end());
+        const quint64 sequence = retries.takeLast().sequence;
+        Outstanding *entry = outstanding.find(sequence);
+        if (!entry) {
+            continue;  // Уже подтверждено
+        }
+        if (entry->sent >= attempts) {
+            Metrics::add(Metrics::CompletionsDropped);
+            LOG_SAMPLED(Logger::Debug, "Completion notice %1 to %2:%3 was never acknowledged",
+                        sequence, entry->client.address.toString(), entry->client.port);
+            outstanding.remove(sequence);
+            continue;
+        }
+        sink->sendDatagram(entry->datagram, entry->client);
+        Metrics::add(Metrics::CompletionsResent);
+        ++entry->sent;
+        entry->interval *= 2;
+        retries.append(Retry{now + entry->interval, sequence});
+        std::push_heap(retries.begin(), retries.end());
+    }
+}
+
+qint64 CompletionNotifier::Private::nextDeadline() const
+{
+    qint64 deadline = retries.isEmpty() ? -1 : retries.first().at;
+    for (const Batch &batch : batches) {
+        if (deadline < 0 || batch.flushAt < deadline) {
+            deadline = batch.flushAt;
+        }
+    }
+    return deadline;
+}
+
+void CompletionNotifier::Private::run()
+{
+    QList<Completion> completions;
+    QList<std::pair<ClientKey, quint64>> acknowledged;
+    forever {
+        {
+            QMutexLocker locker(&mutex);
+            forever {
+                if (stopping) {
+                    return;
+                }
+                if (!incoming.isEmpty() || !acks.isEmpty()) {
+                    break;
+                }
+                const qint64 deadline = nextDeadline();
+                const qint64 now = QDeadlineTimer::current().deadline();
+                if (deadline >= 0 && deadline <= now) {
+                    break;
+                }
+                if (deadline < 0) {
+                    wake.wait(&mutex);
+                } else {
+                    wake.wait(&mutex, ulong(deadline - now));
+                }
+            }
+            completions.swap(incoming);
+            acknowledged.swap(acks);
+        }
+
+        for (const auto &ack : std::as_const(acknowledged)) {
+            const Outstanding *entry = outstanding.find(ack.second);
+            // Подтвердить можно только уведомление, отправленное этому же клиенту
+            if (entry && entry->key == ack.first) {
+                outstanding.remove(ack.second);
+            }
+        }
+        acknowledged.clear();
+
+        const qint64 now = QDeadlineTimer::current().deadline();
+        for (const Completion &completion : std::as_const(completions)) {
+            add(completion, now);
+        }
+        completions.clear();
+
+        // Сдвиг последней пачки на место отправленной не мешает обходу с конца
+        for (int i = int(batches.size()) - 1; i >= 0; --i) {
+            if (batches.at(i).flushAt <= now) {
+                flush(i, now);
+            }
+        }
+        retransmit(now);
+        waiting.storeRelaxed(outstanding.size());
+    }
+}
+
+CompletionNotifier::CompletionNotifier(DatagramSink *sink, int window, int maxSize, int retryInterval, int attempts)
+    : d(new Private(sink, window, maxSize, retryInterval, attempts))
+{
+}
+
+CompletionNotifier::~CompletionNotifier()
+{
+    stop();
+    delete d;
+}
+
+void CompletionNotifier::start()
+{
+    QMutexLocker locker(&d->mutex);
+    if (d->thread) {
+        return;
+    }
+    d->stopping = false;
+    d->thread = QThread::create([this] { d->run(); });
+    d->thread->setObjectName("completions");
+    d->thread->start();
+}
+
+void CompletionNotifier::stop()
+{
+    QThread *thread;
+    {
+        QMutexLocker locker(&d->mutex);
+        if (!d->thread) {
+            return;
+        }
+        d->stopping = true;
+        d->wake.wakeOne();
+        thread = d->thread;
+        d->thread = nullptr;
+    }
+    thread->wait();
+    delete thread;
+
+    if (d->outstanding.size() > 0 || !d->batches.isEmpty()) {
+        LOG_INFO("Dropped %1 unacknowledged and %2 unsent completion notice(s)",
+                 d->outstanding.size(), d->batches.size());
+    }
+    d->batches.clear();
+    d->batchIndex.clear();
+    d->outstanding.clear();
+    d->retries.clear();
+    d->waiting.storeRelaxed(0);
+}
+
+void CompletionNotifier::completed(const QueuedRequest &request, qint64 waited)
+{
+    QMutexLocker locker(&d->mutex);
+    d->incoming.append(Completion{request.client, request.id, request.numericId, request.configuration, request.format, waited});
+    if (d->incoming.size() == 1) {
+        d->wake.wakeOne();
+    }
+}
+
+void CompletionNotifier::acknowledge(const ClientKey &client, quint64 sequence)
+{
+    QMutexLocker locker(&d->mutex);
+    d->acks.append(std::make_pair(client, sequence));
+    if (d->acks.size() == 1) {
+        d->wake.wakeOne();
+    }
+}
+
+int CompletionNotifier::unacknowledged() const
+{
+    return d->waiting.loadRelaxed();
+}
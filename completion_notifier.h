@@ -0,0 +1,36 @@
+#ifndef COMPLETION_NOTIFIER_H
+#define COMPLETION_NOTIFIER_H
+
+#include "datagram.h"
+#include "request.h"
+
+// Уведомления клиентам о завершении их заявок. Завершения одного клиента,
+// пришедшие в пределах window мс, склеиваются в одно уведомление
+// requestsCompleted {"seq": N, "results": [...]} не больше maxSize байт.
+// Клиент подтверждает его вызовом ackCompletions {"seq": N}; без
+// подтверждения уведомление повторяется через retryInterval мс с удвоением
+// интервала, всего не больше attempts отправок.
+// Отправкой и повторами занимается свой поток; sink должен допускать
+// вызовы из него.
+class CompletionNotifier
+{
+public:
+    CompletionNotifier(DatagramSink *sink, int window, int maxSize, int retryInterval, int attempts);
+    ~CompletionNotifier();
+
+    void start();
+    // Неотправленные и неподтверждённые уведомления отбрасываются
+    void stop();
+
+    // Из потоков обработки; waited — мс от постановки в очередь до завершения
+    void completed(const QueuedRequest &request, qint64 waited);
+    void acknowledge(const ClientKey &client, quint64 sequence);
+
+    int unacknowledged() const;
+
+private:
+    class Private;
+    Private *d;
+};
+
+#endif // COMPLETION_NOTIFIER_H
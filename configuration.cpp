@@ -0,0 +1,125 @@
+#include "configuration.h"
+#include <cstring>
+
+namespace {
+
+struct Name {
+    const char *text;
+    Configuration value;
+};
+
+// Названия в UTF-8; сетки записаны латинской x, кириллица приводится к ней при разборе
+constexpr Name Names[] = {
+    {"одна строка", OneRow},
+    {"две строки", TwoRows},
+    {"три строки", ThreeRows},
+    {"четыре строки", FourRows},
+    {"один столбец", OneColumn},
+    {"два столбца", TwoColumns},
+    {"три столбца", ThreeColumns},
+    {"четыре столбца", FourColumns},
+    {"1x1", Grid1x1},
+    {"1x2", Grid1x2},
+    {"1x3", Grid1x3},
+    {"2x2", Grid2x2},
+    {"2x3", Grid2x3},
+    {"3x3", Grid3x3},
+    {"4x4", Grid4x4},
+    {"8x8", Grid8x8}
+};
+constexpr int NameCount = int(sizeof(Names) / sizeof(Names[0]));
+
+const int MaxNameSize = 32;
+const int TableSize = 32;
+const quint32 HashSeed = 229;  // Подобрано так, чтобы все названия попали в разные слоты
+
+constexpr int textSize(const char *text)
+{
+    int size = 0;
+    while (text[size] != '\0')
+        ++size;
+    return size;
+}
+
+// FNV-1a с перемешиванием в конце (как в MurmurHash3): младшие биты
+// чистого FNV у похожих строк вроде 1x1/1x2 совпадают
+constexpr quint32 hashName(const char *text, int size)
+{
+    quint32 hash = 2166136261u ^ HashSeed;
+    for (int i = 0; i < size; ++i) {
+        hash ^= quint32(static_cast<unsigned char>(text[i]));
+        hash *= 16777619u;
+    }
+    hash ^= hash >> 16;
+    hash *= 0x85ebca6bu;
+    hash ^= hash >> 13;
+    hash *= 0xc2b2ae35u;
+    hash ^= hash >> 16;
+    return hash;
+}
+
+struct Table {
+    quint8 entries[TableSize];  // Номер в Names плюс один, 0 — пустой слот
+    bool perfect;
+};
+
+constexpr Table buildTable()
+{
+    Table table = {};
+    table.perfect = true;
+    for (int i = 0; i < NameCount; ++i) {
+        const int size = textSize(Names[i].text);
+        quint8 &entry = table.entries[hashName(Names[i].text, size) % TableSize];
+        if (entry != 0 || size > MaxNameSize)
+            table.perfect = false;
+        entry = quint8(i + 1);
+    }
+    return table;
+}
+
+constexpr Table Lookup = buildTable();
+static_assert(Lookup.perfect, "Configuration names collide; pick another HashSeed");
+
+// Порядок Names совпадает с перечислением — по нему же ищется название
+constexpr bool namesInOrder()
+{
+    for (int i = 0; i < NameCount; ++i) {
+        if (Names[i].value != OneRow + i)
+            return false;
+    }
+    return NameCount == InvalidConfiguration - OneRow;
+}
+static_assert(namesInOrder(), "Names must follow the Configuration order");
+
+} // namespace
+
+Configuration configurationFromText(QByteArrayView text)
+{
+    char normalized[MaxNameSize];
+    int size = 0;
+    for (qsizetype i = 0; i < text.size(); ++i) {
+        if (size == MaxNameSize)
+            return InvalidConfiguration;
+        if (uchar(text.at(i)) == 0xd1 && i + 1 < text.size() && uchar(text.at(i + 1)) == 0x85) {
+            normalized[size++] = 'x';  // Кириллическая «х»
+            ++i;
+        } else {
+            normalized[size++] = text.at(i);
+        }
+    }
+
+    const int entry = Lookup.entries[hashName(normalized, size) % TableSize];
+    if (entry == 0)
+        return InvalidConfiguration;
+    const Name &name = Names[entry - 1];
+    if (textSize(name.text) != size || memcmp(name.text, normalized, size_t(size)) != 0)
+        return InvalidConfiguration;
+    return name.value;
+}
+
+const char *configurationName(Configuration configuration)
+{
+    if (configuration >= OneRow && configuration < InvalidConfiguration)
+        return Names[configuration - OneRow].text;
+    return configuration == NoConfiguration ? "none" : "invalid";
+}
@@ -0,0 +1,34 @@
+#ifndef CONFIGURATION_H
+#define CONFIGURATION_H
+
+#include <QByteArrayView>
+
+// Раскладка из params.configuration. Название разбирается один раз при
+// приёме заявки, дальше в очереди хранится только этот байт.
+enum Configuration : quint8 {
+    NoConfiguration,  // Параметр не задан
+    OneRow,
+    TwoRows,
+    ThreeRows,
+    FourRows,
+    OneColumn,
+    TwoColumns,
+    ThreeColumns,
+    FourColumns,
+    Grid1x1,
+    Grid1x2,
+    Grid1x3,
+    Grid2x2,
+    Grid2x3,
+    Grid3x3,
+    Grid4x4,
+    Grid8x8,
+    InvalidConfiguration
+};
+
+// text — название в UTF-8; в сетках допустима и кириллическая «х», и латинская x.
+// Неизвестное название — InvalidConfiguration
+Configuration configurationFromText(QByteArrayView text);
+const char *configurationName(Configuration configuration);
+
+#endif // CONFIGURATION_H
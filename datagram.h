@@ -0,0 +1,24 @@
+#ifndef DATAGRAM_H
+#define DATAGRAM_H
+
+#include <QByteArray>
+#include <QByteArrayView>
+#include "request.h"
+
+// Куда отправлять ответы на принятую датаграмму; data копируется до возврата
+class DatagramSink
+{
+public:
+    virtual ~DatagramSink() {}
+    virtual void sendDatagram(QByteArrayView data, const ClientInfo &client) = 0;
+};
+
+// Обработчик входящих датаграмм; data действительна только во время вызова
+class DatagramHandler
+{
+public:
+    virtual ~DatagramHandler() {}
+    virtual void handleDatagram(QByteArrayView data, const ClientInfo &sender, DatagramSink &reply) = 0;
+};
+
+#endif // DATAGRAM_H
@@ -0,0 +1,173 @@
+#ifndef FLAT_HASH_H
+#define FLAT_HASH_H
+
+#include <QList>
+#include <QtGlobal>
+#include <utility>
+
+// Хеш целочисленных ключей — само значение, перемешивает его FlatHashMap.
+// Объявлен до шаблона: для встроенных типов поиск по аргументам не работает
+inline quint64 hashOf(quint64 key) { return key; }
+
+// Финализатор murmur3: все биты хеша влияют на младшие
+inline quint64 hashMix(quint64 h)
+{
+    h ^= h >> 33;
+    h *= Q_UINT64_C(0xff51afd7ed558ccd);
+    h ^= h >> 33;
+    h *= Q_UINT64_C(0xc4ceb9fe1a85ec53);
+    h ^= h >> 33;
+    return h;
+}
+
+// Хеш-таблица с открытой адресацией и линейным пробированием: ключи и
+// значения лежат в одном непрерывном массиве, без отдельного узла на
+// запись. Удаление — обратным сдвигом, без надгробий, поэтому цепочки
+// не деградируют. Для ключа нужны operator== и hashOf(key); хеш
+// дополнительно перемешивается, так что hashOf может быть простым.
+// Указатели на значения действительны до следующей вставки.
+template<typename Key, typename Value>
+class FlatHashMap
+{
+public:
+    explicit FlatHashMap(int capacity = 16) { allocate(capacity); }
+
+    int size() const { return count; }
+    bool isEmpty() const { return count == 0; }
+    int capacity() const { return int(table.size()); }
+
+    Value *find(const Key &key)
+    {
+        const int i = indexOf(key);
+        return i < 0 ? nullptr : &table[i].value;
+    }
+    const Value *find(const Key &key) const
+    {
+        const int i = indexOf(key);
+        return i < 0 ? nullptr : &table[i].value;
+    }
+
+    // Значение для key; новое создаётся из initial. inserted — была ли вставка
+    Value &findOrInsert(const Key &key, const Value &initial, bool *inserted = nullptr)
+    {
+        if ((count + 1) * 4 > capacity() * 3)
+            rehash(capacity() * 2);
+        int i = home(key);
+        while (table[i].used) {
+            if (table[i].key == key) {
+                if (inserted)
+                    *inserted = false;
+                return table[i].value;
+            }
+            i = (i + 1) & mask;
+        }
+        table[i].used = true;
+        table[i].key = key;
+        table[i].value = initial;
+        ++count;
+        if (inserted)
+            *inserted = true;
+        return table[i].value;
+    }
+
+    bool remove(const Key &key)
+    {
+        int hole = indexOf(key);
+        if (hole < 0)
+            return false;
+        // Обратный сдвиг: записи той же цепочки подтягиваются в дыру,
+        // если их исходная позиция не лежит между дырой и ними
+        for (int i = (hole + 1) & mask; table[i].used; i = (i + 1) & mask) {
+            const int wanted = home(table[i].key);
+            if (((i - wanted) & mask) >= ((i - hole) & mask)) {
+                table[hole] = std::move(table[i]);
+                hole = i;
+            }
+        }
+        table[hole].used = false;
+        table[hole].value = Value();
+        --count;
+        return true;
+    }
+
+    // Удаляет записи, для которых predicate(key, value) истинно, и
+    // перестраивает таблицу под оставшиеся
+    template<typename Predicate>
+    int removeIf(Predicate predicate)
+    {
+        const int before = count;
+        QList<Slot> old;
+        old.swap(table);
+        allocate(int(old.size()));
+        for (Slot &slot : old) {
+            if (slot.used && !predicate(slot.key, slot.value))
+                place(std::move(slot));
+        }
+        return before - count;
+    }
+
+    template<typename Function>
+    void forEach(Function function) const
+    {
+        for (const Slot &slot : table) {
+            if (slot.used)
+                function(slot.key, slot.value);
+        }
+    }
+
+    void clear() { allocate(16); }
+
+private:
+    struct Slot {
+        Key key = Key();
+        Value value = Value();
+        bool used = false;
+    };
+
+    int home(const Key &key) const { return int(hashMix(quint64(hashOf(key))) & quint64(mask)); }
+
+    int indexOf(const Key &key) const
+    {
+        for (int i = home(key); table[i].used; i = (i + 1) & mask) {
+            if (table[i].key == key)
+                return i;
+        }
+        return -1;
+    }
+
+    void allocate(int wanted)
+    {
+        int size = 16;
+        while (size < wanted)
+            size *= 2;
+        table = QList<Slot>(size);
+        mask = size - 1;
+        count = 0;
+    }
+
+    void place(Slot &&slot)
+    {
+        int i = home(slot.key);
+        while (table[i].used)
+            i = (i + 1) & mask;
+        table[i] = std::move(slot);
+        ++count;
+    }
+
+    void rehash(int wanted)
+    {
+        QList<Slot> old;
+        old.swap(table);
+        allocate(wanted);
+        for (Slot &slot : old) {
+            if (slot.used)
+                place(std::move(slot));
+        }
+    }
+
+    QList<Slot> table;
+    int mask;
+    int count;
+};
+
+#endif // FLAT_HASH_H
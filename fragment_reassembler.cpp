@@ -0,0 +1,145 @@
+#include "fragment_reassembler.h"
+#include "logger.h"
+#include "metrics.h"
+#include <QtEndian>
+#include <cstring>
+
+namespace {
+
+// Номеров недостающих фрагментов в одном NACK: он должен уйти одной датаграммой
+const int MaxNackEntries = 512;
+
+} // namespace
+
+FragmentReassembler::FragmentReassembler(qint64 memoryLimit)
+    : memoryLimit(memoryLimit)
+    , memory(0)
+{
+}
+
+QByteArrayView FragmentReassembler::add(QByteArrayView fragment, const ClientInfo &sender, qint64 now)
+{
+    Metrics::add(Metrics::FragmentsReceived);
+    if (fragment.size() < HeaderSize || uchar(fragment.at(1)) != Data) {
+        Metrics::add(Metrics::ReassemblyDropped);
+        return QByteArrayView();
+    }
+    const uchar *header = reinterpret_cast<const uchar *>(fragment.data());
+    const quint16 index = qFromBigEndian<quint16>(header + 2);
+    const quint16 count = qFromBigEndian<quint16>(header + 4);
+    Key key;
+    key.client = ClientKey::of(sender);
+    key.message = qFromBigEndian<quint32>(header + 6);
+    const quint32 total = qFromBigEndian<quint32>(header + 10);
+
+    // Куски по ceil(total / count), последний не пустой
+    const quint32 chunk = count > 0 ? (total + count - 1) / count : 0;
+    if (count == 0 || index >= count || total == 0 || total > MaxMessageSize
+            || quint64(chunk) * (count - 1) >= total) {
+        Metrics::add(Metrics::ReassemblyDropped);
+        LOG_SAMPLED(Logger::Debug, "Invalid fragment header from %1:%2", sender.address.toString(), sender.port);
+        return QByteArrayView();
+    }
+    const quint32 offset = chunk * index;
+    const quint32 size = index + 1 < count ? chunk : total - offset;
+    if (quint32(fragment.size() - HeaderSize) != size) {
+        Metrics::add(Metrics::ReassemblyDropped);
+        return QByteArrayView();
+    }
+
+    Message *message = messages.find(key);
+    if (!message) {
+        if (count == 1) {
+            // Единственный фрагмент собирать не нужно
+            return fragment.sliced(HeaderSize);
+        }
+        if (messages.size() >= MaxMessages || memory + total > memoryLimit) {
+            Metrics::add(Metrics::ReassemblyDropped);
+            LOG_SAMPLED(Logger::Warning, "Reassembly table is full, dropping a fragment from %1:%2",
+                        sender.address.toString(), sender.port);
+            return QByteArrayView();
+        }
+        message = &messages.findOrInsert(key, Message());
+        message->client = sender;
+        message->buffer.resize(total);
+        message->received.fill(0, (count + 63) / 64);
+        message->chunk = chunk;
+        message->count = count;
+        message->missing = count;
+        message->nextNack = now + NackDelay;
+        memory += total;
+    } else if (message->count != count || quint32(message->buffer.size()) != total) {
+        Metrics::add(Metrics::ReassemblyDropped);
+        return QByteArrayView();
+    }
+
+    message->lastFragment = now;
+    message->nextNack = qMax(message->nextNack, now + NackDelay);
+    quint64 &word = message->received[index / 64];
+    const quint64 bit = quint64(1) << (index % 64);
+    if (word & bit) {
+        return QByteArrayView();  // Повтор уже принятого фрагмента
+    }
+    word |= bit;
+    message->receivedBytes += quint32(fragment.size());
+    memcpy(message->buffer.data() + offset, fragment.data() + HeaderSize, size);
+    if (--message->missing > 0) {
+        return QByteArrayView();
+    }
+
+    completed.swap(message->buffer);
+    memory -= total;
+    messages.remove(key);
+    return completed;
+}
+
+void FragmentReassembler::expire(qint64 now, DatagramSink &sink)
+{
+    messages.removeIf([&](const Key &key, Message &message) {
+        if (now - message.lastFragment >= Timeout) {
+            Metrics::add(Metrics::ReassemblyDropped);
+            LOG_SAMPLED(Logger::Debug, "Reassembly of message %1 from %2:%3 timed out with %4 of %5 fragment(s) missing",
+                        key.message, message.client.address.toString(), message.client.port,
+                        message.missing, message.count);
+            memory -= message.buffer.size();
+            return true;
+        }
+        // Один принятый фрагмент ещё не подтверждает, что отправитель настоящий
+        if (now >= message.nextNack && message.nacks < MaxNackRounds
+                && message.count - message.missing >= 2) {
+            Metrics::add(Metrics::FragmentNacks);
+            sink.sendDatagram(nack(key, message, int(message.receivedBytes)), message.client);
+            ++message.nacks;
+            message.nextNack = now + NackDelay;
+        }
+        return false;
+    });
+}
+
+QByteArray FragmentReassembler::nack(const Key &key, const Message &message, int maxSize)
+{
+    // Ответ не больше запроса: остальные номера уйдут в следующем NACK
+    const int entries = qMin(qMin<int>(message.missing, MaxNackEntries), (maxSize - HeaderSize) / 2);
+    QByteArray out;
+    out.reserve(HeaderSize + 2 * entries);
+    char header[HeaderSize];
+    header[0] = char(Marker);
+    header[1] = char(Nack);
+    qToBigEndian<quint16>(0, header + 2);
+    qToBigEndian<quint16>(message.count, header + 4);
+    qToBigEndian<quint32>(key.message, header + 6);
+    qToBigEndian<quint32>(quint32(message.buffer.size()), header + 10);
+    out.append(header, HeaderSize);
+
+    int listed = 0;
+    for (int index = 0; index < message.count && listed < entries; ++index) {
+        if (message.received.at(index / 64) & (quint64(1) << (index % 64))) {
+            continue;
+        }
+        char entry[2];
+        qToBigEndian<quint16>(quint16(index), entry);
+        out.append(entry, 2);
+        ++listed;
+    }
+    return out;
+}
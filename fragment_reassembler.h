@@ -0,0 +1,86 @@
+#ifndef FRAGMENT_REASSEMBLER_H
+#define FRAGMENT_REASSEMBLER_H
+
+#include <QByteArray>
+#include <QByteArrayView>
+#include <QList>
+#include "datagram.h"
+#include "flat_hash.h"
+
+// Сборка запросов, не поместившихся в одну датаграмму. Фрагмент начинается
+// с заголовка из HeaderSize байт (числа big-endian):
+//   marker (0x1e) | type | index: u16 | count: u16 | message: u32 | total: u32
+// Тело сообщения total байт режется на count равных кусков по
+// ceil(total / count) байт, последний — остаток; поэтому место фрагмента в
+// буфере известно по его номеру, и каждый сразу копируется в буфер,
+// выделенный под всё сообщение при первом фрагменте.
+// Если фрагменты перестали приходить, клиенту уходит NACK — тот же
+// заголовок с type = Nack и номерами недостающих фрагментов (u16) в теле.
+// Чтобы сервер не усиливал поддельный трафик, NACK шлётся только после
+// второго принятого фрагмента, не чаще MaxNackRounds раз на сообщение и не
+// длиннее уже принятых от клиента байт.
+// Сборки без новых фрагментов дольше Timeout мс отбрасываются; суммарный
+// размер буферов ограничен memoryLimit.
+// Не потокобезопасен: у каждого сокета свой.
+class FragmentReassembler
+{
+public:
+    enum : quint8 {
+        Marker = 0x1e,  // ASCII RS: не начало JSON и не CBOR-массив или словарь
+        Data = 0,
+        Nack = 1
+    };
+    enum {
+        HeaderSize = 14,
+        MaxMessageSize = 1 << 20,
+        MaxMessages = 4096,
+        NackDelay = 50,   // Мс тишины до первого NACK и между повторами
+        MaxNackRounds = 3,
+        Timeout = 2000
+    };
+
+    explicit FragmentReassembler(qint64 memoryLimit = 16 << 20);
+
+    static bool isFragment(QByteArrayView data) { return !data.isEmpty() && uchar(data.at(0)) == Marker; }
+
+    // Собранное сообщение, если этот фрагмент был последним недостающим, иначе
+    // пусто. Сообщение действительно до следующего вызова add()
+    QByteArrayView add(QByteArrayView fragment, const ClientInfo &sender, qint64 now);
+    // NACK для затихших сборок и отбрасывание просроченных
+    void expire(qint64 now, DatagramSink &sink);
+
+    bool isEmpty() const { return messages.isEmpty(); }
+    int size() const { return messages.size(); }
+    qint64 memoryUsage() const { return memory; }
+
+private:
+    struct Key {
+        ClientKey client;
+        quint32 message = 0;
+
+        bool operator==(const Key &other) const { return message == other.message && client == other.client; }
+        friend quint64 hashOf(const Key &key) { return hashOf(key.client) ^ key.message; }
+    };
+
+    struct Message {
+        ClientInfo client;
+        QByteArray buffer;        // total байт, фрагменты пишутся на свои места
+        QList<quint64> received;  // Битовая карта принятых фрагментов
+        quint32 chunk = 0;        // Размер всех фрагментов, кроме последнего
+        quint16 count = 0;
+        quint16 missing = 0;
+        quint8 nacks = 0;         // Отправлено NACK
+        quint32 receivedBytes = 0;  // Принятые фрагменты вместе с заголовками
+        qint64 lastFragment = 0;
+        qint64 nextNack = 0;
+    };
+
+    static QByteArray nack(const Key &key, const Message &message, int maxSize);
+
+    const qint64 memoryLimit;
+    qint64 memory;
+    FlatHashMap<Key, Message> messages;
+    QByteArray completed;  // Последнее собранное сообщение
+};
+
+#endif // FRAGMENT_REASSEMBLER_H
@@ -0,0 +1,487 @@
+#include "handover.h"
+#include "logger.h"
+#include <QFile>
+#include <QSocketNotifier>
+#include <QtEndian>
+#include <cstring>
+#include <utility>
+#ifdef Q_OS_UNIX
+#include <cerrno>
+#include <sys/socket.h>
+#include <sys/un.h>
+#include <unistd.h>
+#endif
+
+namespace {
+
+const char Hello[] = "SERVHOV1";       // Преемник: «готов принять»
+const char SnapshotMagic[] = "SERVSNP1";
+const int MagicSize = 8;
+const int HeaderSize = MagicSize + 4 + 4;  // Метка, число сокетов, размер снимка
+const char Ack = 'A';
+const int MaxSockets = 256;
+const quint32 MaxSnapshotSize = 1u << 30;
+const int IoTimeout = 5000;      // Мс на обмен, когда другая сторона уже готова
+const int DrainTimeout = 60000;  // Мс, за которые старый процесс должен завершить выполняемые заявки
+
+// Флаги заявки в снимке
+enum : quint8 {
+    Ipv6Address = 0x01,
+    NullId = 0x02,
+    StreamClient = 0x04,
+    NumericId = 0x08
+};
+
+template<typename T>
+void put(QByteArray &out, T value)
+{
+    char bytes[sizeof(T)];
+    qToLittleEndian<T>(value, bytes);
+    out.append(bytes, sizeof(T));
+}
+
+// Чтение снимка с проверкой границ: после выхода за конец ok = false
+struct Reader {
+    const char *p;
+    const char *end;
+    bool ok;
+
+    template<typename T>
+    T get()
+    {
+        if (!ok || end - p < qsizetype(sizeof(T))) {
+            ok = false;
+            return T();
+        }
+        const T value = qFromLittleEndian<T>(p);
+        p += sizeof(T);
+        return value;
+    }
+
+    const char *take(qsizetype size)
+    {
+        if (!ok || end - p < size) {
+            ok = false;
+            return nullptr;
+        }
+        const char *start = p;
+        p += size;
+        return start;
+    }
+};
+
+void putRequest(QByteArray &out, const QueuedRequest &request)
+{
+    const bool ipv4 = request.client.address.protocol() == QAbstractSocket::IPv4Protocol;
+    put<qint64>(out, request.enqueuedAt);
+    put<qint64>(out, request.deadline);
+    put<quint64>(out, request.sequence);
+    put<quint16>(out, request.client.port);
+    put<quint8>(out, request.priority);
+    put<quint8>(out, quint8(request.configuration));
+    put<quint8>(out, quint8(request.format));
+    put<quint8>(out, quint8((ipv4 ? 0 : Ipv6Address) | (request.id.isNull() ? NullId : 0)
+                            | (request.client.stream ? StreamClient : 0) | (request.numericId ? NumericId : 0)));
+    if (ipv4) {
+        put<quint32>(out, request.client.address.toIPv4Address());
+    } else {
+        const Q_IPV6ADDR address = request.client.address.toIPv6Address();
+        out.append(reinterpret_cast<const char *>(address.c), 16);
+    }
+    const QByteArray id = request.id.toUtf8();
+    put<quint16>(out, quint16(qMin<qsizetype>(id.size(), 0xffff)));
+    out.append(id.constData(), qMin<qsizetype>(id.size(), 0xffff));
+}
+
+bool getRequest(Reader &in, QueuedRequest &request)
+{
+    request.enqueuedAt = in.get<qint64>();
+    request.deadline = in.get<qint64>();
+    request.sequence = in.get<quint64>();
+    request.client.port = in.get<quint16>();
+    request.priority = in.get<quint8>();
+    request.configuration = Configuration(in.get<quint8>());
+    request.format = WireFormat(in.get<quint8>());
+    const quint8 flags = in.get<quint8>();
+    request.client.stream = flags & StreamClient;
+    request.numericId = flags & NumericId;
+    if (flags & Ipv6Address) {
+        Q_IPV6ADDR address;
+        const char *bytes = in.take(16);
+        if (bytes) {
+            memcpy(address.c, bytes, 16);
+            request.client.address = QHostAddress(address);
+        }
+    } else {
+        request.client.address = QHostAddress(in.get<quint32>());
+    }
+    const quint16 idSize = in.get<quint16>();
+    const char *id = in.take(idSize);
+    if (id && !(flags & NullId)) {
+        request.id = QString::fromUtf8(id, idSize);
+    }
+    return in.ok;
+}
+
+#ifdef Q_OS_UNIX
+void setTimeout(int fd, int msecs)
+{
+    timeval timeout;
+    timeout.tv_sec = msecs / 1000;
+    timeout.tv_usec = (msecs % 1000) * 1000;
+    setsockopt(fd, SOL_SOCKET, SO_RCVTIMEO, &timeout, sizeof(timeout));
+    setsockopt(fd, SOL_SOCKET, SO_SNDTIMEO, &timeout, sizeof(timeout));
+}
+
+bool writeAll(int fd, const char *data, qsizetype size)
+{
+    while (size > 0) {
+        const ssize_t written = ::send(fd, data, size_t(size), MSG_NOSIGNAL);
+        if (written < 0 && errno == EINTR) {
+            continue;
+        }
+        if (written <= 0) {
+            return false;
+        }
+        data += written;
+        size -= written;
+    }
+    return true;
+}
+
+// false — ошибка, тайм-аут или конец потока раньше size байт
+bool readAll(int fd, char *data, qsizetype size)
+{
+    while (size > 0) {
+        const ssize_t read = ::recv(fd, data, size_t(size), 0);
+        if (read < 0 && errno == EINTR) {
+            continue;
+        }
+        if (read <= 0) {
+            return false;
+        }
+        data += read;
+        size -= read;
+    }
+    return true;
+}
+
+bool socketAddress(const QString &path, sockaddr_un &address)
+{
+    const QByteArray name = QFile::encodeName(path);
+    if (name.isEmpty() || size_t(name.size()) >= sizeof(address.sun_path)) {
+        return false;
+    }
+    memset(&address, 0, sizeof(address));
+    address.sun_family = AF_UNIX;
+    memcpy(address.sun_path, name.constData(), size_t(name.size()));
+    return true;
+}
+#endif
+
+} // namespace
+
+Handover::Handover(const QString &path, QObject *parent)
+    : QObject(parent)
+    , path(path)
+    , listener(-1)
+    , connection(-1)
+    , notifier(nullptr)
+{
+}
+
+Handover::~Handover()
+{
+    closeConnection();
+#ifdef Q_OS_UNIX
+    // Файл сокета не удаляется: после передачи по этому пути уже слушает преемник
+    if (listener >= 0) {
+        ::close(listener);
+    }
+#endif
+}
+
+bool Handover::takeOver(QList<int> &sockets, Snapshot &snapshot)
+{
+#ifdef Q_OS_UNIX
+    sockaddr_un address;
+    if (!socketAddress(path, address)) {
+        LOG_ERROR("Invalid handover socket path %1", path);
+        return false;
+    }
+    connection = ::socket(AF_UNIX, SOCK_STREAM | SOCK_CLOEXEC, 0);
+    if (connection < 0) {
+        return false;
+    }
+    if (::connect(connection, reinterpret_cast<sockaddr *>(&address), sizeof(address)) != 0) {
+        // Нет файла или никто не слушает — сервер не запущен
+        if (errno != ENOENT && errno != ECONNREFUSED) {
+            LOG_WARNING("Cannot connect to %1 for handover: %2", path, strerror(errno));
+        }
+        closeConnection();
+        return false;
+    }
+    LOG_INFO("Taking over from the running server through %1", path);
+
+    // Старый процесс сначала дожидается выполняемых заявок
+    setTimeout(connection, DrainTimeout);
+    char header[HeaderSize];
+    union {
+        char data[CMSG_SPACE(sizeof(int) * MaxSockets)];
+        cmsghdr align;
+    } control;
+    iovec vector;
+    vector.iov_base = header;
+    vector.iov_len = sizeof(header);
+    msghdr message;
+    memset(&message, 0, sizeof(message));
+    message.msg_iov = &vector;
+    message.msg_iovlen = 1;
+    message.msg_control = control.data;
+    message.msg_controllen = sizeof(control.data);
+
+    ssize_t received;
+    if (!writeAll(connection, Hello, MagicSize)) {
+        received = -1;
+    } else {
+        do {
+            received = ::recvmsg(connection, &message, MSG_CMSG_CLOEXEC);
+        } while (received < 0 && errno == EINTR);
+    }
+    // Дескрипторы приходят с первым байтом заголовка
+    if (received > 0) {
+        for (cmsghdr *item = CMSG_FIRSTHDR(&message); item; item = CMSG_NXTHDR(&message, item)) {
+            if (item->cmsg_level == SOL_SOCKET && item->cmsg_type == SCM_RIGHTS) {
+                const int count = int((item->cmsg_len - CMSG_LEN(0)) / sizeof(int));
+                for (int i = 0; i < count; ++i) {
+                    int fd;
+                    memcpy(&fd, CMSG_DATA(item) + i * sizeof(int), sizeof(int));
+                    sockets.append(fd);
+                }
+            }
+        }
+    }
+
+    setTimeout(connection, IoTimeout);
+    bool ok = received > 0 && !(message.msg_flags & MSG_CTRUNC)
+            && readAll(connection, header + received, HeaderSize - received)
+            && memcmp(header, SnapshotMagic, MagicSize) == 0;
+    const quint32 count = ok ? qFromLittleEndian<quint32>(header + MagicSize) : 0;
+    const quint32 size = ok ? qFromLittleEndian<quint32>(header + MagicSize + 4) : 0;
+    ok = ok && count == quint32(sockets.size()) && count > 0 && size <= MaxSnapshotSize;
+    QByteArray data;
+    if (ok) {
+        data.resize(qsizetype(size));
+        ok = readAll(connection, data.data(), data.size()) && decode(data, snapshot);
+    }
+    if (!ok) {
+        LOG_ERROR("Handover from the running server failed, starting on our own");
+        for (int fd : std::as_const(sockets)) {
+            ::close(fd);
+        }
+        sockets.clear();
+        snapshot = Snapshot();
+        closeConnection();
+        return false;
+    }
+    LOG_INFO("Received %1 socket(s), %2 queued and %3 deferred request(s)",
+             sockets.size(), snapshot.queued.size(), snapshot.deferred.size());
+    return true;
+#else
+    Q_UNUSED(sockets);
+    Q_UNUSED(snapshot);
+    return false;
+#endif
+}
+
+bool Handover::finishTakeOver()
+{
+#ifdef Q_OS_UNIX
+    // Конец потока — старый процесс закрыл журнал и больше ничего не пишет
+    char byte;
+    bool ok = writeAll(connection, &Ack, 1);
+    ssize_t read = -1;
+    while (ok) {
+        read = ::recv(connection, &byte, 1, 0);
+        if (read < 0 && errno == EINTR) {
+            continue;
+        }
+        break;
+    }
+    closeConnection();
+    if (!ok || read != 0) {
+        LOG_ERROR("The previous server did not confirm the handover");
+        return false;
+    }
+    return true;
+#else
+    return false;
+#endif
+}
+
+bool Handover::listen()
+{
+#ifdef Q_OS_UNIX
+    sockaddr_un address;
+    if (!socketAddress(path, address)) {
+        LOG_ERROR("Invalid handover socket path %1", path);
+        return false;
+    }
+    listener = ::socket(AF_UNIX, SOCK_STREAM | SOCK_CLOEXEC | SOCK_NONBLOCK, 0);
+    if (listener < 0) {
+        return false;
+    }
+    ::unlink(address.sun_path);  // Остался от процесса, который уже передал работу или упал
+    if (::bind(listener, reinterpret_cast<sockaddr *>(&address), sizeof(address)) != 0
+            || ::listen(listener, 1) != 0) {
+        LOG_ERROR("Cannot listen for handover on %1: %2", path, strerror(errno));
+        ::close(listener);
+        listener = -1;
+        return false;
+    }
+    notifier = new QSocketNotifier(listener, QSocketNotifier::Read, this);
+    connect(notifier, &QSocketNotifier::activated, this, &Handover::onConnection);
+    return true;
+#else
+    LOG_WARNING("Handover needs Unix-domain sockets and is unavailable on this platform");
+    return false;
+#endif
+}
+
+bool Handover::send(const QList<int> &sockets, const Snapshot &snapshot)
+{
+#ifdef Q_OS_UNIX
+    if (connection < 0 || sockets.isEmpty() || sockets.size() > MaxSockets) {
+        return false;
+    }
+    const QByteArray data = encode(snapshot);
+    char header[HeaderSize];
+    memcpy(header, SnapshotMagic, MagicSize);
+    qToLittleEndian<quint32>(quint32(sockets.size()), header + MagicSize);
+    qToLittleEndian<quint32>(quint32(data.size()), header + MagicSize + 4);
+
+    union {
+        char data[CMSG_SPACE(sizeof(int) * MaxSockets)];
+        cmsghdr align;
+    } control;
+    memset(&control, 0, sizeof(control));
+    iovec vector;
+    vector.iov_base = header;
+    vector.iov_len = sizeof(header);
+    msghdr message;
+    memset(&message, 0, sizeof(message));
+    message.msg_iov = &vector;
+    message.msg_iovlen = 1;
+    message.msg_control = control.data;
+    message.msg_controllen = CMSG_SPACE(sizeof(int) * size_t(sockets.size()));
+    cmsghdr *item = CMSG_FIRSTHDR(&message);
+    item->cmsg_level = SOL_SOCKET;
+    item->cmsg_type = SCM_RIGHTS;
+    item->cmsg_len = CMSG_LEN(sizeof(int) * size_t(sockets.size()));
+    memcpy(CMSG_DATA(item), sockets.constData(), sizeof(int) * size_t(sockets.size()));
+
+    ssize_t sent;
+    do {
+        sent = ::sendmsg(connection, &message, MSG_NOSIGNAL);
+    } while (sent < 0 && errno == EINTR);
+    char ack = 0;
+    const bool ok = sent > 0
+            && writeAll(connection, header + sent, HeaderSize - sent)
+            && writeAll(connection, data.constData(), data.size())
+            && readAll(connection, &ack, 1) && ack == Ack;
+    if (!ok) {
+        LOG_ERROR("Handover failed, the successor did not accept the sockets");
+        closeConnection();
+        return false;
+    }
+    LOG_INFO("Handed over %1 socket(s), %2 queued and %3 deferred request(s)",
+             sockets.size(), snapshot.queued.size(), snapshot.deferred.size());
+    return true;
+#else
+    Q_UNUSED(sockets);
+    Q_UNUSED(snapshot);
+    return false;
+#endif
+}
+
+void Handover::release()
+{
+    closeConnection();
+}
+
+QByteArray Handover::encode(const Snapshot &snapshot)
+{
+    QByteArray out;
+    out.reserve(64 * (snapshot.queued.size() + snapshot.deferred.size()) + 8);
+    put<quint32>(out, quint32(snapshot.queued.size()));
+    put<quint32>(out, quint32(snapshot.deferred.size()));
+    for (const QueuedRequest &request : snapshot.queued) {
+        putRequest(out, request);
+    }
+    for (int i = 0; i < snapshot.deferred.size(); ++i) {
+        put<qint64>(out, snapshot.due.at(i));
+        putRequest(out, snapshot.deferred.at(i));
+    }
+    return out;
+}
+
+bool Handover::decode(QByteArrayView data, Snapshot &snapshot)
+{
+    Reader in = {data.data(), data.data() + data.size(), true};
+    const quint32 queued = in.get<quint32>();
+    const quint32 deferred = in.get<quint32>();
+    // Запись не короче 27 байт: так размер нельзя завысить счётчиками
+    if (!in.ok || quint64(queued) + deferred > quint64(data.size()) / 27) {
+        return false;
+    }
+    snapshot = Snapshot();
+    snapshot.queued.resize(queued);
+    for (QueuedRequest &request : snapshot.queued) {
+        if (!getRequest(in, request)) {
+            return false;
+        }
+    }
+    snapshot.deferred.resize(deferred);
+    snapshot.due.resize(deferred);
+    for (quint32 i = 0; i < deferred; ++i) {
+        snapshot.due[i] = in.get<qint64>();
+        if (!getRequest(in, snapshot.deferred[i])) {
+            return false;
+        }
+    }
+    return in.ok && in.p == in.end;
+}
+
+void Handover::onConnection()
+{
+#ifdef Q_OS_UNIX
+    const int accepted = ::accept4(listener, nullptr, nullptr, SOCK_CLOEXEC);
+    if (accepted < 0) {
+        return;
+    }
+    if (connection >= 0) {
+        ::close(accepted);  // Передача уже идёт
+        return;
+    }
+    setTimeout(accepted, IoTimeout);
+    char hello[MagicSize];
+    if (!readAll(accepted, hello, MagicSize) || memcmp(hello, Hello, MagicSize) != 0) {
+        LOG_WARNING("Ignoring an invalid handover request on %1", path);
+        ::close(accepted);
+        return;
+    }
+    connection = accepted;
+    LOG_INFO("A new server instance is taking over");
+    emit requested();
+#endif
+}
+
+void Handover::closeConnection()
+{
+#ifdef Q_OS_UNIX
+    if (connection >= 0) {
+        ::close(connection);
+        connection = -1;
+    }
+#endif
+}
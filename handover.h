@@ -0,0 +1,74 @@
+#ifndef HANDOVER_H
+#define HANDOVER_H
+
+#include <QObject>
+#include <QByteArray>
+#include <QByteArrayView>
+#include <QList>
+#include <QString>
+#include "request.h"
+
+class QSocketNotifier;
+
+// Передача работы перезапущенному серверу без закрытия UDP-сокетов.
+// Работающий процесс слушает Unix-сокет path. Новый при запуске подключается
+// к нему, и старый:
+//   1. перестаёт читать UDP-сокеты — датаграммы копятся в буферах ядра;
+//   2. дожидается заявок, уже отданных потокам обработки;
+//   3. отправляет дескрипторы сокетов (SCM_RIGHTS) и снимок очередей;
+//   4. получив подтверждение, закрывает свои копии сокетов и журнал заявок,
+//      разрывает соединение и завершается.
+// Новый процесс открывает журнал только после разрыва, а читать сокеты
+// начинает с того места, где остановился старый: сокет в ядре тот же,
+// поэтому датаграммы не теряются, пока помещаются в его буфер.
+// Монотонные времена в снимке переносятся как есть — оба процесса на одной
+// машине, и часы QDeadlineTimer у них общие.
+class Handover : public QObject
+{
+    Q_OBJECT
+
+public:
+    // Очереди сервера. Индекс заявок по id восстанавливается из них же:
+    // к моменту снимка выполняемых заявок нет
+    struct Snapshot {
+        QList<QueuedRequest> queued;    // В порядке выдачи планировщиком
+        QList<QueuedRequest> deferred;
+        QList<qint64> due;              // Сроки отложенных, монотонные мс
+    };
+
+    explicit Handover(const QString &path, QObject *parent = nullptr);
+    ~Handover();
+
+    // Новый процесс. false — работающего сервера нет (или передача
+    // сорвалась), запуск обычный. Дескрипторы принадлежат вызывающему
+    bool takeOver(QList<int> &sockets, Snapshot &snapshot);
+    // Подтверждает приём и ждёт, пока старый процесс закроет журнал и уйдёт
+    bool finishTakeOver();
+
+    // Работающий процесс: ждать преемника; при его подключении — requested()
+    bool listen();
+    // Отправляет сокеты и снимок и ждёт подтверждения. true — преемник всё
+    // принял, остаётся release(); false — соединение закрыто, работаем дальше
+    bool send(const QList<int> &sockets, const Snapshot &snapshot);
+    // Разрывает соединение: преемник может открывать журнал
+    void release();
+
+    static QByteArray encode(const Snapshot &snapshot);
+    static bool decode(QByteArrayView data, Snapshot &snapshot);
+
+signals:
+    void requested();
+
+private slots:
+    void onConnection();
+
+private:
+    void closeConnection();
+
+    QString path;
+    int listener;      // Слушающий сокет, -1 — не слушаем
+    int connection;    // Соединение с другим процессом, -1 — его нет
+    QSocketNotifier *notifier;
+};
+
+#endif // HANDOVER_H
@@ -0,0 +1,557 @@
+#include "jsonrpc_parser.h"
+#include <QtAlgorithms>
+#include <cstring>
+
+#if defined(__SSE2__)
+#include <emmintrin.h>
+#elif defined(__ARM_NEON)
+#include <arm_neon.h>
+#endif
+
+namespace {
+
+const int MaxDepth = 64;  // Защита стека от глубоко вложенных документов
+
+struct Cursor {
+    const char *p;
+    const char *end;
+};
+
+inline bool isSpace(char c)
+{
+    return c == ' ' || c == '\t' || c == '\n' || c == '\r';
+}
+
+inline bool isDigit(char c)
+{
+    return c >= '0' && c <= '9';
+}
+
+inline int hexValue(char c)
+{
+    if (c >= '0' && c <= '9')
+        return c - '0';
+    if (c >= 'a' && c <= 'f')
+        return c - 'a' + 10;
+    if (c >= 'A' && c <= 'F')
+        return c - 'A' + 10;
+    return -1;
+}
+
+inline void skipSpace(Cursor &c)
+{
+    while (c.p < c.end && isSpace(*c.p))
+        ++c.p;
+}
+
+// Первый байт, требующий внимания внутри строки: '"', '\\', управляющий
+// символ или начало многобайтовой последовательности UTF-8
+inline const char *scanString(const char *p, const char *end)
+{
+#if defined(__SSE2__)
+    const __m128i quote = _mm_set1_epi8('"');
+    const __m128i backslash = _mm_set1_epi8('\\');
+    const __m128i control = _mm_set1_epi8(0x1f);
+    while (end - p >= 16) {
+        const __m128i chunk = _mm_loadu_si128(reinterpret_cast<const __m128i *>(p));
+        // x <= 0x1f без знака <=> min(x, 0x1f) == x
+        const __m128i special = _mm_or_si128(
+                _mm_or_si128(_mm_cmpeq_epi8(chunk, quote), _mm_cmpeq_epi8(chunk, backslash)),
+                _mm_cmpeq_epi8(_mm_min_epu8(chunk, control), chunk));
+        // Старший бит байта — не ASCII
+        const int mask = _mm_movemask_epi8(special) | _mm_movemask_epi8(chunk);
+        if (mask)
+            return p + qCountTrailingZeroBits(quint32(mask));
+        p += 16;
+    }
+#elif defined(__ARM_NEON)
+    const uint8x16_t quote = vdupq_n_u8('"');
+    const uint8x16_t backslash = vdupq_n_u8('\\');
+    const uint8x16_t control = vdupq_n_u8(0x1f);
+    const uint8x16_t ascii = vdupq_n_u8(0x80);
+    while (end - p >= 16) {
+        const uint8x16_t chunk = vld1q_u8(reinterpret_cast<const uint8_t *>(p));
+        const uint8x16_t special = vorrq_u8(vorrq_u8(vceqq_u8(chunk, quote), vceqq_u8(chunk, backslash)),
+                                            vorrq_u8(vcleq_u8(chunk, control), vcgeq_u8(chunk, ascii)));
+        // Сжимаем 128-битную маску в 64 бита — по 4 бита на байт
+        const quint64 mask = vget_lane_u64(vreinterpret_u64_u8(vshrn_n_u16(vreinterpretq_u16_u8(special), 4)), 0);
+        if (mask)
+            return p + (qCountTrailingZeroBits(mask) >> 2);
+        p += 16;
+    }
+#endif
+    while (p < end && *p != '"' && *p != '\\' && uchar(*p) >= 0x20 && uchar(*p) < 0x80)
+        ++p;
+    return p;
+}
+
+// Длина корректной последовательности UTF-8 с первым байтом *p или 0:
+// без избыточных форм, суррогатов и кодов больше U+10FFFF
+inline int utf8Length(const char *p, const char *end)
+{
+    const uchar lead = uchar(*p);
+    int length;
+    uchar low = 0x80;
+    uchar high = 0xbf;  // Допустимые значения второго байта
+    if (lead >= 0xc2 && lead <= 0xdf) {
+        length = 2;
+    } else if (lead >= 0xe0 && lead <= 0xef) {
+        length = 3;
+        if (lead == 0xe0)
+            low = 0xa0;
+        else if (lead == 0xed)
+            high = 0x9f;
+    } else if (lead >= 0xf0 && lead <= 0xf4) {
+        length = 4;
+        if (lead == 0xf0)
+            low = 0x90;
+        else if (lead == 0xf4)
+            high = 0x8f;
+    } else {
+        return 0;
+    }
+    if (end - p < length || uchar(p[1]) < low || uchar(p[1]) > high)
+        return 0;
+    for (int i = 2; i < length; ++i) {
+        if ((uchar(p[i]) & 0xc0) != 0x80)
+            return 0;
+    }
+    return length;
+}
+
+// Курсор стоит на открывающей кавычке; content — текст между кавычками
+bool parseString(Cursor &c, QByteArrayView *content)
+{
+    const char *start = ++c.p;
+    forever {
+        c.p = scanString(c.p, c.end);
+        if (c.p >= c.end)
+            return false;
+        if (*c.p == '"')
+            break;
+        if (uchar(*c.p) >= 0x80) {
+            // QJsonDocument отвергал некорректный UTF-8, разборщик тоже
+            const int length = utf8Length(c.p, c.end);
+            if (length == 0)
+                return false;
+            c.p += length;
+            continue;
+        }
+        if (*c.p != '\\' || c.end - c.p < 2)
+            return false;  // Управляющий символ или обрыв escape
+
+        switch (c.p[1]) {
+        case '"': case '\\': case '/': case 'b': case 'f': case 'n': case 'r': case 't':
+            c.p += 2;
+            break;
+        case 'u':
+            if (c.end - c.p < 6)
+                return false;
+            for (int i = 2; i < 6; ++i) {
+                if (hexValue(c.p[i]) < 0)
+                    return false;
+            }
+            c.p += 6;
+            break;
+        default:
+            return false;
+        }
+    }
+    if (content)
+        *content = QByteArrayView(start, c.p);
+    ++c.p;
+    return true;
+}
+
+bool skipNumber(Cursor &c)
+{
+    if (c.p < c.end && *c.p == '-')
+        ++c.p;
+    if (c.p >= c.end)
+        return false;
+    if (*c.p == '0') {
+        ++c.p;
+    } else if (isDigit(*c.p)) {
+        while (c.p < c.end && isDigit(*c.p))
+            ++c.p;
+    } else {
+        return false;
+    }
+    if (c.p < c.end && *c.p == '.') {
+        ++c.p;
+        if (c.p >= c.end || !isDigit(*c.p))
+            return false;
+        while (c.p < c.end && isDigit(*c.p))
+            ++c.p;
+    }
+    if (c.p < c.end && (*c.p == 'e' || *c.p == 'E')) {
+        ++c.p;
+        if (c.p < c.end && (*c.p == '+' || *c.p == '-'))
+            ++c.p;
+        if (c.p >= c.end || !isDigit(*c.p))
+            return false;
+        while (c.p < c.end && isDigit(*c.p))
+            ++c.p;
+    }
+    return true;
+}
+
+bool skipLiteral(Cursor &c, const char *literal, int length)
+{
+    if (c.end - c.p < length || memcmp(c.p, literal, length) != 0)
+        return false;
+    c.p += length;
+    return true;
+}
+
+bool skipValue(Cursor &c, int depth);
+
+bool skipObject(Cursor &c, int depth)
+{
+    if (depth > MaxDepth)
+        return false;
+    ++c.p;  // '{'
+    skipSpace(c);
+    if (c.p < c.end && *c.p == '}') {
+        ++c.p;
+        return true;
+    }
+    forever {
+        skipSpace(c);
+        if (c.p >= c.end || *c.p != '"' || !parseString(c, nullptr))
+            return false;
+        skipSpace(c);
+        if (c.p >= c.end || *c.p != ':')
+            return false;
+        ++c.p;
+        skipSpace(c);
+        if (!skipValue(c, depth))
+            return false;
+        skipSpace(c);
+        if (c.p >= c.end)
+            return false;
+        if (*c.p == '}') {
+            ++c.p;
+            return true;
+        }
+        if (*c.p != ',')
+            return false;
+        ++c.p;
+    }
+}
+
+bool skipArray(Cursor &c, int depth)
+{
+    if (depth > MaxDepth)
+        return false;
+    ++c.p;  // '['
+    skipSpace(c);
+    if (c.p < c.end && *c.p == ']') {
+        ++c.p;
+        return true;
+    }
+    forever {
+        skipSpace(c);
+        if (!skipValue(c, depth))
+            return false;
+        skipSpace(c);
+        if (c.p >= c.end)
+            return false;
+        if (*c.p == ']') {
+            ++c.p;
+            return true;
+        }
+        if (*c.p != ',')
+            return false;
+        ++c.p;
+    }
+}
+
+bool skipValue(Cursor &c, int depth)
+{
+    if (c.p >= c.end)
+        return false;
+    switch (*c.p) {
+    case '"':
+        return parseString(c, nullptr);
+    case '{':
+        return skipObject(c, depth + 1);
+    case '[':
+        return skipArray(c, depth + 1);
+    case 't':
+        return skipLiteral(c, "true", 4);
+    case 'f':
+        return skipLiteral(c, "false", 5);
+    case 'n':
+        return skipLiteral(c, "null", 4);
+    default:
+        return skipNumber(c);
+    }
+}
+
+void appendUtf8(QByteArray &out, uint codePoint)
+{
+    if (codePoint < 0x80) {
+        out.append(char(codePoint));
+    } else if (codePoint < 0x800) {
+        out.append(char(0xc0 | (codePoint >> 6)));
+        out.append(char(0x80 | (codePoint & 0x3f)));
+    } else if (codePoint < 0x10000) {
+        out.append(char(0xe0 | (codePoint >> 12)));
+        out.append(char(0x80 | ((codePoint >> 6) & 0x3f)));
+        out.append(char(0x80 | (codePoint & 0x3f)));
+    } else {
+        out.append(char(0xf0 | (codePoint >> 18)));
+        out.append(char(0x80 | ((codePoint >> 12) & 0x3f)));
+        out.append(char(0x80 | ((codePoint >> 6) & 0x3f)));
+        out.append(char(0x80 | (codePoint & 0x3f)));
+    }
+}
+
+uint readHex4(const char *p)
+{
+    return uint(hexValue(p[0]) << 12 | hexValue(p[1]) << 8 | hexValue(p[2]) << 4 | hexValue(p[3]));
+}
+
+} // namespace
+
+bool JsonRpcEnvelope::methodIs(QByteArrayView name) const
+{
+    // В CBOR нет escape-последовательностей, текст сравнивается напрямую
+    return format == CborFormat ? method == name : JsonRpcParser::stringEquals(method, name);
+}
+
+JsonRpcParser::Error JsonRpcParser::parse(QByteArrayView data, JsonRpcEnvelope &envelope)
+{
+    envelope = JsonRpcEnvelope();
+    Cursor c = {data.data(), data.data() + data.size()};
+
+    skipSpace(c);
+    if (c.p >= c.end)
+        return ParseError;
+    if (*c.p != '{') {
+        // Корректный JSON, но не объект — это Invalid Request, а не Parse error
+        if (!skipValue(c, 0))
+            return ParseError;
+        skipSpace(c);
+        return c.p == c.end ? InvalidRequest : ParseError;
+    }
+
+    bool hasJsonrpc = false;
+    bool hasMethod = false;
+    bool hasId = false;
+    bool wellTyped = true;
+    QByteArrayView id;
+
+    ++c.p;
+    skipSpace(c);
+    if (c.p < c.end && *c.p == '}') {
+        ++c.p;
+    } else {
+        forever {
+            skipSpace(c);
+            QByteArrayView key;
+            if (c.p >= c.end || *c.p != '"' || !parseString(c, &key))
+                return ParseError;
+            skipSpace(c);
+            if (c.p >= c.end || *c.p != ':')
+                return ParseError;
+            ++c.p;
+            skipSpace(c);
+
+            const char *valueStart = c.p;
+            if (!skipValue(c, 1))
+                return ParseError;
+            const QByteArrayView value(valueStart, c.p);
+            const char kind = *valueStart;
+
+            // Тело строки без кавычек; значение другого типа не срезается
+            if (stringEquals(key, "jsonrpc")) {
+                hasJsonrpc = true;
+                wellTyped = wellTyped && kind == '"';
+                envelope.jsonrpc = kind == '"' ? value.sliced(1, value.size() - 2) : QByteArrayView();
+            } else if (stringEquals(key, "method")) {
+                hasMethod = true;
+                wellTyped = wellTyped && kind == '"';
+                envelope.method = kind == '"' ? value.sliced(1, value.size() - 2) : QByteArrayView();
+            } else if (stringEquals(key, "id")) {
+                hasId = true;
+                id = value;
+                wellTyped = wellTyped && (kind == '"' || kind == 'n' || isNumber(value));
+            } else if (stringEquals(key, "params")) {
+                envelope.hasParams = true;
+                envelope.params = value;
+                wellTyped = wellTyped && (kind == '{' || kind == '[');
+            }
+
+            skipSpace(c);
+            if (c.p >= c.end)
+                return ParseError;
+            if (*c.p == '}') {
+                ++c.p;
+                break;
+            }
+            if (*c.p != ',')
+                return ParseError;
+            ++c.p;
+        }
+    }
+
+    skipSpace(c);
+    if (c.p != c.end)
+        return ParseError;
+
+    // id попадает в конверт только после разбора всего документа: в ответ
+    // на Parse error уходит null. Некорректный id клиенту тоже не возвращаем
+    if (hasId && (isString(id) || isNull(id) || isNumber(id))) {
+        envelope.hasId = true;
+        envelope.id = id;
+    }
+
+    // Поле jsonrpc необязательно для совместимости со старыми клиентами,
+    // но если оно есть, то должно быть "2.0"
+    if (!wellTyped || !hasMethod || (hasJsonrpc && !stringEquals(envelope.jsonrpc, "2.0")))
+        return InvalidRequest;
+    return NoError;
+}
+
+bool JsonRpcParser::isBatch(QByteArrayView data)
+{
+    Cursor c = {data.data(), data.data() + data.size()};
+    skipSpace(c);
+    return c.p < c.end && *c.p == '[';
+}
+
+JsonRpcParser::Error JsonRpcParser::parseBatch(QByteArrayView data, BatchElements &elements)
+{
+    elements.clear();
+    Cursor c = {data.data(), data.data() + data.size()};
+    skipSpace(c);
+    if (c.p >= c.end || *c.p != '[')
+        return InvalidRequest;
+
+    ++c.p;
+    skipSpace(c);
+    if (c.p < c.end && *c.p == ']') {
+        ++c.p;
+    } else {
+        forever {
+            skipSpace(c);
+            const char *elementStart = c.p;
+            if (!skipValue(c, 1))
+                return ParseError;
+            elements.append(QByteArrayView(elementStart, c.p));
+            skipSpace(c);
+            if (c.p >= c.end)
+                return ParseError;
+            if (*c.p == ']') {
+                ++c.p;
+                break;
+            }
+            if (*c.p != ',')
+                return ParseError;
+            ++c.p;
+        }
+    }
+
+    skipSpace(c);
+    if (c.p != c.end)
+        return ParseError;
+    return elements.isEmpty() ? InvalidRequest : NoError;
+}
+
+bool JsonRpcParser::findMember(QByteArrayView object, QByteArrayView key, QByteArrayView &value)
+{
+    Cursor c = {object.data(), object.data() + object.size()};
+    skipSpace(c);
+    if (c.p >= c.end || *c.p != '{')
+        return false;
+    ++c.p;
+    skipSpace(c);
+    if (c.p < c.end && *c.p == '}')
+        return false;
+
+    forever {
+        skipSpace(c);
+        QByteArrayView name;
+        if (c.p >= c.end || *c.p != '"' || !parseString(c, &name))
+            return false;
+        skipSpace(c);
+        if (c.p >= c.end || *c.p != ':')
+            return false;
+        ++c.p;
+        skipSpace(c);
+        const char *valueStart = c.p;
+        if (!skipValue(c, 1))
+            return false;
+        if (stringEquals(name, key)) {
+            value = QByteArrayView(valueStart, c.p);
+            return true;
+        }
+        skipSpace(c);
+        if (c.p >= c.end || *c.p != ',')
+            return false;
+        ++c.p;
+    }
+}
+
+bool JsonRpcParser::isNumber(QByteArrayView token)
+{
+    return !token.isEmpty() && (token.at(0) == '-' || isDigit(token.at(0)));
+}
+
+bool JsonRpcParser::stringEquals(QByteArrayView raw, QByteArrayView text)
+{
+    if (memchr(raw.data(), '\\', raw.size()) == nullptr)
+        return raw == text;
+    return QByteArrayView(unescape(raw)) == text;
+}
+
+QByteArray JsonRpcParser::unescape(QByteArrayView raw)
+{
+    QByteArray out;
+    out.reserve(raw.size());
+
+    const char *p = raw.data();
+    const char *end = p + raw.size();
+    while (p < end) {
+        const char *next = static_cast<const char *>(memchr(p, '\\', end - p));
+        if (!next) {
+            out.append(p, end - p);
+            break;
+        }
+        out.append(p, next - p);
+        p = next;
+        if (end - p < 2)
+            break;
+
+        switch (p[1]) {
+        case 'b': out.append('\b'); p += 2; break;
+        case 'f': out.append('\f'); p += 2; break;
+        case 'n': out.append('\n'); p += 2; break;
+        case 'r': out.append('\r'); p += 2; break;
+        case 't': out.append('\t'); p += 2; break;
+        case 'u': {
+            if (end - p < 6)
+                return out;
+            uint codePoint = readHex4(p + 2);
+            p += 6;
+            // Суррогатная пара UTF-16
+            if (codePoint >= 0xd800 && codePoint < 0xdc00 && end - p >= 6 && p[0] == '\\' && p[1] == 'u') {
+                const uint low = readHex4(p + 2);
+                if (low >= 0xdc00 && low < 0xe000) {
+                    codePoint = 0x10000 + ((codePoint - 0xd800) << 10) + (low - 0xdc00);
+                    p += 6;
+                }
+            }
+            appendUtf8(out, codePoint);
+            break;
+        }
+        default:
+            out.append(p[1]);  // '"', '\\', '/'
+            p += 2;
+            break;
+        }
+    }
+    return out;
+}
@@ -0,0 +1,65 @@
+#ifndef JSONRPC_PARSER_H
+#define JSONRPC_PARSER_H
+
+#include <QByteArray>
+#include <QByteArrayView>
+#include <QVarLengthArray>
+#include "wire_format.h"
+
+// Поля конверта JSON-RPC — срезы исходного буфера, без копирования.
+// Для JSON строки хранятся без кавычек и без раскодирования escape-последовательностей;
+// для CBOR строки — содержимое текстовой строки, id и params — закодированные элементы.
+struct JsonRpcEnvelope {
+    QByteArrayView jsonrpc;  // Содержимое строки "jsonrpc"
+    QByteArrayView method;   // Содержимое строки "method"
+    QByteArrayView id;       // Исходный токен id: строка, число или null
+    QByteArrayView params;   // Исходный текст params: объект или массив
+    bool hasId = false;
+    bool hasParams = false;
+    WireFormat format = JsonFormat;
+
+    bool methodIs(QByteArrayView name) const;
+};
+
+// Элементы пакетного запроса — срезы исходного буфера
+typedef QVarLengthArray<QByteArrayView, 64> BatchElements;
+
+// Потоковый разборщик конверта, работающий прямо по буферу приёма.
+// Документ проверяется целиком, но дерево не строится и память не выделяется;
+// строки просматриваются SIMD-блоками по 16 байт, где это доступно.
+class JsonRpcParser
+{
+public:
+    // Коды ошибок JSON-RPC 2.0; разборщик возвращает только первые три.
+    // -32000..-32099 — ошибки сервера, определяемые реализацией
+    enum Error {
+        NoError = 0,
+        ParseError = -32700,
+        InvalidRequest = -32600,
+        MethodNotFound = -32601,
+        InvalidParams = -32602,
+        ServerBusy = -32000,
+        RateLimited = -32001,
+        DeadlineExpired = -32002  // Заявка снята: её срок истёк до выполнения
+    };
+
+    static Error parse(QByteArrayView data, JsonRpcEnvelope &envelope);
+
+    // Пакетный запрос — массив верхнего уровня
+    static bool isBatch(QByteArrayView data);
+    static Error parseBatch(QByteArrayView data, BatchElements &elements);
+
+    // Значение поля key в JSON-объекте object (исходный токен); false, если поля нет
+    static bool findMember(QByteArrayView object, QByteArrayView key, QByteArrayView &value);
+
+    static bool isString(QByteArrayView token) { return token.size() >= 2 && token.at(0) == '"'; }
+    static bool isNumber(QByteArrayView token);
+    static bool isNull(QByteArrayView token) { return token == QByteArrayView("null"); }
+
+    // Сравнение содержимого строки (без кавычек) с обычным текстом
+    static bool stringEquals(QByteArrayView raw, QByteArrayView text);
+    // Раскодирование содержимого строки (без кавычек) в UTF-8
+    static QByteArray unescape(QByteArrayView raw);
+};
+
+#endif // JSONRPC_PARSER_H
@@ -0,0 +1,148 @@
+#include "listener_pool.h"
+#include "flat_hash.h"
+#include "logger.h"
+
+ListenerPool::ListenerPool(DatagramHandler *handler, int batchSize, UdpTransport::Backend backend, QObject *parent)
+    : QObject(parent)
+    , handler(handler)
+    , batchSize(batchSize)
+    , backend(backend)
+{
+}
+
+ListenerPool::~ListenerPool()
+{
+    stop();
+}
+
+bool ListenerPool::start(quint16 port, int count)
+{
+#ifndef Q_OS_LINUX
+    if (count > 1) {
+        LOG_WARNING("Sharded listeners need SO_REUSEPORT load balancing, using one listener");
+        count = 1;
+    }
+#endif
+
+    if (count <= 1) {
+        UdpTransport *transport = new UdpTransport(handler, batchSize, backend, this);
+        transports.append(transport);
+        return transport->bind(port);
+    }
+
+    // Все сокеты привязываются здесь, чтобы ошибка bind была видна сразу,
+    // и только потом переезжают в свои потоки
+    for (int i = 0; i < count; ++i) {
+        UdpTransport *transport = new UdpTransport(handler, batchSize, backend);
+        transports.append(transport);
+        if (!transport->bind(port, true)) {
+            stop();
+            return false;
+        }
+    }
+    startThreads();
+    return true;
+}
+
+bool ListenerPool::adopt(const QList<int> &sockets)
+{
+    if (sockets.size() == 1) {
+        UdpTransport *transport = new UdpTransport(handler, batchSize, backend, this);
+        transports.append(transport);
+        return transport->adopt(sockets.first());
+    }
+
+    for (int socket : sockets) {
+        UdpTransport *transport = new UdpTransport(handler, batchSize, backend);
+        transports.append(transport);
+        if (!transport->adopt(socket)) {
+            stop();
+            return false;
+        }
+    }
+    startThreads();
+    return true;
+}
+
+void ListenerPool::startThreads()
+{
+    for (int i = 0; i < transports.size(); ++i) {
+        QThread *thread = new QThread(this);
+        thread->setObjectName(QString("listener-%1").arg(i));
+        transports.at(i)->moveToThread(thread);
+        connect(thread, &QThread::finished, transports.at(i), &QObject::deleteLater);
+        threads.append(thread);
+        thread->start();
+    }
+}
+
+bool ListenerPool::pause()
+{
+    bool ok = true;
+    for (UdpTransport *transport : std::as_const(transports)) {
+        bool paused = false;
+        if (threads.isEmpty()) {
+            paused = transport->pause();
+        } else {
+            // Сокет читается в своём потоке: к возврату он уже не читает
+            QMetaObject::invokeMethod(transport, [transport] {
+                return transport->pause();
+            }, Qt::BlockingQueuedConnection, &paused);
+        }
+        ok = ok && paused;
+    }
+    return ok;
+}
+
+void ListenerPool::resume()
+{
+    for (UdpTransport *transport : std::as_const(transports)) {
+        QMetaObject::invokeMethod(transport, [transport] {
+            transport->resume();
+        }, Qt::AutoConnection);
+    }
+}
+
+QList<int> ListenerPool::descriptors() const
+{
+    QList<int> sockets;
+    for (const UdpTransport *transport : transports) {
+        sockets.append(transport->descriptor());
+    }
+    return sockets;
+}
+
+quint16 ListenerPool::localPort() const
+{
+    return transports.isEmpty() ? 0 : transports.first()->localPort();
+}
+
+void ListenerPool::stop()
+{
+    if (threads.isEmpty()) {
+        // Сокеты без своих потоков принадлежат этому потоку
+        qDeleteAll(transports);
+    } else {
+        for (QThread *thread : threads) {
+            thread->quit();
+        }
+        for (QThread *thread : threads) {
+            thread->wait();
+        }
+        qDeleteAll(threads);
+    }
+    threads.clear();
+    transports.clear();
+}
+
+void ListenerPool::sendDatagram(QByteArrayView data, const ClientInfo &client)
+{
+    if (transports.isEmpty()) {
+        return;
+    }
+    UdpTransport *transport = transports.at(int(hashMix(hashOf(ClientKey::of(client))) % quint64(transports.size())));
+    const QByteArray copy = data.toByteArray();
+    QMetaObject::invokeMethod(transport, [transport, copy, client] {
+        transport->sendDatagram(copy, client);
+    }, Qt::QueuedConnection);
+}
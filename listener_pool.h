@@ -0,0 +1,51 @@
+#ifndef LISTENER_POOL_H
+#define LISTENER_POOL_H
+
+#include <QObject>
+#include <QList>
+#include <QThread>
+#include "datagram.h"
+#include "udp_transport.h"
+
+// K UDP-сокетов на одном порту (SO_REUSEPORT), каждый в своём потоке со своим
+// циклом событий; ядро распределяет клиентов между сокетами. При K = 1 сокет
+// обслуживается в потоке, создавшем пул.
+// Как DatagramSink пул отправляет датаграммы из любого потока: отправка
+// передаётся сокету слушателя в его собственный поток.
+class ListenerPool : public QObject, public DatagramSink
+{
+    Q_OBJECT
+
+public:
+    ListenerPool(DatagramHandler *handler, int batchSize, UdpTransport::Backend backend, QObject *parent = nullptr);
+    ~ListenerPool();
+
+    bool start(quint16 port, int count);
+    // Сокеты предыдущего процесса, по одному слушателю на каждый
+    bool adopt(const QList<int> &sockets);
+    void stop();
+
+    // Приостанавливает и возобновляет чтение всех сокетов, см. UdpTransport::pause()
+    bool pause();
+    void resume();
+    QList<int> descriptors() const;
+    // Общий порт слушателей, 0 — пул не запущен
+    quint16 localPort() const;
+
+    int size() const { return transports.size(); }
+    UdpTransport *transport(int index) const { return transports.at(index); }
+
+    // Датаграммы одному клиенту уходят через один сокет и не обгоняют друг друга
+    void sendDatagram(QByteArrayView data, const ClientInfo &client) override;
+
+private:
+    void startThreads();
+
+    DatagramHandler *handler;
+    int batchSize;
+    UdpTransport::Backend backend;
+    QList<UdpTransport *> transports;
+    QList<QThread *> threads;
+};
+
+#endif // LISTENER_POOL_H
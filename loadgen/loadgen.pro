@@ -0,0 +1,21 @@
+QT += core network
+
+CONFIG += c++17 console
+CONFIG -= app_bundle
+
+INCLUDEPATH += ..
+
+SOURCES += \
+    main.cpp \
+    ../cbor_parser.cpp \
+    ../jsonrpc_parser.cpp \
+    ../metrics.cpp
+
+HEADERS += \
+    ../cbor_parser.h \
+    ../jsonrpc_parser.h \
+    ../metrics.h \
+    ../wire_format.h
+
+TARGET = loadgen
+TEMPLATE = app
@@ -0,0 +1,483 @@
+#include <QCoreApplication>
+#include <QCommandLineParser>
+#include <QDeadlineTimer>
+#include <QHash>
+#include <QThread>
+#include "cbor_parser.h"
+#include "jsonrpc_parser.h"
+#include "metrics.h"
+#include <arpa/inet.h>
+#include <netdb.h>
+#include <netinet/in.h>
+#include <poll.h>
+#include <sys/socket.h>
+#include <unistd.h>
+#include <time.h>
+#include <cerrno>
+#include <cstdio>
+#include <cstring>
+#include <iostream>
+
+// Генератор нагрузки: шлёт processRequest на сервер через loopback и меряет
+// время до подтверждения. Открытый цикл держит заданный темп независимо от
+// ответов, закрытый — заданное число запросов в полёте.
+
+namespace {
+
+enum {
+    MaxDatagram = 65536,
+    SendSlots = 1 << 20    // Время отправки хранится по id % SendSlots
+};
+
+struct Options {
+    QByteArray host;
+    quint16 port;
+    bool closedLoop;
+    int rate;              // Запросов в секунду (открытый цикл)
+    int concurrency;       // Запросов в полёте (закрытый цикл)
+    int duration;          // Секунд
+    int timeout;           // Мс ожидания ответа, после которых запрос считается потерянным
+    int priority;          // 0 — случайный 1..7
+    WireFormat format;
+};
+
+qint64 nowNs()
+{
+    timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return qint64(ts.tv_sec) * 1000000000 + ts.tv_nsec;
+}
+
+void sleepUntil(qint64 deadline)
+{
+    timespec ts;
+    ts.tv_sec = deadline / 1000000000;
+    ts.tv_nsec = deadline % 1000000000;
+    while (clock_nanosleep(CLOCK_MONOTONIC, TIMER_ABSTIME, &ts, nullptr) == EINTR) {
+    }
+}
+
+const char *const Configurations[] = {"одна строка", "два столбца", "3x3", "четыре строки", "2x2", "8x8"};
+
+void buildRequest(QByteArray &out, WireFormat format, quint64 id, int priority)
+{
+    const char *configuration = Configurations[id % (sizeof(Configurations) / sizeof(Configurations[0]))];
+    out.clear();
+    if (format == CborFormat) {
+        CborRpcParser::appendHead(out, 5, 4);    // Словарь из четырёх пар
+        CborRpcParser::appendText(out, "jsonrpc");
+        CborRpcParser::appendText(out, "2.0");
+        CborRpcParser::appendText(out, "method");
+        CborRpcParser::appendText(out, "processRequest");
+        CborRpcParser::appendText(out, "id");
+        CborRpcParser::appendHead(out, 0, id);
+        CborRpcParser::appendText(out, "params");
+        CborRpcParser::appendHead(out, 5, 2);
+        CborRpcParser::appendText(out, "priority");
+        CborRpcParser::appendHead(out, 0, quint64(priority));
+        CborRpcParser::appendText(out, "configuration");
+        CborRpcParser::appendText(out, configuration);
+        return;
+    }
+    out.append("{\"jsonrpc\":\"2.0\",\"method\":\"processRequest\",\"id\":");
+    out.append(QByteArray::number(id));
+    out.append(",\"params\":{\"priority\":");
+    out.append(QByteArray::number(priority));
+    out.append(",\"configuration\":\"");
+    out.append(configuration);
+    out.append("\"}}");
+}
+
+// id ответа; false, если ответ не разобран или id не наш
+bool replyId(QByteArrayView reply, WireFormat format, quint64 &id, bool &isError)
+{
+    QByteArrayView value;
+    bool ok = false;
+    if (format == CborFormat) {
+        if (!CborRpcParser::findMember(reply, "id", value))
+            return false;
+        const qint64 number = CborRpcParser::integer(value, &ok);
+        id = quint64(number);
+        ok = ok && number >= 0;
+        isError = CborRpcParser::findMember(reply, "error", value);
+    } else {
+        if (!JsonRpcParser::findMember(reply, "id", value) || !JsonRpcParser::isNumber(value))
+            return false;
+        id = value.toByteArray().toULongLong(&ok);
+        isError = JsonRpcParser::findMember(reply, "error", value);
+    }
+    return ok;
+}
+
+// Уведомление requestsCompleted, которое сервер шлёт сам, а не ответ на запрос
+bool isCompletionPush(QByteArrayView reply, WireFormat format)
+{
+    QByteArrayView value;
+    if (format == CborFormat) {
+        return CborRpcParser::findMember(reply, "method", value) && CborRpcParser::isText(value)
+                && CborRpcParser::text(value) == QByteArrayView("requestsCompleted");
+    }
+    return JsonRpcParser::findMember(reply, "method", value) && JsonRpcParser::isString(value)
+            && JsonRpcParser::stringEquals(value.sliced(1, value.size() - 2), "requestsCompleted");
+}
+
+class LoadGenerator
+{
+public:
+    explicit LoadGenerator(const Options &options);
+    ~LoadGenerator();
+
+    bool open();
+    void run();
+    void report() const;
+
+private:
+    void runOpenLoop();
+    void runClosedLoop();
+    bool send(quint64 id);
+    int priorityFor(quint64 id) const;
+    // Принимает ответы до deadline (нс); для каждого подтверждённого id вызывает done
+    template<typename Done>
+    void receive(qint64 deadline, Done done);
+
+    Options options;
+    int socketFd;
+    QAtomicInteger<qint64> *sentAt;   // Момент отправки по слотам; 0 — ответ уже получен
+
+    LatencyHistogram latency;         // Мкс; пишет только принимающий поток
+    QAtomicInteger<quint64> sent;
+    QAtomicInteger<quint64> sendErrors;
+    quint64 acknowledged;
+    quint64 rejected;                 // Ответы с ошибкой JSON-RPC
+    quint64 pushed;                   // Уведомления requestsCompleted
+    quint64 unexpected;               // Дубликаты, чужие и неразобранные ответы
+    qint64 elapsed;                   // Нс фактической отправки
+};
+
+LoadGenerator::LoadGenerator(const Options &options)
+    : options(options), socketFd(-1), sentAt(new QAtomicInteger<qint64>[SendSlots]),
+      latency(), sent(0), sendErrors(0), acknowledged(0), rejected(0), pushed(0), unexpected(0), elapsed(0)
+{
+}
+
+LoadGenerator::~LoadGenerator()
+{
+    if (socketFd >= 0) {
+        ::close(socketFd);
+    }
+    delete[] sentAt;
+}
+
+bool LoadGenerator::open()
+{
+    addrinfo hints;
+    memset(&hints, 0, sizeof(hints));
+    hints.ai_family = AF_UNSPEC;
+    hints.ai_socktype = SOCK_DGRAM;
+    addrinfo *addresses = nullptr;
+    const QByteArray port = QByteArray::number(options.port);
+    const int status = getaddrinfo(options.host.constData(), port.constData(), &hints, &addresses);
+    if (status != 0) {
+        std::cerr << "Cannot resolve " << options.host.constData() << ": " << gai_strerror(status) << std::endl;
+        return false;
+    }
+
+    for (addrinfo *address = addresses; address && socketFd < 0; address = address->ai_next) {
+        socketFd = ::socket(address->ai_family, address->ai_socktype | SOCK_NONBLOCK | SOCK_CLOEXEC, 0);
+        if (socketFd < 0) {
+            continue;
+        }
+        // connect() фильтрует датаграммы от других отправителей и позволяет send/recv
+        if (::connect(socketFd, address->ai_addr, address->ai_addrlen) != 0) {
+            ::close(socketFd);
+            socketFd = -1;
+        }
+    }
+    freeaddrinfo(addresses);
+    if (socketFd < 0) {
+        std::cerr << "Cannot connect to " << options.host.constData() << ": " << strerror(errno) << std::endl;
+        return false;
+    }
+
+    // Крупные буферы, чтобы потери на стороне генератора не смешивались с потерями сервера
+    const int bufferSize = 8 << 20;
+    setsockopt(socketFd, SOL_SOCKET, SO_RCVBUF, &bufferSize, sizeof(bufferSize));
+    setsockopt(socketFd, SOL_SOCKET, SO_SNDBUF, &bufferSize, sizeof(bufferSize));
+    return true;
+}
+
+int LoadGenerator::priorityFor(quint64 id) const
+{
+    return options.priority > 0 ? options.priority : int(id % 7) + 1;
+}
+
+bool LoadGenerator::send(quint64 id)
+{
+    thread_local QByteArray datagram;
+    buildRequest(datagram, options.format, id, priorityFor(id));
+    forever {
+        if (::send(socketFd, datagram.constData(), size_t(datagram.size()), 0) >= 0) {
+            sent.storeRelaxed(sent.loadRelaxed() + 1);
+            return true;
+        }
+        if (errno == EAGAIN || errno == EWOULDBLOCK) {
+            pollfd writable = {socketFd, POLLOUT, 0};
+            poll(&writable, 1, 10);
+            continue;
+        }
+        if (errno != EINTR) {
+            // ECONNREFUSED и подобные: сервер не слушает порт
+            sendErrors.storeRelaxed(sendErrors.loadRelaxed() + 1);
+            return false;
+        }
+    }
+}
+
+template<typename Done>
+void LoadGenerator::receive(qint64 deadline, Done done)
+{
+    char buffer[MaxDatagram];
+    forever {
+        const ssize_t size = ::recv(socketFd, buffer, sizeof(buffer), 0);
+        if (size < 0) {
+            if (errno == EINTR || errno == ECONNREFUSED) {
+                continue;
+            }
+            if (errno != EAGAIN && errno != EWOULDBLOCK) {
+                return;
+            }
+            const qint64 now = nowNs();
+            if (now >= deadline) {
+                return;
+            }
+            pollfd readable = {socketFd, POLLIN, 0};
+            poll(&readable, 1, int(qMin<qint64>((deadline - now + 999999) / 1000000, 10)));
+            continue;
+        }
+
+        const qint64 now = nowNs();
+        quint64 id;
+        bool isError;
+        if (isCompletionPush(QByteArrayView(buffer, size), options.format)) {
+            ++pushed;
+            continue;
+        }
+        if (!replyId(QByteArrayView(buffer, size), options.format, id, isError)) {
+            ++unexpected;
+            continue;
+        }
+        const qint64 sentTime = sentAt[id % SendSlots].fetchAndStoreRelaxed(0);
+        if (sentTime == 0) {
+            ++unexpected;
+            continue;
+        }
+        latency.record(quint64(qMax<qint64>(0, now - sentTime)) / 1000);
+        if (isError) {
+            ++rejected;
+        } else {
+            ++acknowledged;
+        }
+        done(id);
+    }
+}
+
+void LoadGenerator::run()
+{
+    if (options.closedLoop) {
+        runClosedLoop();
+    } else {
+        runOpenLoop();
+    }
+}
+
+void LoadGenerator::runOpenLoop()
+{
+    const qint64 interval = 1000000000 / options.rate;
+    const quint64 total = quint64(options.rate) * quint64(options.duration);
+    const qint64 start = nowNs();
+    QAtomicInt sending(1);
+
+    // Отправка идёт по расписанию в своём потоке. Задержка считается от
+    // запланированного момента, а не от фактической отправки: если генератор
+    // или сервер отстали, ожидание в очереди тоже попадает в измерение
+    // (поправка на coordinated omission).
+    QThread *sender = QThread::create([&] {
+        for (quint64 id = 1; id <= total; ++id) {
+            const qint64 scheduled = start + qint64(id - 1) * interval;
+            if (nowNs() < scheduled) {
+                sleepUntil(scheduled);
+            }
+            sentAt[id % SendSlots].storeRelaxed(scheduled);
+            if (!send(id)) {
+                sentAt[id % SendSlots].storeRelaxed(0);
+            }
+        }
+        elapsed = nowNs() - start;
+        sending.storeRelease(0);
+    });
+    sender->start();
+
+    while (sending.loadAcquire()) {
+        receive(nowNs() + 10000000, [](quint64) {});
+    }
+    sender->wait();
+    delete sender;
+    receive(nowNs() + qint64(options.timeout) * 1000000, [](quint64) {});
+}
+
+void LoadGenerator::runClosedLoop()
+{
+    const qint64 timeout = qint64(options.timeout) * 1000000;
+    const qint64 start = nowNs();
+    const qint64 end = start + qint64(options.duration) * 1000000000;
+    QHash<quint64, qint64> inFlight;   // id -> срок ожидания ответа
+    quint64 nextId = 1;
+
+    auto launch = [&] {
+        const quint64 id = nextId++;
+        const qint64 now = nowNs();
+        sentAt[id % SendSlots].storeRelaxed(now);
+        if (send(id)) {
+            inFlight.insert(id, now + timeout);
+        } else {
+            sentAt[id % SendSlots].storeRelaxed(0);
+        }
+    };
+
+    while (nowNs() < end && sendErrors.loadRelaxed() == 0) {
+        while (inFlight.size() < options.concurrency) {
+            launch();
+        }
+        receive(nowNs() + 1000000, [&](quint64 id) { inFlight.remove(id); });
+
+        // Не дождавшиеся ответа запросы считаются потерянными и заменяются новыми
+        const qint64 now = nowNs();
+        for (auto it = inFlight.begin(); it != inFlight.end();) {
+            if (it.value() <= now) {
+                sentAt[it.key() % SendSlots].storeRelaxed(0);
+                it = inFlight.erase(it);
+            } else {
+                ++it;
+            }
+        }
+    }
+    elapsed = nowNs() - start;
+    receive(nowNs() + timeout, [&](quint64 id) { inFlight.remove(id); });
+}
+
+void LoadGenerator::report() const
+{
+    const quint64 requests = sent.loadRelaxed();
+    const quint64 answered = acknowledged + rejected;
+    const quint64 lost = requests > answered ? requests - answered : 0;
+    const double seconds = elapsed > 0 ? double(elapsed) / 1e9 : 1.0;
+    const HistogramSummary summary = latency.summary();
+
+    std::printf("mode         %s, %s\n", options.closedLoop ? "closed loop" : "open loop",
+                options.format == CborFormat ? "CBOR" : "JSON");
+    std::printf("sent         %llu (%.0f/s)\n", (unsigned long long)requests, double(requests) / seconds);
+    std::printf("acknowledged %llu\n", (unsigned long long)acknowledged);
+    std::printf("rejected     %llu\n", (unsigned long long)rejected);
+    std::printf("lost         %llu (%.3f%%)\n", (unsigned long long)lost,
+                requests ? 100.0 * double(lost) / double(requests) : 0.0);
+    if (pushed) {
+        std::printf("pushed       %llu\n", (unsigned long long)pushed);
+    }
+    if (unexpected) {
+        std::printf("unexpected   %llu\n", (unsigned long long)unexpected);
+    }
+    if (sendErrors.loadRelaxed()) {
+        std::printf("send errors  %llu\n", (unsigned long long)sendErrors.loadRelaxed());
+    }
+    std::printf("ack latency  p50 %llu us, p90 %llu us, p99 %llu us, p99.9 %llu us, max %llu us\n",
+                (unsigned long long)summary.p50, (unsigned long long)summary.p90,
+                (unsigned long long)summary.p99, (unsigned long long)summary.p999,
+                (unsigned long long)summary.max);
+}
+
+} // namespace
+
+int main(int argc, char *argv[])
+{
+    QCoreApplication a(argc, argv);
+
+    QCommandLineParser parser;
+    parser.setApplicationDescription("Load generator for the UDP JSON-RPC server");
+    parser.addHelpOption();
+    QCommandLineOption hostOption("host", "Server address.", "host", "127.0.0.1");
+    parser.addOption(hostOption);
+    QCommandLineOption portOption("port", "Server port.", "port");
+    parser.addOption(portOption);
+    QCommandLineOption modeOption("mode",
+        "open: send at a fixed rate regardless of replies; closed: keep a fixed number of requests in flight.",
+        "mode", "open");
+    parser.addOption(modeOption);
+    QCommandLineOption rateOption("rate", "Requests per second in open-loop mode.", "count", "10000");
+    parser.addOption(rateOption);
+    QCommandLineOption concurrencyOption("concurrency", "Requests in flight in closed-loop mode.", "count", "64");
+    parser.addOption(concurrencyOption);
+    QCommandLineOption durationOption("duration", "Test duration.", "secs", "10");
+    parser.addOption(durationOption);
+    QCommandLineOption timeoutOption("timeout", "Time after which an unanswered request counts as lost.", "msecs", "1000");
+    parser.addOption(timeoutOption);
+    QCommandLineOption priorityOption("priority", "Request priority 1-7 (0 spreads requests over all priorities).", "level", "0");
+    parser.addOption(priorityOption);
+    QCommandLineOption formatOption("format", "Request encoding: json or cbor.", "format", "json");
+    parser.addOption(formatOption);
+    parser.process(a);
+
+    Options options;
+    bool ok;
+    options.host = parser.value(hostOption).toUtf8();
+    const int port = parser.value(portOption).toInt(&ok);
+    if (!ok || port < 1 || port > 65535) {
+        std::cerr << "A valid --port is required." << std::endl;
+        return 1;
+    }
+    options.port = quint16(port);
+    const QString mode = parser.value(modeOption);
+    if (mode != "open" && mode != "closed") {
+        std::cerr << "Invalid mode (open or closed)." << std::endl;
+        return 1;
+    }
+    options.closedLoop = mode == "closed";
+    options.rate = parser.value(rateOption).toInt(&ok);
+    if (!ok || options.rate < 1 || options.rate > 10000000) {
+        std::cerr << "Invalid rate." << std::endl;
+        return 1;
+    }
+    options.concurrency = parser.value(concurrencyOption).toInt(&ok);
+    if (!ok || options.concurrency < 1 || options.concurrency > SendSlots / 2) {
+        std::cerr << "Invalid concurrency." << std::endl;
+        return 1;
+    }
+    options.duration = parser.value(durationOption).toInt(&ok);
+    if (!ok || options.duration < 1) {
+        std::cerr << "Invalid duration." << std::endl;
+        return 1;
+    }
+    options.timeout = parser.value(timeoutOption).toInt(&ok);
+    if (!ok || options.timeout < 1) {
+        std::cerr << "Invalid timeout." << std::endl;
+        return 1;
+    }
+    options.priority = parser.value(priorityOption).toInt(&ok);
+    if (!ok || options.priority < 0 || options.priority > 7) {
+        std::cerr << "Invalid priority (0-7)." << std::endl;
+        return 1;
+    }
+    const QString format = parser.value(formatOption);
+    if (format != "json" && format != "cbor") {
+        std::cerr << "Invalid format (json or cbor)." << std::endl;
+        return 1;
+    }
+    options.format = format == "cbor" ? CborFormat : JsonFormat;
+
+    LoadGenerator generator(options);
+    if (!generator.open()) {
+        return 1;
+    }
+    generator.run();
+    generator.report();
+    return 0;
+}
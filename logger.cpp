@@ -0,0 +1,323 @@
+#include "logger.h"
+#include <QDateTime>
+#include <QList>
+#include <QMutex>
+#include <QThread>
+#include <QWaitCondition>
+#include <atomic>
+#include <cstdio>
+#include <cstring>
+#include <utility>
+
+namespace {
+
+// Кольцо одного потока-источника: пишет только он, читает только фоновый поток
+class LogRing
+{
+public:
+    enum { Capacity = 1024 };  // Степень двойки
+
+    explicit LogRing(quint32 thread) : thread(thread), head(0), tail(0), dropped(0), closed(0), writing(0) {}
+
+    LogRecord *acquire()
+    {
+        const quint32 h = head.loadRelaxed();
+        if (h - tail.loadAcquire() == Capacity) {
+            dropped.fetchAndAddRelaxed(1);
+            return nullptr;
+        }
+        return &records[h & (Capacity - 1)];
+    }
+    void publish()
+    {
+        head.storeRelease(head.loadRelaxed() + 1);
+        writing.storeRelease(0);
+    }
+
+    LogRecord records[Capacity];
+    const quint32 thread;
+    QAtomicInteger<quint32> head;     // Пишет источник
+    QAtomicInteger<quint32> tail;     // Пишет фоновый поток
+    QAtomicInteger<quint32> dropped;  // Записей потеряно из-за переполнения
+    QAtomicInt closed;                // Поток-источник завершился
+    QAtomicInt writing;               // Источник заполняет запись, см. Logger::stop()
+};
+
+// Кольцо текущего потока; при завершении потока помечается закрытым,
+// а удаляет его фоновый поток, дочитав остаток
+struct LocalRing {
+    LogRing *ring = nullptr;
+    ~LocalRing()
+    {
+        if (ring)
+            ring->closed.storeRelease(1);
+    }
+};
+
+thread_local LocalRing localRing;
+QAtomicInteger<quint32> threadCounter;
+
+const char LevelLetters[] = "DIWE";
+
+void appendArg(QByteArray &out, const LogRecord &record, int i)
+{
+    switch (record.types[i]) {
+    case LogRecord::Integer:
+        out.append(QByteArray::number(record.args[i].integer));
+        break;
+    case LogRecord::Unsigned:
+        out.append(QByteArray::number(record.args[i].number));
+        break;
+    case LogRecord::Real:
+        out.append(QByteArray::number(record.args[i].real));
+        break;
+    case LogRecord::Text:
+        out.append(record.text + record.args[i].text.offset, record.args[i].text.size);
+        break;
+    }
+}
+
+// Строка вида «12:34:56.789 I [2] сообщение»; %1..%6 заменяются аргументами
+void format(QByteArray &out, const LogRecord &record)
+{
+    out.append(QDateTime::fromMSecsSinceEpoch(record.time).toString("hh:mm:ss.zzz").toLatin1());
+    out.append(' ');
+    out.append(LevelLetters[record.level]);
+    out.append(" [");
+    out.append(QByteArray::number(record.thread));
+    out.append("] ");
+    for (const char *p = record.format; *p; ++p) {
+        if (p[0] == '%' && p[1] >= '1' && p[1] < '1' + record.argc) {
+            appendArg(out, record, p[1] - '1');
+            ++p;
+        } else {
+            out.append(*p);
+        }
+    }
+    out.append('\n');
+}
+
+void write(const QByteArray &out)
+{
+    fwrite(out.constData(), 1, size_t(out.size()), stderr);
+    fflush(stderr);
+}
+
+} // namespace
+
+class Logger::Private
+{
+public:
+    Private() : thread(nullptr), stopping(false) {}
+
+    void drain(QByteArray &out);
+    void run();
+
+    QMutex mutex;  // Защищает rings и stopping; источники берут его только при регистрации
+    QWaitCondition wake;
+    QList<LogRing *> rings;
+    QThread *thread;
+    bool stopping;
+};
+
+QAtomicInt Logger::threshold(Logger::Info);
+QAtomicInteger<quint32> Logger::sampling(1);
+
+void LogRecord::appendText(QByteArrayView value)
+{
+    const int i = argc++;
+    const qsizetype size = qMin<qsizetype>(value.size(), TextSize - textUsed);
+    types[i] = Text;
+    args[i].text.offset = textUsed;
+    args[i].text.size = quint16(size);
+    memcpy(text + textUsed, value.data(), size_t(size));
+    textUsed = quint16(textUsed + size);
+}
+
+Logger &Logger::instance()
+{
+    static Logger logger;
+    return logger;
+}
+
+Logger::Logger()
+    : d(new Private)
+    , running(0)
+{
+}
+
+Logger::~Logger()
+{
+    stop();
+    qDeleteAll(d->rings);
+    delete d;
+}
+
+void Logger::setLevel(Level level)
+{
+    threshold.storeRelaxed(level);
+}
+
+void Logger::setSampleInterval(int every)
+{
+    sampling.storeRelaxed(quint32(qMax(1, every)));
+}
+
+bool Logger::levelFromName(const QString &name, Level &level)
+{
+    static const char *const names[] = {"debug", "info", "warning", "error", "off"};
+    for (int i = Debug; i <= Off; ++i) {
+        if (name.compare(QLatin1String(names[i]), Qt::CaseInsensitive) == 0) {
+            level = Level(i);
+            return true;
+        }
+    }
+    return false;
+}
+
+void Logger::start()
+{
+    QMutexLocker locker(&d->mutex);
+    if (d->thread)
+        return;
+    d->stopping = false;
+    d->thread = QThread::create([this] { d->run(); });
+    d->thread->setObjectName("logger");
+    d->thread->start(QThread::LowPriority);
+    running.storeRelease(1);
+}
+
+void Logger::stop()
+{
+    QThread *thread;
+    {
+        QMutexLocker locker(&d->mutex);
+        if (!d->thread)
+            return;
+        running.storeRelaxed(0);
+        // Пара барьеру в acquire(): источник либо увидит running == 0, либо
+        // мы увидим его флаг writing и дождёмся публикации. Источник с
+        // поднятым флагом мьютекс не берёт, так что ждать можно под ним
+        std::atomic_thread_fence(std::memory_order_seq_cst);
+        for (LogRing *ring : std::as_const(d->rings)) {
+            while (ring->writing.loadAcquire())
+                QThread::yieldCurrentThread();
+        }
+        d->stopping = true;
+        d->wake.wakeOne();
+        thread = d->thread;
+        d->thread = nullptr;
+    }
+    thread->wait();  // Фоновый поток дочитывает кольца перед выходом
+    delete thread;
+}
+
+LogRecord *Logger::acquire(LogRecord *fallback)
+{
+    LogRing *&ring = localRing.ring;
+    if (!ring) {
+        ring = new LogRing(threadCounter.fetchAndAddRelaxed(1) + 1);
+        QMutexLocker locker(&d->mutex);
+        d->rings.append(ring);
+    }
+    ring->writing.storeRelaxed(1);
+    std::atomic_thread_fence(std::memory_order_seq_cst);
+    if (!running.loadRelaxed()) {
+        // stop() уже прошёл проверку флагов: в последнее дочитывание запись не попадёт
+        ring->writing.storeRelaxed(0);
+        return fallback;
+    }
+    LogRecord *record = ring->acquire();
+    if (!record)
+        ring->writing.storeRelaxed(0);
+    return record;
+}
+
+void Logger::publish(Level level)
+{
+    localRing.ring->publish();
+    // Предупреждения и ошибки выводятся без задержки опроса
+    if (level >= Warning) {
+        QMutexLocker locker(&d->mutex);
+        d->wake.wakeOne();
+    }
+}
+
+void Logger::begin(LogRecord &record, Level level, const char *format)
+{
+    LogRing *ring = localRing.ring;
+    record.time = QDateTime::currentMSecsSinceEpoch();
+    record.format = format;
+    record.level = quint8(level);
+    record.argc = 0;
+    record.textUsed = 0;
+    record.thread = ring ? ring->thread : 0;
+}
+
+void Logger::writeNow(const LogRecord &record)
+{
+    QByteArray out;
+    format(out, record);
+    write(out);
+}
+
+void Logger::Private::drain(QByteArray &out)
+{
+    QList<LogRing *> snapshot;
+    {
+        QMutexLocker locker(&mutex);
+        snapshot = rings;
+    }
+
+    for (LogRing *ring : std::as_const(snapshot)) {
+        // closed читается до head: всё, что поток успел записать, уже видно
+        const bool closed = ring->closed.loadAcquire();
+        const quint32 head = ring->head.loadAcquire();
+        quint32 tail = ring->tail.loadRelaxed();
+        for (; tail != head; ++tail)
+            format(out, ring->records[tail & (LogRing::Capacity - 1)]);
+        ring->tail.storeRelease(tail);
+
+        const quint32 dropped = ring->dropped.fetchAndStoreRelaxed(0);
+        if (dropped != 0) {
+            LogRecord record;
+            record.time = QDateTime::currentMSecsSinceEpoch();
+            record.format = "%1 log record(s) dropped";
+            record.level = Warning;
+            record.argc = 1;
+            record.textUsed = 0;
+            record.thread = ring->thread;
+            record.types[0] = LogRecord::Unsigned;
+            record.args[0].number = dropped;
+            format(out, record);
+        }
+
+        if (closed) {
+            QMutexLocker locker(&mutex);
+            rings.removeOne(ring);
+            delete ring;
+        }
+    }
+}
+
+void Logger::Private::run()
+{
+    QByteArray out;
+    forever {
+        out.clear();
+        drain(out);
+        if (!out.isEmpty())
+            write(out);
+
+        QMutexLocker locker(&mutex);
+        if (stopping)
+            break;
+        wake.wait(&mutex, 20);  // Опрос колец; ошибки будят поток сразу
+    }
+
+    // Записи, опубликованные между последним опросом и остановкой
+    out.clear();
+    drain(out);
+    if (!out.isEmpty())
+        write(out);
+}
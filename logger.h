@@ -0,0 +1,166 @@
+#ifndef LOGGER_H
+#define LOGGER_H
+
+#include <QAtomicInteger>
+#include <QByteArray>
+#include <QByteArrayView>
+#include <QString>
+#include <type_traits>
+
+// Запись журнала фиксированного размера: аргументы копируются в неё как есть,
+// а текст сообщения собирается уже в фоновом потоке
+struct LogRecord {
+    enum {
+        MaxArgs = 6,
+        TextSize = 160
+    };
+    enum ArgType : quint8 {
+        Integer,
+        Unsigned,
+        Real,
+        Text
+    };
+    struct TextRef {
+        quint16 offset;
+        quint16 size;
+    };
+    union Arg {
+        qint64 integer;
+        quint64 number;
+        double real;
+        TextRef text;
+    };
+
+    qint64 time;         // Мс Unix-времени
+    const char *format;  // Строковый литерал с %1..%6
+    quint8 level;
+    quint8 argc;
+    quint16 textUsed;
+    quint32 thread;      // Порядковый номер потока-источника
+    ArgType types[MaxArgs];
+    Arg args[MaxArgs];
+    char text[TextSize]; // Копии строковых аргументов, длинные обрезаются
+
+    void appendText(QByteArrayView value);
+};
+
+// Аргументы записи: числа хранятся как есть, строки копируются в запись
+namespace LogArg {
+
+template<typename T>
+inline typename std::enable_if<std::is_integral<T>::value || std::is_enum<T>::value>::type
+append(LogRecord &record, T value)
+{
+    const int i = record.argc++;
+    if (std::is_signed<T>::value) {
+        record.types[i] = LogRecord::Integer;
+        record.args[i].integer = qint64(value);
+    } else {
+        record.types[i] = LogRecord::Unsigned;
+        record.args[i].number = quint64(value);
+    }
+}
+
+inline void append(LogRecord &record, double value)
+{
+    const int i = record.argc++;
+    record.types[i] = LogRecord::Real;
+    record.args[i].real = value;
+}
+
+inline void append(LogRecord &record, QByteArrayView value) { record.appendText(value); }
+inline void append(LogRecord &record, const QByteArray &value) { record.appendText(QByteArrayView(value)); }
+inline void append(LogRecord &record, const char *value) { record.appendText(QByteArrayView(value)); }
+inline void append(LogRecord &record, const QString &value) { record.appendText(QByteArrayView(value.toUtf8())); }
+
+} // namespace LogArg
+
+// Асинхронный журнал. Каждый поток пишет в собственное кольцо записей без
+// блокировок, фоновый поток забирает записи, форматирует и выводит в stderr.
+// Проверка уровня — одно чтение атомарной переменной, аргументы отключённых
+// уровней даже не вычисляются (см. макросы LOG_*). Если кольцо переполнено,
+// запись отбрасывается, а число потерь выводится позже.
+class Logger
+{
+public:
+    enum Level {
+        Debug,
+        Info,
+        Warning,
+        Error,
+        Off
+    };
+
+    static Logger &instance();
+
+    static bool isEnabled(Level level) { return int(level) >= threshold.loadRelaxed(); }
+    static void setLevel(Level level);
+    static Level level() { return Level(threshold.loadRelaxed()); }
+    // Частые события (LOG_SAMPLED) выводятся один раз из every
+    static void setSampleInterval(int every);
+    static quint32 sampleInterval() { return sampling.loadRelaxed(); }
+    static bool levelFromName(const QString &name, Level &level);
+
+    // До start() и после stop() записи выводятся сразу в вызывающем потоке
+    void start();
+    void stop();
+
+    template<typename... Args>
+    void log(Level level, const char *format, const Args &...args)
+    {
+        static_assert(sizeof...(Args) <= LogRecord::MaxArgs, "Too many log arguments");
+        LogRecord local;
+        LogRecord *record = running.loadAcquire() ? acquire(&local) : &local;
+        if (!record) {
+            return;
+        }
+        begin(*record, level, format);
+        (LogArg::append(*record, args), ...);
+        if (record == &local) {
+            writeNow(local);
+        } else {
+            publish(level);
+        }
+    }
+
+private:
+    Logger();
+    ~Logger();
+
+    // Запись в кольце потока; fallback, если журнал уже останавливается
+    LogRecord *acquire(LogRecord *fallback);
+    void publish(Level level);
+    void begin(LogRecord &record, Level level, const char *format);
+    void writeNow(const LogRecord &record);
+
+    static QAtomicInt threshold;
+    static QAtomicInteger<quint32> sampling;
+
+    class Private;
+    Private *d;
+    QAtomicInt running;
+};
+
+#define LOG_AT(level, ...) \
+    do { \
+        if (Logger::isEnabled(level)) \
+            Logger::instance().log(level, __VA_ARGS__); \
+    } while (false)
+
+#define LOG_DEBUG(...) LOG_AT(Logger::Debug, __VA_ARGS__)
+#define LOG_INFO(...) LOG_AT(Logger::Info, __VA_ARGS__)
+#define LOG_WARNING(...) LOG_AT(Logger::Warning, __VA_ARGS__)
+#define LOG_ERROR(...) LOG_AT(Logger::Error, __VA_ARGS__)
+
+// Для событий на каждую датаграмму: в каждом потоке выводится одно из
+// Logger::sampleInterval() срабатываний этого места
+#define LOG_SAMPLED(level, ...) \
+    do { \
+        if (Logger::isEnabled(level)) { \
+            static thread_local quint32 logSampleCounter = 0; \
+            if (logSampleCounter++ % Logger::sampleInterval() == 0) \
+                Logger::instance().log(level, __VA_ARGS__); \
+        } \
+    } while (false)
+
+#endif // LOGGER_H
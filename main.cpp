@@ -1,5 +1,8 @@
 #include <QCoreApplication>
+#include <QCommandLineParser>
+#include <QThread>
 #include "server.h"
+#include "logger.h"
 #include <iostream>
 #include <string>
 #include <limits>
@@ -7,9 +10,299 @@
 int main(int argc, char *argv[])
 {
     QCoreApplication a(argc, argv);
+
+    QCommandLineParser parser;
+    parser.setApplicationDescription("UDP JSON-RPC server");
+    parser.addHelpOption();
+    QCommandLineOption agingOption("aging",
+        "Milliseconds a queued request waits before it is promoted one priority level (0 disables aging).",
+        "msecs", "2000");
+    parser.addOption(agingOption);
+    QCommandLineOption schedulingOption("scheduling",
+        "Order of queued requests: priority (priority levels with per-client rounds) or deadline (earliest deadline first).",
+        "policy", "priority");
+    parser.addOption(schedulingOption);
+    QCommandLineOption batchOption("batch",
+        "Maximum number of datagrams received with one system call.",
+        "count", "64");
+    parser.addOption(batchOption);
+    QCommandLineOption ioBackendOption("io-backend",
+        "UDP I/O on Linux: sockets (recvmmsg/sendmmsg) or io_uring (falls back to sockets when unavailable).",
+        "backend", "sockets");
+    parser.addOption(ioBackendOption);
+    QCommandLineOption listenersOption("listeners",
+        "Number of listener threads sharing the port via SO_REUSEPORT (0 = one per CPU).",
+        "count", "1");
+    parser.addOption(listenersOption);
+    QCommandLineOption workersOption("workers",
+        "Number of threads processing queued requests (0 = one per CPU).",
+        "count", "1");
+    parser.addOption(workersOption);
+    QCommandLineOption workerAffinityOption("worker-affinity",
+        "Keep requests of one client or configuration on one worker thread, in order: none, client or configuration.",
+        "key", "none");
+    parser.addOption(workerAffinityOption);
+    QCommandLineOption groupWindowOption("group-window",
+        "Number of due requests of one priority split into same-configuration batches at a time (1 = no batching).",
+        "count", "16");
+    parser.addOption(groupWindowOption);
+    QCommandLineOption groupShiftOption("group-shift",
+        "Maximum number of earlier requests a request may overtake by joining a batch.",
+        "count", "8");
+    parser.addOption(groupShiftOption);
+    QCommandLineOption replySizeOption("reply-size",
+        "Maximum size of one batch response datagram in bytes; larger replies are split.",
+        "bytes", "1400");
+    parser.addOption(replySizeOption);
+    QCommandLineOption tcpOption("tcp",
+        "Also accept requests over TCP on the same port number, as frames prefixed with a 4-byte big-endian length.");
+    parser.addOption(tcpOption);
+    QCommandLineOption unixSocketOption("unix-socket",
+        "Also accept length-prefixed requests on this Unix-domain socket.",
+        "path");
+    parser.addOption(unixSocketOption);
+    QCommandLineOption pushOption("push-completions",
+        "Notify clients with a requestsCompleted notification when their queued requests complete.");
+    parser.addOption(pushOption);
+    QCommandLineOption pushWindowOption("push-window",
+        "Milliseconds during which completions for one client are coalesced into one notification.",
+        "msecs", "5");
+    parser.addOption(pushWindowOption);
+    QCommandLineOption pushRetryOption("push-retry",
+        "Milliseconds before an unacknowledged notification is first resent; the interval doubles on each retry.",
+        "msecs", "200");
+    parser.addOption(pushRetryOption);
+    QCommandLineOption pushAttemptsOption("push-attempts",
+        "Times a notification is sent, the first one included, before it is given up on.",
+        "count", "5");
+    parser.addOption(pushAttemptsOption);
+    QCommandLineOption logLevelOption("log-level",
+        "Lowest log level written: debug, info, warning, error or off.",
+        "level", "info");
+    parser.addOption(logLevelOption);
+    QCommandLineOption logSampleOption("log-sample",
+        "Write only one of every N per-datagram debug events.",
+        "N", "1");
+    parser.addOption(logSampleOption);
+    QCommandLineOption metricsFileOption("metrics-file",
+        "Periodically write metrics in Prometheus text format to this file (for the node_exporter textfile collector).",
+        "path");
+    parser.addOption(metricsFileOption);
+    QCommandLineOption metricsIntervalOption("metrics-interval",
+        "Seconds between metrics file updates.",
+        "secs", "10");
+    parser.addOption(metricsIntervalOption);
+    QCommandLineOption queueLimitOption("queue-limit",
+        "Queue length at which new requests are rejected with a \"Server busy\" error.",
+        "count", "100000");
+    parser.addOption(queueLimitOption);
+    QCommandLineOption queueResumeOption("queue-resume",
+        "Queue length at or below which requests are accepted again after an overload (default: 90% of --queue-limit, below the limit).",
+        "count");
+    parser.addOption(queueResumeOption);
+    QCommandLineOption clientRateOption("client-rate",
+        "Requests per second allowed from one client address and port (0 = unlimited).",
+        "count", "0");
+    parser.addOption(clientRateOption);
+    QCommandLineOption clientBurstOption("client-burst",
+        "Requests a client may send at once above its rate (default: one second worth).",
+        "count", "0");
+    parser.addOption(clientBurstOption);
+    QCommandLineOption fairQuantumOption("fair-quantum",
+        "Requests served from one client before moving on to the next one of the same priority.",
+        "count", "4");
+    parser.addOption(fairQuantumOption);
+    QCommandLineOption retryCacheOption("retry-cache",
+        "Accepted requests remembered to recognise client retransmissions (0 disables the cache).",
+        "count", "65536");
+    parser.addOption(retryCacheOption);
+    QCommandLineOption retryTtlOption("retry-ttl",
+        "Milliseconds a retransmitted request is still recognised as a retry.",
+        "msecs", "30000");
+    parser.addOption(retryTtlOption);
+    QCommandLineOption logDirectoryOption("request-log",
+        "Directory of the write-ahead log of accepted requests; pending requests are restored from it on start.",
+        "path");
+    parser.addOption(logDirectoryOption);
+    QCommandLineOption logSyncOption("request-log-sync",
+        "Milliseconds between group commits (fdatasync) of the request log.",
+        "msecs", "5");
+    parser.addOption(logSyncOption);
+    QCommandLineOption logEarlyAckOption("request-log-early-ack",
+        "Acknowledge requests without waiting for their request log group commit; a crash may then lose acknowledged requests.");
+    parser.addOption(logEarlyAckOption);
+    QCommandLineOption logCheckpointOption("request-log-checkpoint",
+        "Log segment size in MiB after which pending requests are compacted into a checkpoint.",
+        "MiB", "64");
+    parser.addOption(logCheckpointOption);
+    QCommandLineOption handoverOption("handover",
+        "Unix-domain socket for restarts without downtime: a server started with the same path takes over the sockets and queued requests of the running one, which then exits.",
+        "path");
+    parser.addOption(handoverOption);
+    QCommandLineOption portOption("port",
+        "UDP port to listen on (49153-65535); without it the port is asked on stdin, unless --handover is given and the sockets are taken over from the running server.",
+        "port");
+    parser.addOption(portOption);
+    parser.process(a);
+
+    ServerOptions options;
+    bool ok;
+    options.agingInterval = parser.value(agingOption).toLongLong(&ok);
+    if (!ok || options.agingInterval < 0) {
+        std::cerr << "Invalid aging interval." << std::endl;
+        return 1;
+    }
+    if (!RequestScheduler::policyFromName(parser.value(schedulingOption), options.scheduling)) {
+        std::cerr << "Invalid scheduling policy." << std::endl;
+        return 1;
+    }
+    options.batchSize = parser.value(batchOption).toInt(&ok);
+    if (!ok || options.batchSize < 1 || options.batchSize > 1024) {
+        std::cerr << "Invalid batch size (1-1024)." << std::endl;
+        return 1;
+    }
+    if (!UdpTransport::backendFromName(parser.value(ioBackendOption), options.ioBackend)) {
+        std::cerr << "Invalid I/O backend." << std::endl;
+        return 1;
+    }
+    options.listenerCount = parser.value(listenersOption).toInt(&ok);
+    if (!ok || options.listenerCount < 0) {
+        std::cerr << "Invalid listener count." << std::endl;
+        return 1;
+    }
+    options.workerCount = parser.value(workersOption).toInt(&ok);
+    if (!ok || options.workerCount < 0) {
+        std::cerr << "Invalid worker count." << std::endl;
+        return 1;
+    }
+    if (!WorkerPool::affinityFromName(parser.value(workerAffinityOption), options.workerAffinity)) {
+        std::cerr << "Invalid worker affinity." << std::endl;
+        return 1;
+    }
+    options.groupWindow = parser.value(groupWindowOption).toInt(&ok);
+    if (!ok || options.groupWindow < 1 || options.groupWindow > 1024) {
+        std::cerr << "Invalid group window (1-1024)." << std::endl;
+        return 1;
+    }
+    options.groupShift = parser.value(groupShiftOption).toInt(&ok);
+    if (!ok || options.groupShift < 0) {
+        std::cerr << "Invalid group shift." << std::endl;
+        return 1;
+    }
+    options.maxReplySize = parser.value(replySizeOption).toInt(&ok);
+    if (!ok || options.maxReplySize < 512 || options.maxReplySize > 65507) {
+        std::cerr << "Invalid reply size (512-65507)." << std::endl;
+        return 1;
+    }
+    options.streamTcp = parser.isSet(tcpOption);
+    options.streamSocket = parser.value(unixSocketOption);
+    options.metricsFile = parser.value(metricsFileOption);
+    const int metricsInterval = parser.value(metricsIntervalOption).toInt(&ok);
+    if (!ok || metricsInterval < 1) {
+        std::cerr << "Invalid metrics interval." << std::endl;
+        return 1;
+    }
+    options.metricsInterval = metricsInterval * 1000;
+    options.queueLimit = parser.value(queueLimitOption).toInt(&ok);
+    if (!ok || options.queueLimit < 1) {
+        std::cerr << "Invalid queue limit." << std::endl;
+        return 1;
+    }
+    // 90% предела, но всегда ниже него: при малом пределе десятая часть — ноль
+    options.queueResume = qMin(options.queueLimit - 1, options.queueLimit - options.queueLimit / 10);
+    if (parser.isSet(queueResumeOption)) {
+        options.queueResume = parser.value(queueResumeOption).toInt(&ok);
+        if (!ok || options.queueResume < 0 || options.queueResume >= options.queueLimit) {
+            std::cerr << "Invalid queue resume level (0 to queue limit - 1)." << std::endl;
+            return 1;
+        }
+    }
+    options.clientRate = parser.value(clientRateOption).toInt(&ok);
+    if (!ok || options.clientRate < 0) {
+        std::cerr << "Invalid client rate." << std::endl;
+        return 1;
+    }
+    options.clientBurst = parser.value(clientBurstOption).toInt(&ok);
+    if (!ok || options.clientBurst < 0) {
+        std::cerr << "Invalid client burst." << std::endl;
+        return 1;
+    }
+    options.fairQuantum = parser.value(fairQuantumOption).toInt(&ok);
+    if (!ok || options.fairQuantum < 1) {
+        std::cerr << "Invalid fair quantum." << std::endl;
+        return 1;
+    }
+    options.retryCacheSize = parser.value(retryCacheOption).toInt(&ok);
+    if (!ok || options.retryCacheSize < 0 || options.retryCacheSize > (1 << 24)) {
+        std::cerr << "Invalid retry cache size (0-16777216)." << std::endl;
+        return 1;
+    }
+    options.retryTtl = parser.value(retryTtlOption).toLongLong(&ok);
+    if (!ok || options.retryTtl < 1) {
+        std::cerr << "Invalid retry TTL." << std::endl;
+        return 1;
+    }
+    options.logDirectory = parser.value(logDirectoryOption);
+    options.logSyncInterval = parser.value(logSyncOption).toInt(&ok);
+    if (!ok || options.logSyncInterval < 1 || options.logSyncInterval > 10000) {
+        std::cerr << "Invalid request log sync interval (1-10000)." << std::endl;
+        return 1;
+    }
+    options.logAckBeforeSync = parser.isSet(logEarlyAckOption);
+    const qint64 logCheckpoint = parser.value(logCheckpointOption).toLongLong(&ok);
+    if (!ok || logCheckpoint < 1) {
+        std::cerr << "Invalid request log checkpoint size." << std::endl;
+        return 1;
+    }
+    options.logCheckpointSize = logCheckpoint << 20;
+    options.handoverPath = parser.value(handoverOption);
+    options.pushCompletions = parser.isSet(pushOption);
+    options.pushWindow = parser.value(pushWindowOption).toInt(&ok);
+    if (!ok || options.pushWindow < 0 || options.pushWindow > 10000) {
+        std::cerr << "Invalid push window (0-10000)." << std::endl;
+        return 1;
+    }
+    options.pushRetryInterval = parser.value(pushRetryOption).toInt(&ok);
+    if (!ok || options.pushRetryInterval < 1) {
+        std::cerr << "Invalid push retry interval." << std::endl;
+        return 1;
+    }
+    options.pushAttempts = parser.value(pushAttemptsOption).toInt(&ok);
+    if (!ok || options.pushAttempts < 1 || options.pushAttempts > 16) {
+        std::cerr << "Invalid push attempt count (1-16)." << std::endl;
+        return 1;
+    }
+    Logger::Level logLevel;
+    if (!Logger::levelFromName(parser.value(logLevelOption), logLevel)) {
+        std::cerr << "Invalid log level." << std::endl;
+        return 1;
+    }
+    const int logSample = parser.value(logSampleOption).toInt(&ok);
+    if (!ok || logSample < 1) {
+        std::cerr << "Invalid log sample interval." << std::endl;
+        return 1;
+    }
+    Logger::setLevel(logLevel);
+    Logger::setSampleInterval(logSample);
+    if (options.listenerCount == 0) {
+        options.listenerCount = QThread::idealThreadCount();
+    }
+    if (options.workerCount == 0) {
+        options.workerCount = QThread::idealThreadCount();
+    }
+
     quint16 port = 0;
+    if (parser.isSet(portOption)) {
+        const int value = parser.value(portOption).toInt(&ok);
+        if (!ok || value <= 49152 || value > 65535) {
+            std::cerr << "Invalid port number." << std::endl;
+            return 1;
+        }
+        port = static_cast<quint16>(value);
+    }
 
-    while (port == 0) {
+    // Преемник получает сокеты работающего сервера вместе с их портом
+    while (port == 0 && options.handoverPath.isEmpty()) {
         std::cout << "Enter a port number (49152-65535): ";
         std::string input;
         std::cin >> input;
@@ -32,10 +325,15 @@ int main(int argc, char *argv[])
         }
     }
 
+    // Журнал пишется фоновым потоком; при выходе он дописывает накопленное
+    Logger::instance().start();
+    QObject::connect(&a, &QCoreApplication::aboutToQuit, [] { Logger::instance().stop(); });
+
     // Создаем сервер и передаем ему порт
-    Server server(port);
+    Server server(port, options);
+    QObject::connect(&server, &Server::handedOver, &a, &QCoreApplication::quit, Qt::QueuedConnection);
 
-    std::cout << "Server is running on port " << port << ". Waiting for requests..." << std::endl;
+    std::cout << "Server is running on port " << server.port() << ". Waiting for requests..." << std::endl;
 
     return a.exec();
 }
@@ -0,0 +1,204 @@
+#include "metrics.h"
+#include <QtAlgorithms>
+#include <utility>
+
+namespace {
+
+struct CounterInfo {
+    const char *name;        // Для getStats
+    const char *metric;      // Для Prometheus
+    const char *help;
+};
+
+const CounterInfo Counters[Metrics::CounterCount] = {
+    {"datagramsReceived", "serv_datagrams_received_total", "Datagrams received."},
+    {"datagramsSent", "serv_datagrams_sent_total", "Reply datagrams handed to the socket."},
+    {"requestsReceived", "serv_requests_received_total", "JSON-RPC calls received, batch elements included."},
+    {"requestsAccepted", "serv_requests_accepted_total", "Calls queued for processing."},
+    {"requestsRejected", "serv_requests_rejected_total", "Calls rejected as malformed or with invalid params."},
+    {"unknownMethods", "serv_unknown_methods_total", "Calls to unknown methods."},
+    {"batchesReceived", "serv_batches_received_total", "Batch requests received."},
+    {"requestsProcessed", "serv_requests_processed_total", "Queued requests processed."},
+    {"socketDrops", "serv_socket_drops_total", "Datagrams dropped by the kernel on a full receive buffer."},
+    {"oversizedDatagrams", "serv_oversized_datagrams_total", "Datagrams dropped as larger than the receive slot."},
+    {"requestsShed", "serv_requests_shed_total", "Calls rejected while the queue is above its high watermark."},
+    {"requestsThrottled", "serv_requests_throttled_total", "Calls rejected by the per-client rate limit."},
+    {"duplicateRequests", "serv_duplicate_requests_total", "Retransmitted calls acknowledged from the retry cache without queueing."},
+    {"requestsStolen", "serv_requests_stolen_total", "Queued requests a worker thread took over from another worker's queue."},
+    {"requestsCancelled", "serv_requests_cancelled_total", "Queued requests withdrawn by their clients with cancelRequest."},
+    {"completionsPushed", "serv_completions_pushed_total", "Request results pushed to clients in requestsCompleted notifications."},
+    {"completionsResent", "serv_completions_resent_total", "Retransmissions of unacknowledged completion notifications."},
+    {"completionsDropped", "serv_completions_dropped_total", "Completion notifications given up on without an acknowledgement."},
+    {"connectionsAccepted", "serv_connections_accepted_total", "Stream connections accepted over TCP or a Unix socket."},
+    {"oversizedFrames", "serv_oversized_frames_total", "Stream frames over the size limit; the connection is closed."},
+    {"fragmentsReceived", "serv_fragments_received_total", "Fragments of requests larger than one datagram."},
+    {"reassemblyDropped", "serv_reassembly_dropped_total", "Fragments or partial messages dropped as invalid, over the memory cap or timed out."},
+    {"fragmentNacks", "serv_fragment_nacks_total", "Retransmit requests sent for missing fragments."},
+    {"requestBatches", "serv_request_batches_total", "Batches of same-configuration requests run by worker threads."},
+    {"requestsExpired", "serv_requests_expired_total", "Queued requests dropped unprocessed because their deadline passed."}
+};
+
+struct HistogramInfo {
+    const char *name;
+    const char *metric;
+    const char *help;
+    double scale;            // Единица записи в секундах
+};
+
+const HistogramInfo Histograms[Metrics::HistogramCount] = {
+    {"ackLatencyUs", "serv_ack_latency_seconds", "Time from datagram receipt to reply hand-off.", 1e-6},
+    {"queueWaitMs", "serv_queue_wait_seconds", "Time a request waits in the queue before processing.", 1e-3},
+    {"batchRunUs", "serv_request_batch_run_seconds", "Time a worker thread spends on one batch of same-configuration requests.", 1e-6}
+};
+
+// Границы le в Prometheus — 2^k - 1: корзины целочисленные, «не больше 2^k - 1»
+// совпадает с «меньше 2^k», поэтому накопленные значения точные
+const int PrometheusBuckets = 25;
+
+} // namespace
+
+thread_local Metrics::Shard *Metrics::shard = nullptr;
+QMutex Metrics::shardsMutex;
+QList<Metrics::Shard *> Metrics::shards;
+
+int LatencyHistogram::bucketOf(quint64 value)
+{
+    if (value < 2 * SubBuckets)
+        return int(value);
+    const int shift = 63 - qCountLeadingZeroBits(value) - SubBucketBits;
+    return shift * SubBuckets + int(value >> shift);
+}
+
+quint64 LatencyHistogram::lowerBound(int bucket)
+{
+    if (bucket < 2 * SubBuckets)
+        return quint64(bucket);
+    const int shift = bucket / SubBuckets - 1;
+    return quint64(bucket - shift * SubBuckets) << shift;
+}
+
+Metrics::Shard *Metrics::registerShard()
+{
+    shard = new Shard;
+    QMutexLocker locker(&shardsMutex);
+    shards.append(shard);
+    return shard;
+}
+
+quint64 Metrics::counter(Counter counter)
+{
+    QMutexLocker locker(&shardsMutex);
+    quint64 total = 0;
+    for (const Shard *p : std::as_const(shards))
+        total += p->counters[counter].loadRelaxed();
+    return total;
+}
+
+HistogramSummary LatencyHistogram::summarize(const quint64 *counts, quint64 sum, quint64 max)
+{
+    HistogramSummary result = {};
+    result.sum = sum;
+    result.max = max;
+    for (int i = 0; i < BucketCount; ++i)
+        result.count += counts[i];
+    if (result.count == 0)
+        return result;
+
+    const quint64 targets[] = {(result.count * 50 + 99) / 100, (result.count * 90 + 99) / 100,
+                               (result.count * 99 + 99) / 100, (result.count * 999 + 999) / 1000};
+    quint64 *values[] = {&result.p50, &result.p90, &result.p99, &result.p999};
+    quint64 seen = 0;
+    int next = 0;
+    for (int i = 0; i < BucketCount && next < 4; ++i) {
+        seen += counts[i];
+        while (next < 4 && seen >= targets[next]) {
+            const quint64 upper = i + 1 < BucketCount ? lowerBound(i + 1) - 1 : max;
+            *values[next++] = qMin(upper, max);
+        }
+    }
+    return result;
+}
+
+HistogramSummary LatencyHistogram::summary() const
+{
+    QList<quint64> counts(BucketCount, 0);
+    for (int i = 0; i < BucketCount; ++i)
+        counts[i] = buckets[i].loadRelaxed();
+    return summarize(counts.constData(), sum.loadRelaxed(), max.loadRelaxed());
+}
+
+HistogramSummary Metrics::summary(Histogram histogram)
+{
+    QList<quint64> merged(LatencyHistogram::BucketCount, 0);
+    quint64 sum = 0;
+    quint64 max = 0;
+    {
+        QMutexLocker locker(&shardsMutex);
+        for (const Shard *p : std::as_const(shards)) {
+            const LatencyHistogram &h = p->histograms[histogram];
+            for (int i = 0; i < LatencyHistogram::BucketCount; ++i)
+                merged[i] += h.buckets[i].loadRelaxed();
+            sum += h.sum.loadRelaxed();
+            max = qMax(max, h.max.loadRelaxed());
+        }
+    }
+    return LatencyHistogram::summarize(merged.constData(), sum, max);
+}
+
+const char *Metrics::counterName(Counter counter)
+{
+    return Counters[counter].name;
+}
+
+const char *Metrics::histogramName(Histogram histogram)
+{
+    return Histograms[histogram].name;
+}
+
+void Metrics::appendPrometheus(QByteArray &out)
+{
+    for (int c = 0; c < CounterCount; ++c) {
+        const CounterInfo &info = Counters[c];
+        out.append("# HELP ").append(info.metric).append(' ').append(info.help).append('\n');
+        out.append("# TYPE ").append(info.metric).append(" counter\n");
+        out.append(info.metric).append(' ').append(QByteArray::number(counter(Counter(c)))).append('\n');
+    }
+
+    for (int h = 0; h < HistogramCount; ++h) {
+        const HistogramInfo &info = Histograms[h];
+        QList<quint64> cumulative(PrometheusBuckets, 0);
+        quint64 count = 0;
+        quint64 sum = 0;
+        {
+            QMutexLocker locker(&shardsMutex);
+            for (const Shard *p : std::as_const(shards)) {
+                const LatencyHistogram &histogram = p->histograms[h];
+                for (int i = 0; i < LatencyHistogram::BucketCount; ++i) {
+                    const quint64 n = histogram.buckets[i].loadRelaxed();
+                    if (n == 0)
+                        continue;
+                    count += n;
+                    // Корзина целиком меньше 2^k, начиная с первого k выше её нижней границы
+                    const quint64 lower = LatencyHistogram::lowerBound(i);
+                    for (int k = 0; k < PrometheusBuckets; ++k) {
+                        if (lower < (quint64(1) << k))
+                            cumulative[k] += n;
+                    }
+                }
+                sum += histogram.sum.loadRelaxed();
+            }
+        }
+
+        out.append("# HELP ").append(info.metric).append(' ').append(info.help).append('\n');
+        out.append("# TYPE ").append(info.metric).append(" histogram\n");
+        // le включает границу: в корзине k значения меньше 2^k, то есть не больше 2^k - 1
+        for (int k = 0; k < PrometheusBuckets; ++k) {
+            out.append(info.metric).append("_bucket{le=\"")
+               .append(QByteArray::number(double((quint64(1) << k) - 1) * info.scale, 'g', 6))
+               .append("\"} ").append(QByteArray::number(cumulative[k])).append('\n');
+        }
+        out.append(info.metric).append("_bucket{le=\"+Inf\"} ").append(QByteArray::number(count)).append('\n');
+        out.append(info.metric).append("_sum ").append(QByteArray::number(double(sum) * info.scale, 'g', 12)).append('\n');
+        out.append(info.metric).append("_count ").append(QByteArray::number(count)).append('\n');
+    }
+}
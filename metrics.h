@@ -0,0 +1,135 @@
+#ifndef METRICS_H
+#define METRICS_H
+
+#include <QAtomicInteger>
+#include <QByteArray>
+#include <QList>
+#include <QMutex>
+
+// Сводка гистограммы: перцентили — верхние границы корзин, не выше max
+struct HistogramSummary {
+    quint64 count;
+    quint64 sum;
+    quint64 max;
+    quint64 p50;
+    quint64 p90;
+    quint64 p99;
+    quint64 p999;
+};
+
+// Гистограмма в духе HDR: до 32 значения точные, дальше на каждую степень
+// двойки 16 корзин, то есть погрешность не больше 1/16. Пишет в неё только
+// поток-владелец, поэтому атомарные операции — обычные load/store без lock;
+// читать можно из любого потока.
+class LatencyHistogram
+{
+public:
+    enum {
+        SubBucketBits = 4,
+        SubBuckets = 1 << SubBucketBits,
+        BucketCount = (64 - SubBucketBits + 1) * SubBuckets
+    };
+
+    void record(quint64 value)
+    {
+        bump(buckets[bucketOf(value)], 1);
+        bump(total, 1);
+        bump(sum, value);
+        if (value > max.loadRelaxed())
+            max.storeRelaxed(value);
+    }
+
+    static int bucketOf(quint64 value);
+    static quint64 lowerBound(int bucket);
+    static HistogramSummary summarize(const quint64 *counts, quint64 sum, quint64 max);
+
+    HistogramSummary summary() const;
+
+    QAtomicInteger<quint64> buckets[BucketCount];
+    QAtomicInteger<quint64> total;
+    QAtomicInteger<quint64> sum;
+    QAtomicInteger<quint64> max;
+
+private:
+    static void bump(QAtomicInteger<quint64> &value, quint64 n) { value.storeRelaxed(value.loadRelaxed() + n); }
+};
+
+
+// Счётчики и гистограммы сервера. У каждого потока своя копия (shard),
+// поэтому запись не требует ни блокировок, ни атомарных read-modify-write;
+// снимок суммирует копии всех потоков. Копии завершившихся потоков не
+// удаляются, чтобы итоги не уменьшались.
+class Metrics
+{
+public:
+    enum Counter {
+        DatagramsReceived,
+        DatagramsSent,
+        RequestsReceived,   // Вызовы, включая элементы пакетов
+        RequestsAccepted,   // Поставлены в очередь
+        RequestsRejected,   // Ошибки разбора и параметров
+        UnknownMethods,
+        BatchesReceived,
+        RequestsProcessed,
+        SocketDrops,        // Отброшены ядром из-за переполнения буфера сокета (SO_RXQ_OVFL)
+        OversizedDatagrams,
+        RequestsShed,       // Отклонены: очередь выше верхнего порога
+        RequestsThrottled,  // Отклонены лимитом клиента
+        DuplicateRequests,  // Повторы уже принятых заявок, подтверждены из кеша
+        RequestsStolen,     // Взяты потоком обработки из чужой очереди
+        RequestsCancelled,  // Отменены клиентом через cancelRequest
+        CompletionsPushed,  // Результаты, отправленные клиентам в requestsCompleted
+        CompletionsResent,  // Повторы неподтверждённых уведомлений
+        CompletionsDropped, // Уведомления, так и не подтверждённые после всех повторов
+        ConnectionsAccepted, // Потоковые соединения (TCP и Unix-сокеты)
+        OversizedFrames,    // Кадры больше предела, соединение закрыто
+        FragmentsReceived,  // Фрагменты запросов больше одной датаграммы
+        ReassemblyDropped,  // Фрагменты и сборки, отброшенные как неверные, лишние или просроченные
+        FragmentNacks,      // Запросы недостающих фрагментов
+        RequestBatches,     // Пачки заявок одной конфигурации, выполненные потоками обработки
+        RequestsExpired,    // Сняты до выполнения: истёк срок deadline
+        CounterCount
+    };
+
+    enum Histogram {
+        AckLatency,         // От приёма датаграммы до передачи ответа в сокет, мкс
+        QueueWait,          // От постановки в очередь до обработки, мс
+        BatchRunTime,       // Выполнение одной пачки заявок, мкс
+        HistogramCount
+    };
+
+    static void add(Counter counter, quint64 n = 1)
+    {
+        QAtomicInteger<quint64> &value = local().counters[counter];
+        value.storeRelaxed(value.loadRelaxed() + n);
+    }
+    static void record(Histogram histogram, quint64 value) { local().histograms[histogram].record(value); }
+
+    static quint64 counter(Counter counter);
+    static HistogramSummary summary(Histogram histogram);
+
+    static const char *counterName(Counter counter);
+    static const char *histogramName(Histogram histogram);
+
+    // Счётчики и гистограммы в текстовом формате Prometheus
+    static void appendPrometheus(QByteArray &out);
+
+private:
+    struct Shard {
+        QAtomicInteger<quint64> counters[CounterCount];
+        LatencyHistogram histograms[HistogramCount];
+    };
+
+    static Shard &local()
+    {
+        Shard *current = shard;
+        return Q_LIKELY(current) ? *current : *registerShard();
+    }
+    static Shard *registerShard();
+
+    static thread_local Shard *shard;
+    static QMutex shardsMutex;   // Защищает только список, не сами копии
+    static QList<Shard *> shards;
+};
+
+#endif // METRICS_H
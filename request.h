@@ -0,0 +1,67 @@
+#ifndef REQUEST_H
+#define REQUEST_H
+
+#include <QHostAddress>
+#include <QList>
+#include <QString>
+#include <QtEndian>
+#include "configuration.h"
+#include "wire_format.h"
+
+struct ClientInfo {
+    QHostAddress address;
+    quint16 port;
+    // Клиент потокового соединения: отвечают ему только в соединение, не по UDP.
+    // У Unix-сокета адреса нет, вместо него — уникальный номер соединения
+    bool stream = false;
+};
+
+// Клиент как ключ хеш-таблиц: адрес в виде IPv6 (IPv4 — отображённый) и порт.
+// Сравнение и хеширование — несколько целочисленных операций вместо QHostAddress
+struct ClientKey {
+    quint64 high = 0;
+    quint64 low = 0;
+    quint16 port = 0;
+    bool stream = false;  // С UDP-клиентом того же адреса и порта не совпадает
+
+    static ClientKey of(const ClientInfo &client)
+    {
+        const Q_IPV6ADDR address = client.address.toIPv6Address();
+        ClientKey key;
+        key.high = qFromBigEndian<quint64>(address.c);
+        key.low = qFromBigEndian<quint64>(address.c + 8);
+        key.port = client.port;
+        key.stream = client.stream;
+        return key;
+    }
+
+    bool operator==(const ClientKey &other) const
+    {
+        return high == other.high && low == other.low && port == other.port && stream == other.stream;
+    }
+};
+
+inline quint64 hashOf(const ClientKey &key)
+{
+    return key.high * Q_UINT64_C(0x9e3779b97f4a7c15) ^ key.low ^ (quint64(key.port) << 48)
+            ^ (key.stream ? Q_UINT64_C(0xc2b2ae3d27d4eb4f) : 0);
+}
+
+// Заявка, ожидающая обработки в планировщике. Параметры разобраны при
+// приёме в типизированные поля, исходный params не хранится
+struct QueuedRequest {
+    ClientInfo client;
+    QString id;
+    qint64 enqueuedAt;            // Монотонное время постановки в очередь, мс
+    Configuration configuration;
+    quint8 priority;              // 1 — самый срочный, 7 — самый низкий
+    WireFormat format;            // Кодировка запроса, в ней же уходят ответы
+    quint64 sequence = 0;         // Номер записи в журнале заявок, 0 — не журналируется
+    qint64 deadline = 0;          // Монотонное время, после которого результат не нужен, мс; 0 — без срока
+    bool numericId = false;       // id пришёл числом: "42" и 42 — разные id, в ответах тип сохраняется
+};
+
+// Заявки одной конфигурации, которые поток обработки выполняет за один заход
+typedef QList<QueuedRequest> RequestBatch;
+
+#endif // REQUEST_H
@@ -0,0 +1,40 @@
+#include "request_grouper.h"
+
+RequestGrouper::RequestGrouper(int window, int maxShift, bool byClient)
+    : size(qMax(1, window))
+    , maxShift(qMax(0, maxShift))
+    , byClient(byClient)
+{
+}
+
+void RequestGrouper::group(const QList<QueuedRequest> &requests, QList<RequestBatch> &batches)
+{
+    batches.clear();
+    heads.resize(0);
+    for (int i = 0; i < requests.size(); ++i) {
+        const QueuedRequest &request = requests.at(i);
+        // Первые заявки пачек возрастают, поэтому поиск идёт от последней
+        // пачки и обрывается на первой, до которой дальше maxShift
+        int target = -1;
+        for (int b = int(heads.size()) - 1; b >= 0 && i - heads.at(b) <= maxShift; --b) {
+            if (sameGroup(requests.at(heads.at(b)), request)) {
+                target = b;
+                break;
+            }
+        }
+        if (target < 0) {
+            target = int(heads.size());
+            heads.append(i);
+            batches.append(RequestBatch());
+        }
+        batches[target].append(request);
+    }
+}
+
+bool RequestGrouper::sameGroup(const QueuedRequest &a, const QueuedRequest &b) const
+{
+    if (a.configuration != b.configuration) {
+        return false;
+    }
+    return !byClient || ClientKey::of(a.client) == ClientKey::of(b.client);
+}
@@ -0,0 +1,34 @@
+#ifndef REQUEST_GROUPER_H
+#define REQUEST_GROUPER_H
+
+#include <QList>
+#include "request.h"
+
+// Раскладывает окно заявок, выданных планировщиком подряд, по пачкам с
+// одной конфигурацией, чтобы подготовка к ней делалась раз на пачку.
+// Пачки идут в порядке своих первых заявок, внутри пачки порядок тоже
+// сохраняется. Заявка присоединяется к пачке, только если стоит не дальше
+// maxShift позиций от её первой заявки: так любая заявка обгоняет не больше
+// maxShift заявок, выданных раньше неё. При привязке потоков по клиенту
+// пачки не смешивают клиентов — пачка целиком уходит в один поток.
+class RequestGrouper
+{
+public:
+    RequestGrouper(int window, int maxShift, bool byClient);
+
+    // Заявок в одном окне; 1 — группировка выключена
+    int window() const { return size; }
+
+    // batches перезаписывается
+    void group(const QList<QueuedRequest> &requests, QList<RequestBatch> &batches);
+
+private:
+    bool sameGroup(const QueuedRequest &a, const QueuedRequest &b) const;
+
+    const int size;
+    const int maxShift;
+    const bool byClient;
+    QList<int> heads;  // Номер первой заявки каждой пачки в окне
+};
+
+#endif // REQUEST_GROUPER_H
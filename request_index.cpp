@@ -0,0 +1,65 @@
+#include "request_index.h"
+
+const char *RequestIndex::stateName(State state)
+{
+    switch (state) {
+    case Deferred:
+        return "deferred";
+    case Queued:
+        return "queued";
+    case Processing:
+        return "processing";
+    default:
+        return "unknown";
+    }
+}
+
+RequestIndex::Key RequestIndex::keyOf(const ClientKey &client, const QString &id, bool numeric)
+{
+    // FNV-1a по символам UTF-16: id сравнивается уже разобранным текстом,
+    // потому что в getStatus он приходит внутри params, а не токеном конверта
+    quint64 hash = Q_UINT64_C(0xcbf29ce484222325);
+    for (QChar c : id) {
+        hash = (hash ^ c.unicode()) * Q_UINT64_C(0x100000001b3);
+    }
+    Key key;
+    key.client = client;
+    key.id = id;
+    key.hash = numeric ? ~hash : hash;
+    key.numeric = numeric;
+    return key;
+}
+
+void RequestIndex::update(const QueuedRequest &request, State state, quint32 slot)
+{
+    if (!isIndexed(request)) {
+        return;
+    }
+    Entry &entry = entries.findOrInsert(keyOf(ClientKey::of(request.client), request.id, request.numericId), Entry());
+    entry.state = state;
+    entry.slot = slot;
+}
+
+void RequestIndex::remove(const QueuedRequest &request)
+{
+    if (isIndexed(request)) {
+        remove(ClientKey::of(request.client), request.id, request.numericId);
+    }
+}
+
+void RequestIndex::remove(const ClientKey &client, const QString &id, bool numeric)
+{
+    entries.remove(keyOf(client, id, numeric));
+}
+
+RequestIndex::State RequestIndex::find(const ClientKey &client, const QString &id, bool numeric, quint32 *slot) const
+{
+    const Entry *entry = entries.find(keyOf(client, id, numeric));
+    if (!entry) {
+        return Unknown;
+    }
+    if (slot) {
+        *slot = entry->slot;
+    }
+    return entry->state;
+}
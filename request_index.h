@@ -0,0 +1,64 @@
+#ifndef REQUEST_INDEX_H
+#define REQUEST_INDEX_H
+
+#include <QString>
+#include "flat_hash.h"
+#include "request.h"
+
+// Индекс принятых, но ещё не обработанных заявок по (клиент, id): где
+// заявка сейчас и номер её записи в планировщике или колесе таймеров.
+// Поиск, перенос и отмена — O(1). Заявки без id (уведомления и id null)
+// не индексируются: спросить о них всё равно нельзя. Ключ хранит текст id
+// целиком и его тип: ни совпадение отпечатков, ни id 42 и "42" не путают
+// заявки. На один ключ — не больше
+// одной заявки: повтор id, пока заявка не обработана, в очередь не ставится.
+// Не потокобезопасен: вызывается под блокировкой очереди.
+class RequestIndex
+{
+public:
+    enum State : quint8 {
+        Unknown,     // Не найдена: обработана, отменена или не принималась
+        Deferred,    // Ждёт срока в колесе таймеров
+        Queued,      // В планировщике
+        Processing   // Передана потоку обработки
+    };
+
+    static const char *stateName(State state);
+    static bool isIndexed(const QueuedRequest &request) { return !request.id.isNull(); }
+
+    // Запоминает или переносит заявку; slot — номер записи в её очереди
+    void update(const QueuedRequest &request, State state, quint32 slot = 0);
+    void remove(const QueuedRequest &request);
+    void remove(const ClientKey &client, const QString &id, bool numeric);
+
+    // numeric — id пришёл числом, см. QueuedRequest::numericId
+    State find(const ClientKey &client, const QString &id, bool numeric, quint32 *slot = nullptr) const;
+
+    void clear() { entries.clear(); }
+    int size() const { return entries.size(); }
+
+private:
+    struct Key {
+        ClientKey client;
+        QString id;
+        quint64 hash = 0;  // Отпечаток текста и типа id
+        bool numeric = false;
+
+        bool operator==(const Key &other) const
+        {
+            return hash == other.hash && client == other.client && numeric == other.numeric && id == other.id;
+        }
+        friend quint64 hashOf(const Key &key) { return hashOf(key.client) ^ key.hash; }
+    };
+
+    struct Entry {
+        State state = Unknown;
+        quint32 slot = 0;
+    };
+
+    static Key keyOf(const ClientKey &client, const QString &id, bool numeric);
+
+    FlatHashMap<Key, Entry> entries;
+};
+
+#endif // REQUEST_INDEX_H
@@ -0,0 +1,593 @@
+#include "request_log.h"
+#include "flat_hash.h"
+#include "logger.h"
+#include <QDir>
+#include <QElapsedTimer>
+#include <QFile>
+#include <QMutex>
+#include <QThread>
+#include <QWaitCondition>
+#include <QtEndian>
+#include <algorithm>
+#include <cstring>
+#ifdef Q_OS_UNIX
+#include <fcntl.h>
+#include <unistd.h>
+#endif
+
+namespace {
+
+// Запись: длина содержимого и его CRC-32 (по 4 байта), затем содержимое —
+// тип записи и поля, числа в little-endian
+enum RecordType : quint8 {
+    Accepted = 1,
+    Completed = 2,
+    AcceptedWithDeadline = 3  // Как Accepted, после срока — срок актуальности (qint64)
+};
+
+const int HeaderSize = 8;
+const quint32 MaxRecordSize = 4096;
+// Тип, номер, срок, порт, приоритет, конфигурация, кодировка, длина адреса
+const quint32 AcceptedFixedSize = 1 + 8 + 8 + 2 + 1 + 1 + 1 + 1;
+const quint32 CompletedSize = 1 + 8;
+// Бит в длине адреса: клиент потокового соединения (ClientInfo::stream)
+const quint8 StreamClient = 0x80;
+// Бит в длине адреса: id пришёл числом (QueuedRequest::numericId)
+const quint8 NumericId = 0x40;
+
+const char SegmentSuffix[] = ".wal";
+const char CheckpointSuffix[] = ".checkpoint";
+
+struct Crc32Table {
+    quint32 values[256];
+
+    constexpr Crc32Table() : values()
+    {
+        for (quint32 i = 0; i < 256; ++i) {
+            quint32 c = i;
+            for (int k = 0; k < 8; ++k)
+                c = (c & 1) ? 0xedb88320u ^ (c >> 1) : c >> 1;
+            values[i] = c;
+        }
+    }
+};
+
+constexpr Crc32Table Crc32;
+
+quint32 crc32(const uchar *data, qsizetype size)
+{
+    quint32 crc = 0xffffffffu;
+    for (qsizetype i = 0; i < size; ++i)
+        crc = Crc32.values[(crc ^ data[i]) & 0xff] ^ (crc >> 8);
+    return crc ^ 0xffffffffu;
+}
+
+template<typename T>
+void put(QByteArray &out, T value)
+{
+    char bytes[sizeof(T)];
+    qToLittleEndian<T>(value, bytes);
+    out.append(bytes, sizeof(T));
+}
+
+template<typename T>
+T get(const uchar *&p)
+{
+    const T value = qFromLittleEndian<T>(p);
+    p += sizeof(T);
+    return value;
+}
+
+// Заголовок дописывается после содержимого: длина известна только теперь
+void finishRecord(QByteArray &out, qsizetype start)
+{
+    uchar *header = reinterpret_cast<uchar *>(out.data() + start);
+    const quint32 size = quint32(out.size() - start - HeaderSize);
+    qToLittleEndian<quint32>(size, header);
+    qToLittleEndian<quint32>(crc32(header + HeaderSize, size), header + 4);
+}
+
+void appendAccepted(QByteArray &out, quint64 sequence, const QueuedRequest &request, qint64 dueAt, qint64 expiresAt)
+{
+    const qsizetype start = out.size();
+    out.append(HeaderSize, '\0');
+    put<quint8>(out, expiresAt != 0 ? AcceptedWithDeadline : Accepted);
+    put<quint64>(out, sequence);
+    put<qint64>(out, dueAt);
+    if (expiresAt != 0)
+        put<qint64>(out, expiresAt);
+    put<quint16>(out, request.client.port);
+    put<quint8>(out, request.priority);
+    put<quint8>(out, request.configuration);
+    put<quint8>(out, request.format);
+    const quint8 flags = (request.client.stream ? StreamClient : 0) | (request.numericId ? NumericId : 0);
+    if (request.client.address.protocol() == QAbstractSocket::IPv4Protocol) {
+        put<quint8>(out, 4 | flags);
+        put<quint32>(out, request.client.address.toIPv4Address());
+    } else {
+        const Q_IPV6ADDR address = request.client.address.toIPv6Address();
+        put<quint8>(out, 16 | flags);
+        out.append(reinterpret_cast<const char *>(address.c), 16);
+    }
+    // Остаток записи — id в UTF-8; слишком длинный обрезается
+    const QByteArray id = request.id.toUtf8();
+    out.append(id.constData(), qMin<qsizetype>(id.size(), MaxRecordSize - AcceptedFixedSize - 8 - 16));
+    finishRecord(out, start);
+}
+
+void appendCompleted(QByteArray &out, quint64 sequence)
+{
+    const qsizetype start = out.size();
+    out.append(HeaderSize, '\0');
+    put<quint8>(out, Completed);
+    put<quint64>(out, sequence);
+    finishRecord(out, start);
+}
+
+bool decodeAccepted(const uchar *record, RequestLog::Recovered &recovered)
+{
+    const quint32 size = qFromLittleEndian<quint32>(record);
+    const uchar *p = record + HeaderSize + 1;
+    const uchar *end = record + HeaderSize + size;
+
+    QueuedRequest &request = recovered.request;
+    request.sequence = get<quint64>(p);
+    recovered.dueAt = get<qint64>(p);
+    recovered.expiresAt = 0;
+    if (record[HeaderSize] == AcceptedWithDeadline)
+        recovered.expiresAt = get<qint64>(p);  // Длину записи уже проверил Replay
+    request.client.port = get<quint16>(p);
+    request.priority = get<quint8>(p);
+    request.configuration = Configuration(get<quint8>(p));
+    request.format = WireFormat(get<quint8>(p));
+    quint8 addressSize = get<quint8>(p);
+    request.client.stream = addressSize & StreamClient;
+    request.numericId = addressSize & NumericId;
+    addressSize &= ~(StreamClient | NumericId);
+    if (end - p < addressSize)
+        return false;
+    if (addressSize == 4) {
+        request.client.address = QHostAddress(qFromLittleEndian<quint32>(p));
+    } else if (addressSize == 16) {
+        Q_IPV6ADDR address;
+        memcpy(address.c, p, 16);
+        request.client.address = QHostAddress(address);
+    } else {
+        return false;
+    }
+    p += addressSize;
+    request.id = QString::fromUtf8(reinterpret_cast<const char *>(p), end - p);
+    request.enqueuedAt = 0;
+    return true;
+}
+
+QString fileName(quint64 index, const char *suffix)
+{
+    return QString("%1%2").arg(index, 16, 10, QLatin1Char('0')).arg(QLatin1String(suffix));
+}
+
+// Номера файлов с данным суффиксом по возрастанию
+QList<quint64> indices(const QDir &directory, const char *suffix)
+{
+    QList<quint64> result;
+    const QStringList names = directory.entryList(QStringList(QString("*") + QLatin1String(suffix)), QDir::Files);
+    for (const QString &name : names) {
+        bool ok;
+        const quint64 index = name.left(name.size() - int(strlen(suffix))).toULongLong(&ok);
+        if (ok)
+            result.append(index);
+    }
+    std::sort(result.begin(), result.end());
+    return result;
+}
+
+bool syncFile(QFile &file)
+{
+    if (!file.flush())
+        return false;
+#ifdef Q_OS_UNIX
+    return ::fdatasync(file.handle()) == 0;
+#else
+    return true;
+#endif
+}
+
+// Новые и переименованные файлы переживут сбой, только если
+// синхронизирован и сам каталог
+void syncDirectory(const QString &path)
+{
+#ifdef Q_OS_UNIX
+    const int fd = ::open(QFile::encodeName(path).constData(), O_RDONLY | O_DIRECTORY | O_CLOEXEC);
+    if (fd >= 0) {
+        ::fsync(fd);
+        ::close(fd);
+    }
+#else
+    Q_UNUSED(path);
+#endif
+}
+
+// Воспроизведение журнала: незавершённые заявки — указатели на их записи
+// в отображённых файлах
+class Replay
+{
+public:
+    Replay() : lastSequence(0) {}
+    ~Replay() { qDeleteAll(files); }
+
+    // Отображает файл и применяет его записи; повреждённый хвост отбрасывается
+    bool apply(const QString &path);
+    // Записи незавершённых заявок в порядке номеров
+    QList<const uchar *> pending() const;
+
+    FlatHashMap<quint64, const uchar *> live;
+    quint64 lastSequence;
+
+private:
+    QList<QFile *> files;  // Держат отображения до конца воспроизведения
+};
+
+bool Replay::apply(const QString &path)
+{
+    QFile *file = new QFile(path);
+    files.append(file);
+    if (!file->open(QIODevice::ReadOnly))
+        return false;
+    const qint64 size = file->size();
+    if (size == 0)
+        return true;
+    const uchar *data = file->map(0, size);
+    if (!data)
+        return false;
+
+    const uchar *p = data;
+    const uchar *end = data + size;
+    while (end - p >= HeaderSize) {
+        const quint32 length = qFromLittleEndian<quint32>(p);
+        const quint32 checksum = qFromLittleEndian<quint32>(p + 4);
+        const uchar *payload = p + HeaderSize;
+        if (length == 0 || length > MaxRecordSize || end - payload < qint64(length)
+                || crc32(payload, length) != checksum)
+            break;
+
+        if ((payload[0] == Accepted && length >= AcceptedFixedSize)
+                || (payload[0] == AcceptedWithDeadline && length >= AcceptedFixedSize + 8)) {
+            const uchar *q = payload + 1;
+            const quint64 sequence = get<quint64>(q);
+            live.findOrInsert(sequence, p);
+            lastSequence = qMax(lastSequence, sequence);
+        } else if (payload[0] == Completed && length >= CompletedSize) {
+            const uchar *q = payload + 1;
+            const quint64 sequence = get<quint64>(q);
+            live.remove(sequence);
+            lastSequence = qMax(lastSequence, sequence);
+        }
+        p = payload + length;
+    }
+    if (p != end) {
+        // Обрыв при сбое посреди записи: всё до него цело
+        LOG_WARNING("Request log %1 is damaged at offset %2, the rest of the file is ignored",
+                    path, qint64(p - data));
+    }
+    return true;
+}
+
+QList<const uchar *> Replay::pending() const
+{
+    QList<QPair<quint64, const uchar *>> entries;
+    entries.reserve(live.size());
+    live.forEach([&entries](quint64 sequence, const uchar *record) {
+        entries.append(qMakePair(sequence, record));
+    });
+    std::sort(entries.begin(), entries.end(),
+              [](const QPair<quint64, const uchar *> &a, const QPair<quint64, const uchar *> &b) {
+                  return a.first < b.first;
+              });
+    QList<const uchar *> records;
+    records.reserve(entries.size());
+    for (const auto &entry : std::as_const(entries))
+        records.append(entry.second);
+    return records;
+}
+
+} // namespace
+
+class RequestLog::Private
+{
+public:
+    Private(const QString &directory, int syncInterval, qint64 checkpointSize, DatagramSink *sink)
+        : directory(directory), syncInterval(qMax(1, syncInterval)), checkpointSize(checkpointSize),
+          sink(sink), nextSequence(1), stopping(false), thread(nullptr), segmentIndex(0), segmentEnd(0),
+          checkpointIndex(0), compactUpTo(0)
+    {
+    }
+
+    // Ответ, ждущий фиксации записей, добавленных до него
+    struct HeldReply {
+        qsizetype offset;  // Смещение в heldData
+        qsizetype size;
+        ClientInfo client;
+    };
+
+    QString path(quint64 index, const char *suffix) const { return directory + QLatin1Char('/') + fileName(index, suffix); }
+    bool openSegment(quint64 index);
+    bool commit(const QByteArray &batch);
+    void checkpoint(quint64 upTo);
+    void run();
+
+    const QString directory;
+    const int syncInterval;
+    const qint64 checkpointSize;
+    DatagramSink *const sink;
+
+    QMutex mutex;  // Защищает pending, held, nextSequence и stopping
+    QWaitCondition wake;
+    QByteArray pending;  // Записи, ещё не отданные в файл
+    QByteArray heldData;  // Тела отложенных ответов подряд
+    QList<HeldReply> held;
+    quint64 nextSequence;
+    bool stopping;
+    QThread *thread;
+
+    // Дальше — только фоновый поток (и open() до его запуска)
+    QFile segment;
+    quint64 segmentIndex;
+    qint64 segmentEnd;        // Конец последней целиком записанной группы
+    quint64 checkpointIndex;  // Контрольная точка покрывает сегменты с номерами не больше этого
+    quint64 compactUpTo;      // Сегменты, прочитанные при запуске, сжимаются первым делом
+};
+
+bool RequestLog::Private::openSegment(quint64 index)
+{
+    segment.close();
+    segment.setFileName(path(index, SegmentSuffix));
+    // Без буфера QFile: недописанная группа не досылается в файл позже
+    segmentIndex = index;
+    if (!segment.open(QIODevice::WriteOnly | QIODevice::Append | QIODevice::Unbuffered)) {
+        LOG_ERROR("Could not open request log %1: %2", segment.fileName(), segment.errorString());
+        return false;
+    }
+    segmentEnd = segment.size();
+    syncDirectory(directory);
+    return true;
+}
+
+bool RequestLog::Private::commit(const QByteArray &batch)
+{
+    // Сегмент, который не удалось открыть, заменяется следующим
+    if (!segment.isOpen() && !openSegment(segmentIndex + 1))
+        return false;
+    if (segment.write(batch) == batch.size() && syncFile(segment)) {
+        segmentEnd += batch.size();
+        return true;
+    }
+    LOG_ERROR("Could not write request log %1: %2", segment.fileName(), segment.errorString());
+    // Чтение сегмента останавливается на первой повреждённой записи, поэтому
+    // оборванная группа не должна оказаться перед следующими: файл обрезается
+    // до последней целой группы, а если и это не удалось — начинается новый
+    if (!segment.resize(segmentEnd) || !syncFile(segment)) {
+        LOG_WARNING("Could not truncate request log %1, starting a new segment", segment.fileName());
+        openSegment(segmentIndex + 1);
+    }
+    return false;
+}
+
+void RequestLog::Private::checkpoint(quint64 upTo)
+{
+    QElapsedTimer timer;
+    timer.start();
+
+    // Вход — прошлая контрольная точка и все сегменты до upTo включительно
+    Replay replay;
+    QStringList inputs;
+    if (checkpointIndex != 0)
+        inputs.append(path(checkpointIndex, CheckpointSuffix));
+    const QDir dir(directory);
+    for (quint64 index : indices(dir, SegmentSuffix)) {
+        if (index <= upTo)
+            inputs.append(path(index, SegmentSuffix));
+    }
+    for (const QString &input : std::as_const(inputs)) {
+        if (!replay.apply(input)) {
+            LOG_ERROR("Could not read request log %1, checkpoint skipped", input);
+            return;
+        }
+    }
+
+    // Контрольная точка пишется во временный файл и подменяет старую
+    // переименованием, так что при сбое остаётся одна из двух целиком
+    const QString target = path(upTo, CheckpointSuffix);
+    QFile file(target + ".tmp");
+    const QList<const uchar *> records = replay.pending();
+    bool ok = file.open(QIODevice::WriteOnly | QIODevice::Truncate);
+    for (const uchar *record : records) {
+        if (!ok)
+            break;
+        const qint64 size = HeaderSize + qFromLittleEndian<quint32>(record);
+        ok = file.write(reinterpret_cast<const char *>(record), size) == size;
+    }
+    ok = ok && syncFile(file);
+    file.close();
+    if (!ok || (QFile::exists(target) && !QFile::remove(target)) || !file.rename(target)) {
+        LOG_ERROR("Could not write request log checkpoint %1", target);
+        QFile::remove(file.fileName());
+        return;
+    }
+    syncDirectory(directory);
+
+    for (const QString &input : std::as_const(inputs)) {
+        if (input != target)
+            QFile::remove(input);
+    }
+    checkpointIndex = upTo;
+    LOG_INFO("Request log checkpoint: %1 pending request(s) kept from %2 file(s) in %3 ms",
+             records.size(), inputs.size(), timer.elapsed());
+}
+
+void RequestLog::Private::run()
+{
+    if (compactUpTo > checkpointIndex)
+        checkpoint(compactUpTo);
+
+    QByteArray batch;
+    QByteArray replyData;
+    QList<HeldReply> replies;
+    QMutexLocker locker(&mutex);
+    forever {
+        if (!stopping)
+            wake.wait(&mutex, syncInterval);
+        batch.swap(pending);
+        replyData.swap(heldData);
+        replies.swap(held);
+        const bool last = stopping;
+        locker.unlock();
+
+        // Всё накопленное за интервал — одной записью и одной синхронизацией.
+        // Записи отложенных ответов — в этой группе или в уже записанных
+        const bool committed = batch.isEmpty() || commit(batch);
+        batch.clear();
+        if (committed && sink) {
+            for (const HeldReply &reply : std::as_const(replies))
+                sink->sendDatagram(QByteArrayView(replyData.constData() + reply.offset, reply.size), reply.client);
+        } else if (!replies.isEmpty()) {
+            LOG_WARNING("Dropped %1 acknowledgement(s) of requests that could not be logged", replies.size());
+        }
+        replyData.clear();
+        replies.clear();
+        if (!last && segment.isOpen() && segment.size() >= checkpointSize) {
+            const quint64 sealed = segmentIndex;
+            if (openSegment(sealed + 1))
+                checkpoint(sealed);
+        }
+        if (last)
+            break;
+        locker.relock();
+    }
+    segment.close();
+}
+
+RequestLog::RequestLog(const QString &directory, int syncInterval, qint64 checkpointSize, DatagramSink *sink)
+    : d(new Private(directory, syncInterval, checkpointSize, sink))
+{
+}
+
+RequestLog::~RequestLog()
+{
+    close();
+    delete d;
+}
+
+bool RequestLog::open(QList<Recovered> &recovered)
+{
+    QElapsedTimer timer;
+    timer.start();
+
+    QDir dir(d->directory);
+    if (!dir.mkpath(".")) {
+        LOG_ERROR("Could not create request log directory %1", d->directory);
+        return false;
+    }
+
+    // Недописанные контрольные точки от прошлого запуска
+    const QStringList leftovers = dir.entryList(QStringList("*.tmp"), QDir::Files);
+    for (const QString &name : leftovers)
+        dir.remove(name);
+
+    const QList<quint64> checkpoints = indices(dir, CheckpointSuffix);
+    const QList<quint64> segments = indices(dir, SegmentSuffix);
+    d->checkpointIndex = checkpoints.isEmpty() ? 0 : checkpoints.last();
+    for (quint64 index : checkpoints) {
+        if (index != d->checkpointIndex)
+            QFile::remove(d->path(index, CheckpointSuffix));
+    }
+
+    Replay replay;
+    if (d->checkpointIndex != 0 && !replay.apply(d->path(d->checkpointIndex, CheckpointSuffix))) {
+        LOG_ERROR("Could not read request log checkpoint in %1", d->directory);
+        return false;
+    }
+    quint64 lastIndex = d->checkpointIndex;
+    for (quint64 index : segments) {
+        if (index <= d->checkpointIndex) {
+            // Уже вошёл в контрольную точку, но не успел удалиться
+            QFile::remove(d->path(index, SegmentSuffix));
+            continue;
+        }
+        if (!replay.apply(d->path(index, SegmentSuffix))) {
+            LOG_ERROR("Could not read request log %1", d->path(index, SegmentSuffix));
+            return false;
+        }
+        lastIndex = index;
+    }
+
+    const QList<const uchar *> records = replay.pending();
+    recovered.clear();
+    recovered.reserve(records.size());
+    for (const uchar *record : records) {
+        Recovered entry;
+        if (decodeAccepted(record, entry))
+            recovered.append(entry);
+    }
+    d->nextSequence = replay.lastSequence + 1;
+    d->compactUpTo = lastIndex;
+
+    if (!d->openSegment(lastIndex + 1))
+        return false;
+    LOG_INFO("Recovered %1 pending request(s) from the request log in %2 ms",
+             recovered.size(), timer.elapsed());
+
+    d->stopping = false;
+    d->thread = QThread::create([this] { d->run(); });
+    d->thread->setObjectName("request log");
+    d->thread->start();
+    return true;
+}
+
+void RequestLog::close()
+{
+    QThread *thread;
+    {
+        QMutexLocker locker(&d->mutex);
+        if (!d->thread)
+            return;
+        d->stopping = true;
+        d->wake.wakeOne();
+        thread = d->thread;
+        d->thread = nullptr;
+    }
+    thread->wait();  // Фоновый поток фиксирует остаток перед выходом
+    delete thread;
+}
+
+quint64 RequestLog::append(const QueuedRequest &request, qint64 dueAt, qint64 expiresAt)
+{
+    QMutexLocker locker(&d->mutex);
+    const quint64 sequence = d->nextSequence++;
+    appendAccepted(d->pending, sequence, request, dueAt, expiresAt);
+    return sequence;
+}
+
+void RequestLog::complete(quint64 sequence)
+{
+    QMutexLocker locker(&d->mutex);
+    appendCompleted(d->pending, sequence);
+}
+
+void RequestLog::complete(const RequestBatch &batch)
+{
+    QMutexLocker locker(&d->mutex);
+    for (const QueuedRequest &request : batch) {
+        if (request.sequence != 0) {
+            appendCompleted(d->pending, request.sequence);
+        }
+    }
+}
+
+void RequestLog::sendAfterSync(QByteArrayView datagram, const ClientInfo &client)
+{
+    QMutexLocker locker(&d->mutex);
+    if (!d->thread)
+        return;  // Журнал закрыт: записи до этого вызова на диск уже не попадут
+    d->held.append(Private::HeldReply{d->heldData.size(), datagram.size(), client});
+    d->heldData.append(datagram.data(), datagram.size());
+}
@@ -0,0 +1,54 @@
+#ifndef REQUEST_LOG_H
+#define REQUEST_LOG_H
+
+#include <QList>
+#include <QString>
+#include "datagram.h"
+#include "request.h"
+
+// Журнал упреждающей записи принятых заявок. Каждая принятая заявка и
+// каждое её завершение дописываются в конец текущего сегмента; фоновый
+// поток раз в syncInterval мс отдаёт накопленное одним write и одним
+// fdatasync (групповая фиксация). Когда сегмент перерастает checkpointSize,
+// начинается новый, а старые вместе с прошлой контрольной точкой сжимаются
+// в новую контрольную точку — только незавершённые заявки. При запуске
+// контрольная точка и сегменты после неё читаются через mmap.
+// Подтверждение заявки отдаётся в sendAfterSync() и уходит клиенту только
+// после fdatasync её группы, так что подтверждённая заявка переживает сбой.
+class RequestLog
+{
+public:
+    // Незавершённая заявка из журнала
+    struct Recovered {
+        QueuedRequest request;
+        qint64 dueAt;      // Мс Unix-времени, 0 — без отсрочки
+        qint64 expiresAt;  // Срок актуальности в мс Unix-времени, 0 — без срока
+    };
+
+    // sink отправляет ответы, отложенные sendAfterSync()
+    RequestLog(const QString &directory, int syncInterval, qint64 checkpointSize, DatagramSink *sink = nullptr);
+    ~RequestLog();
+
+    // Восстанавливает незавершённые заявки в порядке приёма и запускает
+    // фоновую запись; false — каталог журнала недоступен
+    bool open(QList<Recovered> &recovered);
+    // Фиксирует накопленное и останавливает фоновый поток
+    void close();
+
+    // dueAt и expiresAt — как в Recovered; возвращает номер для QueuedRequest::sequence
+    quint64 append(const QueuedRequest &request, qint64 dueAt, qint64 expiresAt = 0);
+    void complete(quint64 sequence);
+    // Журналируемые заявки пачки — под одной блокировкой
+    void complete(const RequestBatch &batch);
+
+    // Отправляет датаграмму, когда на диске все записи, добавленные до вызова.
+    // Если записать группу не удалось или журнал уже закрыт, датаграмма
+    // отбрасывается: клиент повторит запрос
+    void sendAfterSync(QByteArrayView datagram, const ClientInfo &client);
+
+private:
+    class Private;
+    Private *d;
+};
+
+#endif // REQUEST_LOG_H
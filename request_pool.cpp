@@ -0,0 +1,139 @@
+#include "request_pool.h"
+#include <cstring>
+
+static_assert(sizeof(PooledRequest) == 64, "PooledRequest should fill one cache line");
+
+RequestPool::RequestPool()
+    : freeList(None)
+    , allocated(0)
+    , count(0)
+{
+}
+
+quint32 RequestPool::acquire(const QueuedRequest &request)
+{
+    quint32 index;
+    if (freeList != None) {
+        index = freeList;
+        freeList = at(index).next;
+    } else {
+        index = allocated++;
+        if ((index >> SlabBits) == quint32(slabs.size()))
+            slabs.append(QList<PooledRequest>(SlabSize));
+    }
+    ++count;
+
+    PooledRequest &record = at(index);
+    const ClientKey client = ClientKey::of(request.client);
+    record.high = client.high;
+    record.low = client.low;
+    record.port = client.port;
+    record.enqueuedAt = request.enqueuedAt;
+    record.deadline = request.deadline;
+    record.sequence = request.sequence;
+    record.next = None;
+    record.configuration = quint8(request.configuration);
+    record.priority = request.priority;
+    record.format = quint8(request.format);
+    record.flags = request.client.address.protocol() == QAbstractSocket::IPv4Protocol ? PooledRequest::Ipv4 : 0;
+    if (request.client.stream)
+        record.flags |= PooledRequest::Stream;
+    if (request.numericId)
+        record.flags |= PooledRequest::NumericId;
+    record.idSize = 0;
+
+    if (request.id.isNull()) {
+        record.flags |= PooledRequest::NullId;
+        return index;
+    }
+    // Обычно id короткий; в UTF-8 он не короче, чем в символах UTF-16
+    if (request.id.size() <= PooledRequest::InlineId) {
+        const QByteArray id = request.id.toUtf8();
+        if (id.size() <= PooledRequest::InlineId) {
+            std::memcpy(record.id, id.constData(), size_t(id.size()));
+            record.idSize = quint8(id.size());
+            return index;
+        }
+    }
+    quint32 slot;
+    if (freeLongIds.isEmpty()) {
+        slot = quint32(longIds.size());
+        longIds.append(request.id);
+    } else {
+        slot = freeLongIds.takeLast();
+        longIds[slot] = request.id;
+    }
+    record.flags |= PooledRequest::LongId;
+    std::memcpy(record.id, &slot, sizeof(slot));
+    return index;
+}
+
+QueuedRequest RequestPool::take(quint32 index)
+{
+    const PooledRequest &record = at(index);
+
+    QueuedRequest request;
+    if (record.flags & PooledRequest::Ipv4) {
+        request.client.address = QHostAddress(quint32(record.low));
+    } else {
+        Q_IPV6ADDR address;
+        qToBigEndian(record.high, address.c);
+        qToBigEndian(record.low, address.c + 8);
+        request.client.address = QHostAddress(address);
+    }
+    request.client.port = record.port;
+    request.client.stream = record.flags & PooledRequest::Stream;
+    request.numericId = record.flags & PooledRequest::NumericId;
+    if (record.flags & PooledRequest::LongId) {
+        quint32 slot;
+        std::memcpy(&slot, record.id, sizeof(slot));
+        request.id = std::move(longIds[slot]);
+        longIds[slot] = QString();
+        freeLongIds.append(slot);
+    } else if (!(record.flags & PooledRequest::NullId)) {
+        request.id = QString::fromUtf8(record.id, record.idSize);
+    }
+    request.enqueuedAt = record.enqueuedAt;
+    request.configuration = Configuration(record.configuration);
+    request.priority = record.priority;
+    request.format = WireFormat(record.format);
+    request.sequence = record.sequence;
+    request.deadline = record.deadline;
+
+    // Длинный id уже возвращён в список, остальное освобождается как обычно
+    at(index).flags &= quint8(~PooledRequest::LongId);
+    release(index);
+    return request;
+}
+
+void RequestPool::release(quint32 index)
+{
+    PooledRequest &record = at(index);
+    if (record.flags & PooledRequest::LongId) {
+        quint32 slot;
+        std::memcpy(&slot, record.id, sizeof(slot));
+        longIds[slot] = QString();
+        freeLongIds.append(slot);
+    }
+    record.next = freeList;
+    freeList = index;
+    --count;
+}
+
+void RequestPool::clear()
+{
+    slabs.clear();
+    freeList = None;
+    allocated = 0;
+    count = 0;
+    longIds.clear();
+    freeLongIds.clear();
+}
+
+qint64 RequestPool::memoryUsage() const
+{
+    qint64 bytes = qint64(slabs.size()) * SlabSize * qint64(sizeof(PooledRequest));
+    for (const QString &id : longIds)
+        bytes += id.capacity() * qint64(sizeof(QChar));
+    return bytes;
+}
@@ -0,0 +1,88 @@
+#ifndef REQUEST_POOL_H
+#define REQUEST_POOL_H
+
+#include <QList>
+#include <QString>
+#include "request.h"
+
+// Заявка в компактном виде для хранения в очереди: 64 байта, без указателей
+// на кучу. Адрес хранится как в ClientKey, короткий id (UTF-8) — прямо в
+// записи, длинный — в отдельном списке пула. next связывает записи в
+// очереди клиента или в списке свободных; в куче сроков это место записи
+// в куче.
+struct PooledRequest {
+    enum { InlineId = 13 };
+    enum Flag : quint8 {
+        Ipv4 = 0x01,    // Адрес был IPv4, а не отображённый IPv6
+        NullId = 0x02,  // id — QString(), а не пустая строка
+        LongId = 0x04,  // id не поместился, в id лежит номер в RequestPool
+        Cancelled = 0x08,  // Отменена: очередь пропустит запись при извлечении
+        Stream = 0x10,  // Клиент потокового соединения, см. ClientInfo::stream
+        NumericId = 0x20  // id пришёл числом, см. QueuedRequest::numericId
+    };
+
+    quint64 high;
+    quint64 low;
+    qint64 enqueuedAt;
+    qint64 deadline;
+    quint64 sequence;
+    quint32 next;
+    quint16 port;
+    quint8 configuration;
+    quint8 priority;
+    quint8 format;
+    quint8 flags;
+    quint8 idSize;
+    char id[InlineId];
+
+    ClientKey client() const
+    {
+        ClientKey key;
+        key.high = high;
+        key.low = low;
+        key.port = port;
+        key.stream = flags & Stream;
+        return key;
+    }
+};
+
+// Пул записей заявок: записи выделяются плитами по SlabSize штук и
+// адресуются 32-битным номером, освобождённые переиспользуются через
+// список свободных. Плиты не возвращаются до clear(), поэтому в
+// установившемся режиме очередь не обращается к распределителю памяти.
+class RequestPool
+{
+public:
+    enum : quint32 { None = 0xffffffffu };
+
+    RequestPool();
+
+    // Номер новой записи с копией request
+    quint32 acquire(const QueuedRequest &request);
+    // Восстанавливает заявку и освобождает запись
+    QueuedRequest take(quint32 index);
+    void release(quint32 index);
+    void clear();
+
+    PooledRequest &at(quint32 index) { return slabs[index >> SlabBits][index & SlabMask]; }
+    const PooledRequest &at(quint32 index) const { return slabs.at(index >> SlabBits).at(index & SlabMask); }
+
+    int size() const { return count; }
+    qint64 memoryUsage() const;  // Байт под плиты и длинные id
+
+private:
+    enum {
+        SlabBits = 10,
+        SlabSize = 1 << SlabBits,
+        SlabMask = SlabSize - 1
+    };
+
+    QList<QList<PooledRequest>> slabs;
+    quint32 freeList;   // Голова списка свободных записей
+    quint32 allocated;  // Записи [0, allocated) уже использовались
+    int count;
+    QList<QString> longIds;
+    QList<quint32> freeLongIds;
+};
+
+#endif // REQUEST_POOL_H
@@ -0,0 +1,287 @@
+#include "request_scheduler.h"
+#include <QtAlgorithms>
+#include <limits>
+
+RequestScheduler::RequestScheduler(qint64 agingInterval, int quantum, Policy policy)
+    : occupancy(0)
+    , count(0)
+    , aging(qMax<qint64>(0, agingInterval))
+    , turn(qMax(1, quantum))
+    , mode(policy)
+    , nextOrder(0)
+{
+}
+
+bool RequestScheduler::policyFromName(const QString &name, Policy &policy)
+{
+    static const char *const names[] = {"priority", "deadline"};
+    for (int i = PriorityPolicy; i <= DeadlinePolicy; ++i) {
+        if (name.compare(QLatin1String(names[i]), Qt::CaseInsensitive) == 0) {
+            policy = Policy(i);
+            return true;
+        }
+    }
+    return false;
+}
+
+void RequestScheduler::setAgingInterval(qint64 msecs)
+{
+    aging = qMax<qint64>(0, msecs);
+}
+
+void RequestScheduler::setQuantum(int requests)
+{
+    turn = qMax(1, requests);
+}
+
+quint32 RequestScheduler::enqueue(const QueuedRequest &request, qint64 now)
+{
+    const int b = qBound<int>(HighestPriority, request.priority, LowestPriority) - HighestPriority;
+    Bucket &bucket = buckets[b];
+
+    const quint32 index = pool.acquire(request);
+    PooledRequest &record = pool.at(index);
+    record.enqueuedAt = now;
+
+    if (mode == DeadlinePolicy) {
+        // Корзина только считает заявки своего уровня для статистики
+        HeapEntry entry;
+        if (record.deadline != 0)
+            entry.key = record.deadline;
+        else if (aging > 0)
+            entry.key = now + (b + 1) * aging;
+        else
+            entry.key = std::numeric_limits<qint64>::max();
+        entry.order = nextOrder++;
+        entry.slot = index;
+        heap.append(entry);
+        siftUp(int(heap.size()) - 1);
+        ++bucket.count;
+        ++count;
+        return index;
+    }
+
+    const ClientKey client = record.client();
+    bool inserted;
+    int &slot = bucket.index.findOrInsert(client, -1, &inserted);
+    if (inserted) {
+        // Новый клиент встаёт в конец круга
+        if (bucket.freeFlows.isEmpty()) {
+            slot = int(bucket.flows.size());
+            bucket.flows.append(Flow());
+        } else {
+            slot = bucket.freeFlows.takeLast();
+        }
+        bucket.flows[slot].client = client;
+        bucket.active.enqueue(slot);
+    }
+
+    Flow &flow = bucket.flows[slot];
+    if (flow.last == RequestPool::None)
+        flow.first = index;
+    else
+        pool.at(flow.last).next = index;
+    flow.last = index;
+    ++bucket.count;
+    occupancy |= quint8(1u << b);
+    ++count;
+    return index;
+}
+
+QueuedRequest RequestScheduler::dequeue(qint64 now)
+{
+    Q_ASSERT(!isEmpty());
+    if (mode == DeadlinePolicy)
+        return pool.take(removeAt(0));
+
+    // Отменённые записи снимаются по пути и не расходуют ход клиента;
+    // живая заявка есть, раз очередь не пуста, поэтому цикл конечен
+    forever {
+        const int b = pickBucket(now);
+        Bucket &bucket = buckets[b];
+        const int slot = bucket.active.head();
+        Flow &flow = bucket.flows[slot];
+
+        // Единичная стоимость заявки: в начале хода счётчик пополняется на quantum
+        if (flow.deficit == 0)
+            flow.deficit = turn;
+        const quint32 index = flow.first;
+        flow.first = pool.at(index).next;
+        const bool cancelled = pool.at(index).flags & PooledRequest::Cancelled;
+        if (!cancelled)
+            --flow.deficit;
+
+        if (flow.first == RequestPool::None) {
+            // Опустевшая очередь выходит из круга и теряет остаток хода
+            bucket.active.dequeue();
+            bucket.index.remove(flow.client);
+            flow.last = RequestPool::None;
+            flow.deficit = 0;
+            bucket.freeFlows.append(slot);
+        } else if (flow.deficit == 0) {
+            bucket.active.enqueue(bucket.active.dequeue());
+        }
+
+        if (--bucket.count == 0)
+            occupancy &= quint8(~(1u << b));
+        if (cancelled) {
+            --bucket.cancelled;
+            pool.release(index);
+            continue;
+        }
+        --count;
+        return pool.take(index);
+    }
+}
+
+int RequestScheduler::nextPriority(qint64 now) const
+{
+    Q_ASSERT(!isEmpty());
+    if (mode == DeadlinePolicy)
+        return HighestPriority;
+    return pickBucket(now) + HighestPriority;
+}
+
+void RequestScheduler::takeExpired(qint64 now, QList<QueuedRequest> &expired)
+{
+    // Заявка без срока на вершине заслоняет остальные до своей выдачи
+    while (mode == DeadlinePolicy && !heap.isEmpty()) {
+        const PooledRequest &record = pool.at(heap.first().slot);
+        if (record.deadline == 0 || record.deadline > now)
+            break;
+        expired.append(pool.take(removeAt(0)));
+    }
+}
+
+qint64 RequestScheduler::nextExpiry() const
+{
+    if (mode != DeadlinePolicy || heap.isEmpty())
+        return -1;
+    const qint64 deadline = pool.at(heap.first().slot).deadline;
+    return deadline != 0 ? deadline : -1;
+}
+
+void RequestScheduler::cancel(quint32 slot)
+{
+    if (mode == DeadlinePolicy) {
+        pool.release(removeAt(int(pool.at(slot).next)));
+        return;
+    }
+    PooledRequest &record = pool.at(slot);
+    if (record.flags & PooledRequest::Cancelled)
+        return;
+    record.flags |= PooledRequest::Cancelled;
+    ++buckets[qBound<int>(HighestPriority, record.priority, LowestPriority) - HighestPriority].cancelled;
+    // Остались одни отменённые — очередь сбрасывается целиком, не дожидаясь извлечения
+    if (--count == 0)
+        clear();
+}
+
+void RequestScheduler::clear()
+{
+    for (Bucket &bucket : buckets)
+        bucket = Bucket();
+    pool.clear();
+    heap.clear();
+    occupancy = 0;
+    count = 0;
+}
+
+int RequestScheduler::size(int priority) const
+{
+    if (priority < HighestPriority || priority > LowestPriority)
+        return 0;
+    const Bucket &bucket = buckets[priority - HighestPriority];
+    return bucket.count - bucket.cancelled;
+}
+
+int RequestScheduler::clients(int priority) const
+{
+    if (priority < HighestPriority || priority > LowestPriority)
+        return 0;
+    return int(buckets[priority - HighestPriority].active.size());
+}
+
+int RequestScheduler::pickBucket(qint64 now) const
+{
+    // Самая срочная непустая корзина — младший установленный бит
+    const int top = qCountTrailingZeroBits(occupancy);
+    if (aging == 0)
+        return top;
+
+    // Сравниваются очередные заявки корзин (не более семи) по эффективному
+    // приоритету. Очередная — голова очереди текущего клиента, а не самая
+    // старая заявка корзины: до остальных клиентов очередь дойдёт за круг
+    int best = top;
+    qint64 bestLevel = top - (now - headEnqueuedAt(top)) / aging;
+    for (quint8 rest = quint8(occupancy & (occupancy - 1)); rest; rest &= quint8(rest - 1)) {
+        const int bucket = qCountTrailingZeroBits(rest);
+        const qint64 waited = now - headEnqueuedAt(bucket);
+        const qint64 level = bucket - waited / aging;
+        if (level < bestLevel) {
+            best = bucket;
+            bestLevel = level;
+        }
+    }
+    return best;
+}
+
+qint64 RequestScheduler::headEnqueuedAt(int bucket) const
+{
+    const Bucket &b = buckets[bucket];
+    return pool.at(b.flows.at(b.active.head()).first).enqueuedAt;
+}
+
+void RequestScheduler::place(int position, const HeapEntry &entry)
+{
+    heap[position] = entry;
+    pool.at(entry.slot).next = quint32(position);
+}
+
+void RequestScheduler::siftUp(int position)
+{
+    const HeapEntry entry = heap.at(position);
+    while (position > 0) {
+        const int parent = (position - 1) / 2;
+        if (!(entry < heap.at(parent)))
+            break;
+        place(position, heap.at(parent));
+        position = parent;
+    }
+    place(position, entry);
+}
+
+void RequestScheduler::siftDown(int position)
+{
+    const HeapEntry entry = heap.at(position);
+    const int size = int(heap.size());
+    forever {
+        int child = 2 * position + 1;
+        if (child >= size)
+            break;
+        if (child + 1 < size && heap.at(child + 1) < heap.at(child))
+            ++child;
+        if (!(heap.at(child) < entry))
+            break;
+        place(position, heap.at(child));
+        position = child;
+    }
+    place(position, entry);
+}
+
+quint32 RequestScheduler::removeAt(int position)
+{
+    const quint32 slot = heap.at(position).slot;
+    const HeapEntry last = heap.takeLast();
+    if (position < heap.size()) {
+        // Последний элемент встаёт на освободившееся место и может уйти
+        // как вверх, так и вниз
+        place(position, last);
+        siftUp(position);
+        siftDown(int(pool.at(last.slot).next));
+    }
+    const PooledRequest &record = pool.at(slot);
+    --buckets[qBound<int>(HighestPriority, record.priority, LowestPriority) - HighestPriority].count;
+    --count;
+    return slot;
+}
@@ -0,0 +1,123 @@
+#ifndef REQUEST_SCHEDULER_H
+#define REQUEST_SCHEDULER_H
+
+#include <QList>
+#include <QQueue>
+#include <QString>
+#include "flat_hash.h"
+#include "request.h"
+#include "request_pool.h"
+
+// Планировщик заявок: по одной корзине на каждый приоритет 1..7
+// и битовая карта занятых корзин, так что выбор корзины — O(1).
+// Старение: каждые agingInterval мс ожидания поднимают заявку на один уровень.
+// Внутри корзины у каждого клиента своя очередь, и клиенты обслуживаются
+// по кругу (deficit round robin): за один ход — не больше quantum заявок,
+// поэтому клиент с длинной очередью не задерживает остальных.
+// Сами заявки лежат в RequestPool, очереди клиентов — списки его записей.
+// Отмена — O(1): запись помечается и пропускается при извлечении.
+//
+// В режиме DeadlinePolicy корзин нет: заявки выдаются по возрастанию срока
+// (earliest deadline first) из двоичной кучи номеров записей пула, место
+// записи в куче хранится в самой записи, поэтому отмена — настоящее
+// удаление за O(log n). Заявке без срока назначается условный срок
+// enqueuedAt + priority × agingInterval, так что и она со временем
+// обгоняет новые заявки со сроком; без старения она ждёт, пока заявок со
+// сроком не останется. Справедливости между клиентами в этом режиме нет.
+class RequestScheduler
+{
+public:
+    enum {
+        HighestPriority = 1,
+        LowestPriority = 7,
+        PriorityLevels = LowestPriority - HighestPriority + 1
+    };
+
+    enum Policy {
+        PriorityPolicy,
+        DeadlinePolicy
+    };
+
+    explicit RequestScheduler(qint64 agingInterval = 0, int quantum = 1, Policy policy = PriorityPolicy);
+
+    Policy policy() const { return mode; }
+    static bool policyFromName(const QString &name, Policy &policy);
+
+    // 0 — старение выключено. Условные сроки уже стоящих в куче заявок не меняются
+    void setAgingInterval(qint64 msecs);
+    qint64 agingInterval() const { return aging; }
+    void setQuantum(int requests);
+    int quantum() const { return turn; }
+
+    // Возвращает номер записи для at() и cancel(); он действителен до извлечения
+    quint32 enqueue(const QueuedRequest &request, qint64 now);
+    QueuedRequest dequeue(qint64 now);
+    // Уровень корзины, из которой возьмёт dequeue(now), с учётом старения;
+    // очередь не должна быть пуста. У кучи сроков уровень один — HighestPriority
+    int nextPriority(qint64 now) const;
+    // Куча сроков: снимает с её вершины заявки со сроком не позже now.
+    // По приоритетам просроченные не ищутся — они отсеиваются при выдаче
+    void takeExpired(qint64 now, QList<QueuedRequest> &expired);
+    // Ближайший срок на вершине кучи, -1 — его нет
+    qint64 nextExpiry() const;
+    void cancel(quint32 slot);
+    void clear();
+
+    const PooledRequest &at(quint32 slot) const { return pool.at(slot); }
+
+    bool isEmpty() const { return count == 0; }
+    int size() const { return count; }
+    int size(int priority) const;
+    int clients(int priority) const;  // Клиентов с заявками в корзине; у кучи сроков 0
+    qint64 memoryUsage() const { return pool.memoryUsage(); }
+
+private:
+    // Очередь одного клиента в корзине: первая и последняя записи пула
+    struct Flow {
+        ClientKey client;
+        quint32 first = RequestPool::None;
+        quint32 last = RequestPool::None;
+        int deficit = 0;  // Сколько заявок ещё можно выдать в текущем ходе
+    };
+
+    // Элемент кучи сроков; order — номер постановки, он упорядочивает равные сроки
+    struct HeapEntry {
+        qint64 key;
+        quint64 order;
+        quint32 slot;
+
+        bool operator<(const HeapEntry &other) const
+        {
+            return key < other.key || (key == other.key && order < other.order);
+        }
+    };
+
+    struct Bucket {
+        QList<Flow> flows;                   // Свободные места переиспользуются
+        QList<int> freeFlows;
+        QQueue<int> active;                  // Непустые очереди в порядке обхода
+        FlatHashMap<ClientKey, int> index;   // Клиент -> номер в flows
+        int count = 0;                       // Записей, включая отменённые
+        int cancelled = 0;
+    };
+
+    int pickBucket(qint64 now) const;
+    // Время постановки очередной заявки корзины
+    qint64 headEnqueuedAt(int bucket) const;
+    void place(int position, const HeapEntry &entry);
+    void siftUp(int position);
+    void siftDown(int position);
+    quint32 removeAt(int position);
+
+    RequestPool pool;
+    Bucket buckets[PriorityLevels];
+    quint8 occupancy;  // Бит i установлен, если корзина i не пуста
+    int count;         // Заявок без отменённых
+    qint64 aging;
+    int turn;
+    Policy mode;
+    QList<HeapEntry> heap;  // Только для DeadlinePolicy
+    quint64 nextOrder;
+};
+
+#endif // REQUEST_SCHEDULER_H
@@ -0,0 +1,370 @@
+#include "response_encoder.h"
+#include "cbor_parser.h"
+
+namespace {
+
+const char Prefix[] = "{\"jsonrpc\":\"2.0\",\"id\":";
+const char AcknowledgementHead[] = ",\"result\":\"Request will be processed with ID: ";
+const char AcknowledgementTail[] = "\"}";
+const char UnknownMethodTail[] = ",\"error\":{\"code\":-32601,\"message\":\"Unknown method\"}}";
+const char ErrorHead[] = ",\"error\":{\"code\":";
+const char MessageHead[] = ",\"message\":";
+const char ResultHead[] = ",\"result\":";
+const char NotificationHead[] = "{\"jsonrpc\":\"2.0\",\"method\":";
+const char ParamsHead[] = ",\"params\":";
+
+const char AcknowledgementText[] = "Request will be processed with ID: ";
+
+const int InitialCapacity = 512;
+const int MaxDigits = 24;
+
+// Десятичная запись value в конце digits; возвращает индекс первого символа
+int formatInteger(char (&digits)[MaxDigits], qint64 value)
+{
+    int pos = MaxDigits;
+    quint64 magnitude = value < 0 ? 0 - quint64(value) : quint64(value);
+    do {
+        digits[--pos] = char('0' + magnitude % 10);
+        magnitude /= 10;
+    } while (magnitude);
+    if (value < 0) {
+        digits[--pos] = '-';
+    }
+    return pos;
+}
+
+inline void appendLiteral(QByteArray &out, QByteArrayView literal)
+{
+    out.append(literal.data(), literal.size());
+}
+
+inline void appendCborInteger(QByteArray &out, qint64 value)
+{
+    // Отрицательное n кодируется как старший тип 1 со значением -1 - n
+    if (value < 0) {
+        CborRpcParser::appendHead(out, 1, quint64(-1 - value));
+    } else {
+        CborRpcParser::appendHead(out, 0, quint64(value));
+    }
+}
+
+// {"jsonrpc": "2.0", "id": — словарь из трёх пар
+QByteArray renderCborPrefix()
+{
+    QByteArray out;
+    CborRpcParser::appendHead(out, 5, 3);
+    CborRpcParser::appendText(out, "jsonrpc");
+    CborRpcParser::appendText(out, "2.0");
+    CborRpcParser::appendText(out, "id");
+    return out;
+}
+
+QByteArray renderCborUnknownMethod()
+{
+    QByteArray out;
+    CborRpcParser::appendText(out, "error");
+    CborRpcParser::appendHead(out, 5, 2);
+    CborRpcParser::appendText(out, "code");
+    appendCborInteger(out, -32601);
+    CborRpcParser::appendText(out, "message");
+    CborRpcParser::appendText(out, "Unknown method");
+    return out;
+}
+
+const QByteArray &cborPrefix()
+{
+    static const QByteArray prefix = renderCborPrefix();
+    return prefix;
+}
+
+const QByteArray &cborUnknownMethod()
+{
+    static const QByteArray tail = renderCborUnknownMethod();
+    return tail;
+}
+
+} // namespace
+
+ResponseEncoder::ResponseEncoder()
+{
+    buffer.reserve(InitialCapacity);
+}
+
+ResponseEncoder &ResponseEncoder::forThread()
+{
+    thread_local ResponseEncoder encoder;
+    return encoder;
+}
+
+void ResponseEncoder::begin(QByteArrayView id, WireFormat format)
+{
+    buffer.resize(0);  // Ёмкость сохраняется, новых выделений нет
+    if (format == CborFormat) {
+        buffer.append(cborPrefix());
+        if (id.isEmpty()) {
+            buffer.append(char(0xf6));  // null
+        } else {
+            buffer.append(id.data(), id.size());
+        }
+        return;
+    }
+
+    appendLiteral(buffer, Prefix);
+    if (id.isEmpty()) {
+        appendLiteral(buffer, "null");
+    } else {
+        buffer.append(id.data(), id.size());
+    }
+}
+
+QByteArrayView ResponseEncoder::acknowledgement(QByteArrayView id, WireFormat format)
+{
+    begin(id, format);
+    if (format == CborFormat) {
+        // Текст строки: постоянная часть и id числом или строкой
+        QByteArrayView idText;
+        char digits[MaxDigits];
+        if (CborRpcParser::isText(id)) {
+            idText = CborRpcParser::text(id);
+        } else if (CborRpcParser::isInteger(id)) {
+            const int start = formatInteger(digits, CborRpcParser::integer(id));
+            idText = QByteArrayView(digits + start, MaxDigits - start);
+        }
+        CborRpcParser::appendText(buffer, "result");
+        CborRpcParser::appendHead(buffer, 3, quint64(sizeof(AcknowledgementText) - 1 + idText.size()));
+        appendLiteral(buffer, AcknowledgementText);
+        buffer.append(idText.data(), idText.size());
+        return buffer;
+    }
+
+    appendLiteral(buffer, AcknowledgementHead);
+    // Содержимое строкового id уже экранировано — вставляем как есть
+    if (id.size() >= 2 && id.at(0) == '"') {
+        buffer.append(id.data() + 1, id.size() - 2);
+    } else if (id != QByteArrayView("null")) {
+        buffer.append(id.data(), id.size());
+    }
+    appendLiteral(buffer, AcknowledgementTail);
+    return buffer;
+}
+
+QByteArrayView ResponseEncoder::unknownMethod(QByteArrayView id, WireFormat format)
+{
+    begin(id, format);
+    if (format == CborFormat) {
+        buffer.append(cborUnknownMethod());
+    } else {
+        appendLiteral(buffer, UnknownMethodTail);
+    }
+    return buffer;
+}
+
+QByteArrayView ResponseEncoder::error(QByteArrayView id, int code, QByteArrayView message, WireFormat format)
+{
+    begin(id, format);
+    if (format == CborFormat) {
+        CborRpcParser::appendText(buffer, "error");
+        CborRpcParser::appendHead(buffer, 5, 2);
+        CborRpcParser::appendText(buffer, "code");
+        appendCborInteger(buffer, code);
+        CborRpcParser::appendText(buffer, "message");
+        CborRpcParser::appendText(buffer, message);
+        return buffer;
+    }
+
+    appendLiteral(buffer, ErrorHead);
+    appendInteger(buffer, code);
+    appendLiteral(buffer, MessageHead);
+    appendString(buffer, message);
+    appendLiteral(buffer, "}}");
+    return buffer;
+}
+
+QByteArrayView ResponseEncoder::result(QByteArrayView id, QByteArrayView value, WireFormat format)
+{
+    begin(id, format);
+    if (format == CborFormat) {
+        CborRpcParser::appendText(buffer, "result");
+        buffer.append(value.data(), value.size());
+        return buffer;
+    }
+
+    appendLiteral(buffer, ResultHead);
+    buffer.append(value.data(), value.size());
+    buffer.append('}');
+    return buffer;
+}
+
+QByteArrayView ResponseEncoder::notification(QByteArrayView method, QByteArrayView params, WireFormat format)
+{
+    buffer.resize(0);
+    if (format == CborFormat) {
+        CborRpcParser::appendHead(buffer, 5, 3);
+        CborRpcParser::appendText(buffer, "jsonrpc");
+        CborRpcParser::appendText(buffer, "2.0");
+        CborRpcParser::appendText(buffer, "method");
+        CborRpcParser::appendText(buffer, method);
+        CborRpcParser::appendText(buffer, "params");
+        buffer.append(params.data(), params.size());
+        return buffer;
+    }
+
+    appendLiteral(buffer, NotificationHead);
+    appendString(buffer, method);
+    appendLiteral(buffer, ParamsHead);
+    buffer.append(params.data(), params.size());
+    buffer.append('}');
+    return buffer;
+}
+
+void ResponseEncoder::appendString(QByteArray &out, QByteArrayView text)
+{
+    static const char hex[] = "0123456789abcdef";
+
+    out.append('"');
+    const char *p = text.data();
+    const char *end = p + text.size();
+    const char *run = p;  // Начало участка, не требующего экранирования
+    for (; p < end; ++p) {
+        const uchar c = uchar(*p);
+        if (c >= 0x20 && c != '"' && c != '\\') {
+            continue;
+        }
+        out.append(run, p - run);
+        run = p + 1;
+        switch (c) {
+        case '"': appendLiteral(out, "\\\""); break;
+        case '\\': appendLiteral(out, "\\\\"); break;
+        case '\n': appendLiteral(out, "\\n"); break;
+        case '\r': appendLiteral(out, "\\r"); break;
+        case '\t': appendLiteral(out, "\\t"); break;
+        default: {
+            const char escaped[] = {'\\', 'u', '0', '0', hex[c >> 4], hex[c & 0xf]};
+            out.append(escaped, sizeof(escaped));
+            break;
+        }
+        }
+    }
+    out.append(run, end - run);
+    out.append('"');
+}
+
+void ResponseEncoder::appendInteger(QByteArray &out, qint64 value)
+{
+    char digits[MaxDigits];
+    const int start = formatInteger(digits, value);
+    out.append(digits + start, MaxDigits - start);
+}
+
+ValueWriter::ValueWriter(WireFormat format, QByteArray &out)
+    : format(format)
+    , out(out)
+    , needComma(false)
+{
+}
+
+void ValueWriter::separate()
+{
+    if (needComma) {
+        out.append(',');
+        needComma = false;
+    }
+}
+
+void ValueWriter::beginMap()
+{
+    if (format == CborFormat) {
+        out.append(char(0xbf));
+        return;
+    }
+    separate();
+    out.append('{');
+}
+
+void ValueWriter::endMap()
+{
+    if (format == CborFormat) {
+        out.append(char(0xff));
+        return;
+    }
+    out.append('}');
+    needComma = true;
+}
+
+void ValueWriter::beginArray()
+{
+    if (format == CborFormat) {
+        out.append(char(0x9f));
+        return;
+    }
+    separate();
+    out.append('[');
+}
+
+void ValueWriter::endArray()
+{
+    if (format == CborFormat) {
+        out.append(char(0xff));
+        return;
+    }
+    out.append(']');
+    needComma = true;
+}
+
+void ValueWriter::key(QByteArrayView name)
+{
+    if (format == CborFormat) {
+        CborRpcParser::appendText(out, name);
+        return;
+    }
+    separate();
+    ResponseEncoder::appendString(out, name);
+    out.append(':');
+}
+
+void ValueWriter::integer(qint64 value)
+{
+    if (format == CborFormat) {
+        appendCborInteger(out, value);
+        return;
+    }
+    separate();
+    ResponseEncoder::appendInteger(out, value);
+    needComma = true;
+}
+
+void ValueWriter::boolean(bool value)
+{
+    if (format == CborFormat) {
+        out.append(char(value ? 0xf5 : 0xf4));
+        return;
+    }
+    separate();
+    out.append(value ? "true" : "false");
+    needComma = true;
+}
+
+void ValueWriter::text(QByteArrayView value)
+{
+    if (format == CborFormat) {
+        CborRpcParser::appendText(out, value);
+        return;
+    }
+    separate();
+    ResponseEncoder::appendString(out, value);
+    needComma = true;
+}
+
+void ValueWriter::id(const QString &value, bool numeric)
+{
+    if (!numeric) {
+        text(value.toUtf8());
+    } else if (format == CborFormat) {
+        integer(value.toLongLong());  // В CBOR числовой id — всегда целое
+    } else {
+        // Исходный токен JSON-числа, без переформатирования
+        separate();
+        out.append(value.toUtf8());
+        needComma = true;
+    }
+}
@@ -0,0 +1,65 @@
+#ifndef RESPONSE_ENCODER_H
+#define RESPONSE_ENCODER_H
+
+#include <QByteArray>
+#include <QByteArrayView>
+#include "wire_format.h"
+
+// Кодировщик ответов JSON-RPC в компактный JSON или CBOR — в той же
+// кодировке, что и запрос. У каждого потока свой буфер, который
+// переиспользуется между ответами; постоянные части конвертов заготовлены
+// заранее, подставляется только id.
+// Результат действителен до следующего вызова в этом же потоке.
+class ResponseEncoder
+{
+public:
+    static ResponseEncoder &forThread();
+
+    // id — исходный токен из запроса; пустой означает null
+    QByteArrayView acknowledgement(QByteArrayView id, WireFormat format = JsonFormat);
+    QByteArrayView unknownMethod(QByteArrayView id, WireFormat format = JsonFormat);
+    QByteArrayView error(QByteArrayView id, int code, QByteArrayView message, WireFormat format = JsonFormat);
+    // value — готовое значение в кодировке format
+    QByteArrayView result(QByteArrayView id, QByteArrayView value, WireFormat format = JsonFormat);
+    // Уведомление сервера клиенту (без id); params — готовое значение в кодировке format
+    QByteArrayView notification(QByteArrayView method, QByteArrayView params, WireFormat format = JsonFormat);
+
+    // Строка JSON в кавычках с экранированием
+    static void appendString(QByteArray &out, QByteArrayView text);
+    static void appendInteger(QByteArray &out, qint64 value);
+
+private:
+    ResponseEncoder();
+    void begin(QByteArrayView id, WireFormat format);
+
+    QByteArray buffer;
+};
+
+// Построитель значения для result в кодировке ответа. Словари и массивы
+// могут быть вложенными; в CBOR они неопределённой длины, чтобы не считать
+// элементы заранее.
+class ValueWriter
+{
+public:
+    ValueWriter(WireFormat format, QByteArray &out);
+
+    void beginMap();
+    void endMap();
+    void beginArray();
+    void endArray();
+    void key(QByteArrayView name);
+    void integer(qint64 value);
+    void boolean(bool value);
+    void text(QByteArrayView value);
+    // id заявки в том типе, в каком он пришёл: число остаётся числом
+    void id(const QString &value, bool numeric);
+
+private:
+    void separate();
+
+    WireFormat format;
+    QByteArray &out;
+    bool needComma;  // JSON: перед следующим элементом нужна запятая
+};
+
+#endif // RESPONSE_ENCODER_H
@@ -0,0 +1,95 @@
+#include "retry_cache.h"
+#include <QtAlgorithms>
+
+RetryCache::RetryCache(int capacity, qint64 ttl)
+    : entries(qMax(0, capacity))
+    , index(qMax(0, capacity) * 2)  // Заполнение не выше половины: таблица никогда не растёт
+    , timeToLive(qMax<qint64>(1, ttl))
+    , filled(0)
+    , hand(0)
+{
+}
+
+RetryCache::Key RetryCache::keyOf(const ClientKey &client, QByteArrayView id)
+{
+    // FNV-1a по байтам токена: повтор приходит побайтно тем же
+    quint64 hash = Q_UINT64_C(0xcbf29ce484222325);
+    for (char c : id) {
+        hash = (hash ^ uchar(c)) * Q_UINT64_C(0x100000001b3);
+    }
+    Key key;
+    key.client = client;
+    key.id = QByteArray::fromRawData(id.data(), id.size());
+    key.hash = hash;
+    return key;
+}
+
+bool RetryCache::contains(const ClientKey &client, QByteArrayView id, qint64 now)
+{
+    if (!isEnabled()) {
+        return false;
+    }
+    const int *slot = index.find(keyOf(client, id));
+    if (!slot) {
+        return false;
+    }
+    Entry &entry = entries[*slot];
+    if (entry.expiresAt <= now) {
+        // Место освободит стрелка, запись из индекса убирается сразу
+        index.remove(entry.key);
+        entry.used = false;
+        return false;
+    }
+    entry.referenced = true;
+    return true;
+}
+
+void RetryCache::insert(const ClientKey &client, QByteArrayView id, qint64 now)
+{
+    if (!isEnabled()) {
+        return;
+    }
+    Key key = keyOf(client, id);
+    if (const int *existing = index.find(key)) {
+        Entry &entry = entries[*existing];
+        entry.expiresAt = now + timeToLive;
+        entry.referenced = true;
+        return;
+    }
+
+    const int slot = filled < entries.size() ? filled++ : victim(now);
+    Entry &entry = entries[slot];
+    if (entry.used) {
+        index.remove(entry.key);
+    }
+    key.id = QByteArray(id.data(), id.size());  // Хранимый ключ владеет копией токена
+    entry.key = key;
+    entry.expiresAt = now + timeToLive;
+    entry.used = true;
+    entry.referenced = false;
+    index.findOrInsert(key, slot);
+}
+
+void RetryCache::clear()
+{
+    for (Entry &entry : entries) {
+        entry = Entry();
+    }
+    index = FlatHashMap<Key, int>(int(entries.size()) * 2);
+    filled = 0;
+    hand = 0;
+}
+
+int RetryCache::victim(qint64 now)
+{
+    // Не больше двух оборотов: за первый все биты обращения сбрасываются
+    forever {
+        const int slot = hand;
+        hand = (hand + 1) % int(entries.size());
+        Entry &entry = entries[slot];
+        if (!entry.used || entry.expiresAt <= now || !entry.referenced) {
+            return slot;
+        }
+        entry.referenced = false;
+    }
+}
@@ -0,0 +1,65 @@
+#ifndef RETRY_CACHE_H
+#define RETRY_CACHE_H
+
+#include <QByteArray>
+#include <QByteArrayView>
+#include <QList>
+#include "flat_hash.h"
+#include "request.h"
+
+// Кеш уже принятых заявок для повторов: клиент UDP, не получив
+// подтверждения, шлёт тот же processRequest снова, и повтор не должен
+// попасть в очередь второй раз. Ключ — адрес и порт клиента и исходный
+// токен id целиком: отпечаток ускоряет поиск, но совпадение отпечатков не
+// выдаёт новую заявку за повтор. Размер фиксирован: записи лежат в массиве
+// на capacity мест, при заполнении вытесняются по алгоритму CLOCK (вторая
+// попытка), устаревшие по ttl — в первую очередь.
+// Не потокобезопасен: вызывается под блокировкой очереди.
+class RetryCache
+{
+public:
+    // capacity 0 отключает кеш
+    RetryCache(int capacity, qint64 ttl);
+
+    bool isEnabled() const { return !entries.isEmpty(); }
+
+    // true, если заявка с этим id от этого клиента уже принята и не устарела
+    bool contains(const ClientKey &client, QByteArrayView id, qint64 now);
+    void insert(const ClientKey &client, QByteArrayView id, qint64 now);
+    void clear();
+
+    int size() const { return index.size(); }
+    int capacity() const { return int(entries.size()); }
+
+private:
+    struct Key {
+        ClientKey client;
+        QByteArray id;
+        quint64 hash = 0;  // Отпечаток токена id
+
+        bool operator==(const Key &other) const
+        {
+            return hash == other.hash && client == other.client && id == other.id;
+        }
+        friend quint64 hashOf(const Key &key) { return hashOf(key.client) ^ key.hash; }
+    };
+
+    struct Entry {
+        Key key;
+        qint64 expiresAt = 0;
+        bool used = false;
+        bool referenced = false;  // Бит CLOCK: запись запрашивали с прошлого прохода стрелки
+    };
+
+    // Ключ для поиска ссылается на буфер id без копирования
+    static Key keyOf(const ClientKey &client, QByteArrayView id);
+    int victim(qint64 now);
+
+    QList<Entry> entries;
+    FlatHashMap<Key, int> index;  // Ключ -> номер записи
+    qint64 timeToLive;
+    int filled;   // Записи [0, filled) уже использовались
+    int hand;     // Стрелка CLOCK
+};
+
+#endif // RETRY_CACHE_H
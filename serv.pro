@@ -0,0 +1,9 @@
+TEMPLATE = subdirs
+
+SUBDIRS = \
+    server \
+    tests \
+    loadgen \
+    bench
+
+server.file = server.pro
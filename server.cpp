@@ -1,129 +1,1048 @@
 #include "server.h"
 #include "time_thread.h"
-#include <QDebug>
-#include <QJsonDocument>
-#include <QJsonObject>
+#include "cbor_parser.h"
+#include "response_encoder.h"
+#include "batch_response.h"
+#include "logger.h"
+#include "metrics.h"
 #include <QHostAddress>
 #include <QDateTime>
+#include <QDeadlineTimer>
+#include <QSaveFile>
 
-Server::Server(quint16 port, QObject *parent)
+namespace {
+
+// Дальше суток вперёд заявки не откладываются
+const qint64 MaxDelay = 24 * 60 * 60 * 1000;
+// Период проверки, завершили ли потоки обработки свои заявки перед передачей работы, мс
+const int HandoverPollInterval = 10;
+
+} // namespace
+
+// Ответы на датаграмму. С первой журналируемой заявки ответы придерживаются
+// до фиксации журнала; ушедшие раньше неё (части пакета) её не подтверждают
+class Server::DurableReply : public DatagramSink
+{
+public:
+    DurableReply(DatagramSink &reply, RequestLog *log) : reply(reply), log(log), held(false) {}
+
+    void hold() { held = log != nullptr; }
+    void sendDatagram(QByteArrayView data, const ClientInfo &client) override
+    {
+        if (held) {
+            log->sendAfterSync(data, client);
+        } else {
+            reply.sendDatagram(data, client);
+        }
+    }
+
+private:
+    DatagramSink &reply;
+    RequestLog *log;  // nullptr — ответы уходят сразу
+    bool held;
+};
+
+Server::Server(quint16 port, const ServerOptions &options, QObject *parent)
     : QObject(parent)
-    , socket(new QUdpSocket(this))
+    , listeners(new ListenerPool(this, options.batchSize, options.ioBackend, this))
+    , streams(new StreamListener(this, this))
     , timeThread(new TimeThread(this))
-    , hasRequests(false)
-    , busy(false)
+    , workers(new WorkerPool(this, options.workerCount, options.workerAffinity))
+    , grouper(options.groupWindow, options.groupShift, options.workerAffinity == WorkerPool::ClientAffinity)
+    , delayedRequests(options.agingInterval, options.fairQuantum, options.scheduling)
+    , deferredRequests(QDeadlineTimer::current().deadline())
+    , admission(options.queueLimit, options.queueResume, options.clientRate, options.clientBurst)
+    , retries(options.retryCacheSize, options.retryTtl)
+    , requestLog(nullptr)
+    , ackBeforeSync(options.logAckBeforeSync)
+    , notifier(nullptr)
+    , handover(nullptr)
+    , dispatchPaused(false)
+    , streamPort(options.streamTcp ? port : 0)
+    , streamSocket(options.streamSocket)
     , requestCount(0)  // Инициализация счетчика заявок
+    , maxReplySize(options.maxReplySize)
+    , metricsFile(options.metricsFile)
 {
     connect(timeThread, &TimeThread::tick, this, &Server::processTick);
+    uptime.start();
+    if (options.pushCompletions) {
+        // Уведомления уходят тем же путём, каким пришли заявки, склеенные до предела ответа
+        notifier = new CompletionNotifier(this, options.pushWindow, options.maxReplySize,
+                                          options.pushRetryInterval, options.pushAttempts);
+        notifier->start();
+    }
+    workers->start();
 
-    if (!socket->bind(QHostAddress::Any, port)) {
-        qDebug() << "Server could not start!";
+    // Если сервер уже работает, сокеты и очереди берутся у него. Журнал
+    // открывается только после того, как старый процесс его закрыл
+    QList<int> sockets;
+    Handover::Snapshot snapshot;
+    bool takenOver = false;
+    if (!options.handoverPath.isEmpty()) {
+        handover = new Handover(options.handoverPath, this);
+        connect(handover, &Handover::requested, this, &Server::onHandoverRequested);
+        takenOver = handover->takeOver(sockets, snapshot);
+        if (takenOver) {
+            handover->finishTakeOver();  // Сокеты уже наши: при сбое работаем дальше
+        }
+    }
+
+    if (!options.logDirectory.isEmpty()) {
+        // Заявки, принятые до перезапуска, возвращаются в очередь до начала приёма
+        requestLog = new RequestLog(options.logDirectory, options.logSyncInterval, options.logCheckpointSize, this);
+        QList<RequestLog::Recovered> recovered;
+        if (!requestLog->open(recovered)) {
+            LOG_ERROR("Request log is disabled");
+            delete requestLog;
+            requestLog = nullptr;
+        } else if (!takenOver) {
+            restoreRequests(recovered);
+        } else if (recovered.size() != snapshot.queued.size() + snapshot.deferred.size()) {
+            // В журнале те же заявки, что и в снимке, но снимок точнее: в нём монотонные сроки
+            LOG_WARNING("Request log holds %1 pending request(s), the handed over queues %2",
+                        recovered.size(), snapshot.queued.size() + snapshot.deferred.size());
+        }
+    }
+
+    if (!metricsFile.isEmpty()) {
+        // Файл для textfile-коллектора node_exporter
+        QTimer *metricsTimer = new QTimer(this);
+        connect(metricsTimer, &QTimer::timeout, this, &Server::writeMetricsFile);
+        metricsTimer->start(options.metricsInterval);
+    }
+
+    bool started;
+    if (takenOver) {
+        started = listeners->adopt(sockets);
+        // Порт задал предшественник; TCP для кадров слушается на том же
+        if (options.streamTcp) {
+            streamPort = listeners->localPort();
+        }
+        // Просроченным заявкам из снимка нужны сокеты, чтобы сообщить клиентам
+        restoreSnapshot(snapshot);
+    } else if (port == 0) {
+        LOG_ERROR("No running server to take over from and no port to listen on");
+        started = false;
+    } else {
+        started = listeners->start(port, options.listenerCount);
+    }
+    if (started) {
+        started = listenStreams();
+    }
+    if (!started) {
+        LOG_ERROR("Server could not start!");
     } else {
-        qDebug() << "Server started!";
-        connect(socket, &QUdpSocket::readyRead, this, &Server::onReadyRead);
+        LOG_INFO("Server started with %1 listener(s)!", listeners->size());
         timeThread->start();  // Запуск отдельного потока для управления временем
+        if (handover) {
+            handover->listen();
+        }
     }
 }
 
 Server::~Server()
 {
+    listeners->pause();  // Сначала останавливаем приём; сокеты ещё нужны для ответов
+    {
+        QMutexLocker locker(&queueMutex);
+        dispatchPaused = true;  // Новые пачки потокам больше не раздаются
+    }
     timeThread->stop();  // Остановка потока перед удалением
     timeThread->wait();  // Ожидание завершения потока
-    socket->close();
+    delete workers;      // Дожидается выполняемых заявок: они ещё отвечают клиентам и пишут в журнал
+    if (notifier) {
+        notifier->stop();  // Уведомления отправляются через слушателей — до их остановки
+    }
+    delete notifier;
+    if (requestLog) {
+        requestLog->close();  // Последняя группа и подтверждения, ждавшие её фиксации
+    }
+    listeners->stop();
+    streams->close();
+    delete requestLog;   // Уже закрыт; удаляется после соединений кадров, которые к нему обращаются
 }
 
-void Server::onReadyRead()
+void Server::handleDatagram(QByteArrayView datagram, const ClientInfo &sender, DatagramSink &reply)
 {
-    while (socket->hasPendingDatagrams()) {
-        QByteArray data;
-        data.resize(socket->pendingDatagramSize());
-        QHostAddress senderAddress;
-        quint16 senderPort;
-        socket->readDatagram(data.data(), data.size(), &senderAddress, &senderPort);
+    const qint64 received = QDeadlineTimer::current(Qt::PreciseTimer).deadlineNSecs();
+    Metrics::add(Metrics::DatagramsReceived);
+    LOG_SAMPLED(Logger::Debug, "Data received from %1:%2: %3", sender.address.toString(), sender.port, datagram);
 
-        qDebug() << "Data received:" << data;
+    // Конверт разбирается прямо по буферу приёма, без построения QJsonDocument;
+    // кодировка определяется по первому байту, ответ уходит в той же
+    const WireFormat format = detectWireFormat(datagram);
+    const bool batch = format == CborFormat ? CborRpcParser::isBatch(datagram) : JsonRpcParser::isBatch(datagram);
+    // Подтверждение журналируемой заявки не должно опередить её запись на диск
+    DurableReply durable(reply, ackBeforeSync ? nullptr : requestLog);
+    if (batch) {
+        handleBatch(datagram, format, sender, durable);
+    } else {
+        JsonRpcEnvelope envelope;
+        const JsonRpcParser::Error error = format == CborFormat
+                ? CborRpcParser::parse(datagram, envelope)
+                : JsonRpcParser::parse(datagram, envelope);
+        bool journaled = false;
+        const QByteArrayView response = handleRequest(envelope, error, sender, &journaled);
+        if (journaled) {
+            durable.hold();
+        }
+        sendJsonRpcResponse(response, sender, durable);
+    }
+
+    const qint64 elapsed = QDeadlineTimer::current(Qt::PreciseTimer).deadlineNSecs() - received;
+    Metrics::record(Metrics::AckLatency, quint64(qMax<qint64>(0, elapsed)) / 1000);
+}
+
+void Server::handleBatch(QByteArrayView datagram, WireFormat format, const ClientInfo &sender, DurableReply &reply)
+{
+    BatchElements elements;
+    const JsonRpcParser::Error batchError = format == CborFormat
+            ? CborRpcParser::parseBatch(datagram, elements)
+            : JsonRpcParser::parseBatch(datagram, elements);
+    Metrics::add(Metrics::BatchesReceived);
+    if (batchError != JsonRpcParser::NoError) {
+        // Неразборчивый или пустой пакет — один ответ с ошибкой, не массив
+        Metrics::add(Metrics::RequestsRejected);
+        LOG_SAMPLED(Logger::Debug, "Received invalid JSON-RPC batch");
+        sendJsonRpcResponse(ResponseEncoder::forThread().error(
+                                QByteArrayView(), batchError,
+                                batchError == JsonRpcParser::ParseError ? "Parse error" : "Invalid Request", format),
+                            sender, reply);
+        return;
+    }
+
+    LOG_SAMPLED(Logger::Debug, "Batch received with %1 call(s)", elements.size());
 
-        QJsonDocument jsonDoc = QJsonDocument::fromJson(data);
-        if (jsonDoc.isNull() || !jsonDoc.isObject()) {
-            qDebug() << "Received invalid JSON";
-            return;
+    // Ответы на вызовы пакета собираются в общие массивы по maxReplySize байт
+    // вместо отдельной датаграммы на каждый вызов
+    BatchResponse response(format, maxReplySize, reply, sender);
+    for (const QByteArrayView &element : elements) {
+        JsonRpcEnvelope envelope;
+        const JsonRpcParser::Error error = format == CborFormat
+                ? CborRpcParser::parse(element, envelope)
+                : JsonRpcParser::parse(element, envelope);
+        bool journaled = false;
+        const QByteArrayView result = handleRequest(envelope, error, sender, &journaled);
+        if (journaled) {
+            reply.hold();
         }
+        // Уведомления (вызовы без id) в ответном массиве не участвуют
+        if (error != JsonRpcParser::NoError || envelope.hasId) {
+            response.append(result);
+        }
+    }
+    const int datagrams = response.finish();
+    LOG_SAMPLED(Logger::Debug, "Sent %1 batch response(s) in %2 datagram(s)", response.size(), datagrams);
+}
+
+QByteArrayView Server::handleRequest(const JsonRpcEnvelope &envelope, JsonRpcParser::Error error, const ClientInfo &sender,
+                                     bool *journaled)
+{
+    const WireFormat format = envelope.format;
+    Metrics::add(Metrics::RequestsReceived);
+    if (error != JsonRpcParser::NoError) {
+        Metrics::add(Metrics::RequestsRejected);
+        LOG_SAMPLED(Logger::Debug, "Received invalid JSON-RPC request");
+        return ResponseEncoder::forThread().error(
+                    envelope.id, error,
+                    error == JsonRpcParser::ParseError ? "Parse error" : "Invalid Request", format);
+    }
+
+    const QString id = idText(format, envelope.id);  // Получаем ID
 
-        QJsonObject jsonRequest = jsonDoc.object();
-        QString method = jsonRequest["method"].toString();
-        QString id = jsonRequest["id"].toString();  // Получаем ID
+    LOG_SAMPLED(Logger::Debug, "Method received: %1, request ID: %2", envelope.method, id);
 
-        qDebug() << "Method received:" << method;
-        qDebug() << "Request ID received:" << id;  // Выводим ID для проверки
+    if (envelope.methodIs("getStats")) {
+        QByteArray value;
+        statsValue(format, value);
+        return ResponseEncoder::forThread().result(envelope.id, value, format);
+    }
+    if (envelope.methodIs("getStatus") || envelope.methodIs("cancelRequest")) {
+        return handleStatus(envelope, sender, envelope.methodIs("cancelRequest"));
+    }
+    if (envelope.methodIs("ackCompletions")) {
+        // Клиент получил уведомление requestsCompleted с этим номером
+        QByteArrayView value;
+        bool ok = findParam(envelope, "seq", value);
+        const qint64 sequence = ok ? scalarInteger(format, value, &ok) : 0;
+        if (!ok || sequence < 1) {
+            Metrics::add(Metrics::RequestsRejected);
+            return ResponseEncoder::forThread().error(
+                        envelope.id, JsonRpcParser::InvalidParams, "Invalid seq", format);
+        }
+        if (notifier) {
+            notifier->acknowledge(ClientKey::of(sender), quint64(sequence));
+        }
+        return ResponseEncoder::forThread().result(envelope.id, format == CborFormat ? "\xf5" : "true", format);
+    }
+    if (!envelope.methodIs("processRequest")) {
+        Metrics::add(Metrics::UnknownMethods);
+        return ResponseEncoder::forThread().unknownMethod(envelope.id, format);
+    }
 
-        QJsonObject jsonResponse;
-        jsonResponse["jsonrpc"] = "2.0";
-        jsonResponse["id"] = id;  // Вставляем ID в ответ
+    // Параметры разбираются сразу в типизированные поля заявки.
+    // Без явного приоритета заявка попадает в самую низкую корзину
+    int priority = RequestScheduler::LowestPriority;
+    QByteArrayView value;
+    if (findParam(envelope, "priority", value)) {
+        bool ok;
+        const qint64 number = scalarInteger(format, value, &ok);
+        if (!ok || !validatePriority(number)) {
+            Metrics::add(Metrics::RequestsRejected);
+            return ResponseEncoder::forThread().error(
+                        envelope.id, JsonRpcParser::InvalidParams, "Invalid priority", format);
+        }
+        priority = int(number);
+    }
 
-        if (method == "processRequest") {
-            QJsonObject params = jsonRequest["params"].toObject();
+    Configuration configuration = NoConfiguration;
+    if (findParam(envelope, "configuration", value)) {
+        QByteArray storage;
+        QByteArrayView name;
+        if (stringValue(format, value, storage, name)) {
+            configuration = configurationFromText(name);
+        }
+        if (configuration == NoConfiguration || configuration == InvalidConfiguration) {
+            Metrics::add(Metrics::RequestsRejected);
+            return ResponseEncoder::forThread().error(
+                        envelope.id, JsonRpcParser::InvalidParams, "Invalid configuration", format);
+        }
+    }
 
-            // Сохраняем информацию о клиенте и его запросе, включая ID
-            ClientInfo clientInfo = {senderAddress, senderPort};
-            delayedRequests.enqueue(qMakePair(params, clientInfo));
+    const qint64 now = QDeadlineTimer::current().deadline();
+    qint64 due;
+    if (!dueTime(envelope, now, due)) {
+        Metrics::add(Metrics::RequestsRejected);
+        return ResponseEncoder::forThread().error(
+                    envelope.id, JsonRpcParser::InvalidParams, "Invalid delay", format);
+    }
+    // deadline — сколько мс после приёма результат ещё нужен клиенту;
+    // не выполненная к этому сроку заявка снимается с ошибкой DeadlineExpired
+    qint64 deadline = 0;
+    if (findParam(envelope, "deadline", value)) {
+        bool ok;
+        const qint64 budget = scalarInteger(format, value, &ok);
+        if (!ok || budget < 1 || budget > MaxDelay || now + budget <= due) {
+            Metrics::add(Metrics::RequestsRejected);
+            return ResponseEncoder::forThread().error(
+                        envelope.id, JsonRpcParser::InvalidParams, "Invalid deadline", format);
+        }
+        deadline = now + budget;
+    }
 
-            if (!hasRequests) {
-                hasRequests = true;
+    // Сохраняем информацию о клиенте и его запросе, включая ID
+    QueuedRequest request = {sender, id, 0, configuration, quint8(priority), format};
+    request.deadline = deadline;
+    request.numericId = idIsNumber(format, envelope.id);
+    const ClientKey client = ClientKey::of(sender);
+    // Повторы распознаются только по настоящему id: у уведомлений и id null его нет
+    const bool identified = envelope.hasId
+            && !(format == CborFormat ? CborRpcParser::isNull(envelope.id) : JsonRpcParser::isNull(envelope.id));
+    bool duplicate = false;
+    AdmissionControl::Decision decision = AdmissionControl::Admitted;
+    {
+        QMutexLocker locker(&queueMutex);  // Очередь общая для всех потоков приёма
+        // Заявка с тем же id ещё не обработана, хотя кэш повторов мог её уже забыть:
+        // вторая копия в очередь не ставится, иначе индекс потерял бы одну из них
+        duplicate = identified && (retries.contains(client, envelope.id, now)
+                                   || requestIndex.find(client, id, request.numericId) != RequestIndex::Unknown);
+        if (!duplicate) {
+            // Отложенные заявки тоже занимают память, поэтому считаются в пределе очереди
+            decision = admission.admit(client, delayedRequests.size() + deferredRequests.size(), now);
+        }
+        if (!duplicate && decision == AdmissionControl::Admitted) {
+            if (identified) {
+                retries.insert(client, envelope.id, now);
+            }
+            if (requestLog) {
+                // В журнале сроки хранятся в настенном времени: монотонное не переживает перезапуск
+                const qint64 wallNow = QDateTime::currentMSecsSinceEpoch();
+                const qint64 dueAt = due > now ? wallNow + (due - now) : 0;
+                const qint64 expiresAt = deadline != 0 ? wallNow + (deadline - now) : 0;
+                request.sequence = requestLog->append(request, dueAt, expiresAt);
+                if (journaled) {
+                    *journaled = true;
+                }
+            }
+            if (due > now) {
+                // Отложенная заявка ждёт в колесе таймеров, поток времени будится к её сроку
+                requestIndex.update(request, RequestIndex::Deferred, deferredRequests.schedule(request, due));
+                timeThread->wakeAt(deferredRequests.nextDeadline());
+            } else {
+                requestIndex.update(request, RequestIndex::Queued, delayedRequests.enqueue(request, now));
+                dispatchRequests(now);
+                wakeForExpiry();
+            }
+        }
+    }
+
+    if (duplicate) {
+        // Подтверждение потерялось, и клиент повторил запрос: заявка уже принята.
+        // Её запись может быть ещё не зафиксирована, как и первое подтверждение
+        if (journaled && requestLog) {
+            *journaled = true;
+        }
+        Metrics::add(Metrics::DuplicateRequests);
+        LOG_SAMPLED(Logger::Debug, "Request %1 is a retry, acknowledged again without queueing", id);
+        return ResponseEncoder::forThread().acknowledgement(envelope.id, format);
+    }
+    if (decision == AdmissionControl::Overloaded) {
+        Metrics::add(Metrics::RequestsShed);
+        LOG_SAMPLED(Logger::Debug, "Rejected request %1: server busy", id);
+        return ResponseEncoder::forThread().error(
+                    envelope.id, JsonRpcParser::ServerBusy, "Server busy", format);
+    }
+    if (decision == AdmissionControl::RateLimited) {
+        Metrics::add(Metrics::RequestsThrottled);
+        LOG_SAMPLED(Logger::Debug, "Rejected request %1 from %2:%3: rate limit exceeded",
+                    id, sender.address.toString(), sender.port);
+        return ResponseEncoder::forThread().error(
+                    envelope.id, JsonRpcParser::RateLimited, "Rate limit exceeded", format);
+    }
+
+    Metrics::add(Metrics::RequestsAccepted);
+    return ResponseEncoder::forThread().acknowledgement(envelope.id, format);
+}
+
+QByteArrayView Server::handleStatus(const JsonRpcEnvelope &envelope, const ClientInfo &sender, bool cancel)
+{
+    const WireFormat format = envelope.format;
+    QByteArrayView token;
+    if (!findParam(envelope, "id", token)) {
+        Metrics::add(Metrics::RequestsRejected);
+        return ResponseEncoder::forThread().error(
+                    envelope.id, JsonRpcParser::InvalidParams, "Missing id", format);
+    }
+    // Искать можно только свои заявки: ключ индекса включает адрес и порт клиента
+    const QString target = idText(format, token);
+    const bool numeric = idIsNumber(format, token);
+    const ClientKey client = ClientKey::of(sender);
+
+    RequestIndex::State state;
+    int priority = 0;
+    qint64 waited = -1;
+    quint64 sequence = 0;
+    bool cancelled = false;
+    {
+        QMutexLocker locker(&queueMutex);
+        quint32 slot;
+        state = requestIndex.find(client, target, numeric, &slot);
+        if (state == RequestIndex::Queued || state == RequestIndex::Deferred) {
+            const PooledRequest &record = state == RequestIndex::Queued
+                    ? delayedRequests.at(slot) : deferredRequests.at(slot);
+            priority = record.priority;
+            sequence = record.sequence;
+            if (state == RequestIndex::Queued) {
+                waited = QDeadlineTimer::current().deadline() - record.enqueuedAt;
+            }
+            if (cancel) {
+                // Запись становится надгробием и пропускается при извлечении
+                if (state == RequestIndex::Queued) {
+                    delayedRequests.cancel(slot);
+                } else {
+                    deferredRequests.cancel(slot);
+                }
+                requestIndex.remove(client, target, numeric);
+                cancelled = true;
+            }
+        }
+    }
+
+    if (cancelled) {
+        Metrics::add(Metrics::RequestsCancelled);
+        if (requestLog && sequence != 0) {
+            requestLog->complete(sequence);
+        }
+        LOG_SAMPLED(Logger::Debug, "Request %1 cancelled by %2:%3", target, sender.address.toString(), sender.port);
+    }
+
+    QByteArray value;
+    ValueWriter writer(format, value);
+    writer.beginMap();
+    writer.key("status");
+    writer.text(RequestIndex::stateName(state));
+    if (cancel) {
+        writer.key("cancelled");
+        writer.boolean(cancelled);
+    }
+    if (priority != 0) {
+        writer.key("priority");
+        writer.integer(priority);
+    }
+    if (waited >= 0) {
+        writer.key("waitedMs");
+        writer.integer(waited);
+    }
+    writer.endMap();
+    return ResponseEncoder::forThread().result(envelope.id, value, format);
+}
+
+void Server::processTick(const QDateTime &currentTime)
+{
+    Q_UNUSED(currentTime);
+
+    QMutexLocker locker(&queueMutex);
+    const qint64 now = QDeadlineTimer::current().deadline();
+
+    // Отложенные заявки, чей срок наступил, переходят в планировщик
+    QList<QueuedRequest> due;
+    deferredRequests.advance(now, due);
+    for (const QueuedRequest &ready : std::as_const(due)) {
+        if (isExpired(ready, now)) {
+            expireRequest(ready);
+            continue;
+        }
+        requestIndex.update(ready, RequestIndex::Queued, delayedRequests.enqueue(ready, now));
+    }
+    // Просроченные не ждут места в пуле: они освобождают очередь для заявок,
+    // которые ещё успевают (просматривается только вершина кучи сроков)
+    QList<QueuedRequest> expired;
+    delayedRequests.takeExpired(now, expired);
+    for (const QueuedRequest &request : std::as_const(expired)) {
+        expireRequest(request);
+    }
+    dispatchRequests(now);
+
+    // Следующий тик — к сроку ближайшей отложенной заявки или к истечению
+    // самой срочной из ожидающих
+    const qint64 next = deferredRequests.nextDeadline();
+    if (next >= 0) {
+        timeThread->wakeAt(next);
+    }
+    wakeForExpiry();
+}
+
+bool Server::dispatchRequests(qint64 now)
+{
+    // Заявки уходят в пул, пока в нём есть место; остальные ждут в
+    // планировщике, чтобы их порядок определяли приоритеты и старение.
+    // Окно набирается только из заявок одного уровня: группировка не даёт
+    // менее срочной заявке обогнать более срочную
+    bool dispatched = false;
+    while (!dispatchPaused && !delayedRequests.isEmpty() && workers->hasRoom()) {
+        const int priority = delayedRequests.nextPriority(now);
+        dispatchWindow.resize(0);
+        do {
+            QueuedRequest request = delayedRequests.dequeue(now);
+            if (isExpired(request, now)) {
+                expireRequest(request);  // Место в пуле достаётся тем, кто ещё успевает
+            } else {
+                dispatchWindow.append(std::move(request));
+            }
+        } while (dispatchWindow.size() < grouper.window() && !delayedRequests.isEmpty()
+                 && delayedRequests.nextPriority(now) == priority);
+        if (dispatchWindow.isEmpty()) {
+            continue;
+        }
+        grouper.group(dispatchWindow, dispatchBatches);
+        for (const RequestBatch &batch : std::as_const(dispatchBatches)) {
+            for (const QueuedRequest &request : batch) {
+                requestIndex.update(request, RequestIndex::Processing);
             }
+            workers->submit(batch);
+        }
+        dispatched = true;
+    }
+    return dispatched;
+}
+
+void Server::sendDatagram(QByteArrayView data, const ClientInfo &client)
+{
+    if (!client.stream) {
+        listeners->sendDatagram(data, client);
+        return;
+    }
+    // Клиенту потокового соединения — только в соединение: если его уже
+    // нет, ответ теряется, а не уходит по UDP на чужой адрес
+    if (!streams->deliver(data, client)) {
+        LOG_SAMPLED(Logger::Debug, "Stream client %1:%2 is gone, dropping a message",
+                    client.address.toString(), client.port);
+    }
+}
 
-            jsonResponse["result"] = QString("Request will be processed with ID: %1").arg(id);
-            sendJsonRpcResponse(jsonResponse, senderAddress, senderPort);
+bool Server::refill()
+{
+    QMutexLocker locker(&queueMutex);
+    return dispatchRequests(QDeadlineTimer::current().deadline());
+}
+
+void Server::processBatch(const RequestBatch &batch)
+{
+    // Подготовка к конфигурации и общие блокировки — один раз на пачку
+    QElapsedTimer timer;
+    timer.start();
+    const QString configuration = configurationName(batch.first().configuration);
+    const qint64 now = QDeadlineTimer::current().deadline();
+    if (requestLog) {
+        requestLog->complete(batch);
+    }
+
+    int processed = 0;
+    bool indexed = false;
+    for (const QueuedRequest &request : batch) {
+        indexed = indexed || RequestIndex::isIndexed(request);
+        // Срок мог истечь, пока пачка ждала в очереди потока
+        if (isExpired(request, now)) {
+            reportExpired(request);
+            continue;
+        }
+        ++processed;
+        Metrics::add(Metrics::RequestsProcessed);
+        Metrics::record(Metrics::QueueWait, quint64(qMax<qint64>(0, now - request.enqueuedAt)));
+        LOG_SAMPLED(Logger::Debug, "Processing request %1 with priority %2 configuration %3 from %4:%5",
+                    request.id, request.priority, configuration,
+                    request.client.address.toString(), request.client.port);
+    }
+    requestCount.fetchAndAddRelaxed(processed);
+
+    if (indexed) {
+        QMutexLocker locker(&queueMutex);
+        for (const QueuedRequest &request : batch) {
+            if (RequestIndex::isIndexed(request)) {
+                requestIndex.remove(request);
+            }
+        }
+    }
+    // Уведомить можно только о заявке с id: по нему клиент узнает свою
+    if (notifier && indexed) {
+        for (const QueuedRequest &request : batch) {
+            if (RequestIndex::isIndexed(request) && !isExpired(request, now)) {
+                notifier->completed(request, qMax<qint64>(0, now - request.enqueuedAt));
+            }
+        }
+    }
+    Metrics::add(Metrics::RequestBatches);
+    Metrics::record(Metrics::BatchRunTime, quint64(timer.nsecsElapsed() / 1000));
+}
+
+void Server::restoreRequests(const QList<RequestLog::Recovered> &recovered)
+{
+    if (recovered.isEmpty()) {
+        return;
+    }
+    const qint64 now = QDeadlineTimer::current().deadline();
+    const qint64 wallNow = QDateTime::currentMSecsSinceEpoch();
+    int expired = 0;
+    QMutexLocker locker(&queueMutex);
+    for (const RequestLog::Recovered &entry : recovered) {
+        QueuedRequest request = entry.request;
+        if (entry.expiresAt != 0) {
+            if (entry.expiresAt <= wallNow) {
+                // Срок истёк, пока сервер не работал; сокеты ещё не открыты, и
+                // клиенту об этом не сообщить
+                Metrics::add(Metrics::RequestsExpired);
+                requestLog->complete(request.sequence);
+                ++expired;
+                continue;
+            }
+            request.deadline = now + (entry.expiresAt - wallNow);
+        }
+        if (entry.dueAt > wallNow) {
+            requestIndex.update(request, RequestIndex::Deferred,
+                                deferredRequests.schedule(request, now + (entry.dueAt - wallNow)));
         } else {
-            jsonResponse["error"] = "Unknown method";
-            sendJsonRpcResponse(jsonResponse, senderAddress, senderPort);
+            requestIndex.update(request, RequestIndex::Queued, delayedRequests.enqueue(request, now));
+        }
+    }
+    const qint64 next = deferredRequests.nextDeadline();
+    if (next >= 0) {
+        timeThread->wakeAt(next);
+    }
+    dispatchRequests(now);
+    wakeForExpiry();
+    LOG_INFO("Restored %1 request(s) from the request log, %2 dropped as expired",
+             recovered.size() - expired, expired);
+}
+
+void Server::restoreSnapshot(const Handover::Snapshot &snapshot)
+{
+    const qint64 now = QDeadlineTimer::current().deadline();
+    QMutexLocker locker(&queueMutex);
+    // Время постановки сохраняется, чтобы старение продолжилось с того же места
+    for (QueuedRequest request : snapshot.queued) {
+        if (!requestLog) {
+            request.sequence = 0;
+        }
+        requestIndex.update(request, RequestIndex::Queued, delayedRequests.enqueue(request, request.enqueuedAt));
+    }
+    for (int i = 0; i < snapshot.deferred.size(); ++i) {
+        QueuedRequest request = snapshot.deferred.at(i);
+        if (!requestLog) {
+            request.sequence = 0;
+        }
+        requestIndex.update(request, RequestIndex::Deferred, deferredRequests.schedule(request, snapshot.due.at(i)));
+    }
+    const qint64 next = deferredRequests.nextDeadline();
+    if (next >= 0) {
+        timeThread->wakeAt(next);
+    }
+    dispatchRequests(now);
+    wakeForExpiry();
+}
+
+bool Server::listenStreams()
+{
+    if (streamPort != 0 && !streams->listen(streamPort)) {
+        return false;
+    }
+    return streamSocket.isEmpty() || streams->listenLocal(streamSocket);
+}
+
+void Server::onHandoverRequested()
+{
+    // Новые датаграммы ждут преемника в буферах сокетов; потоковые
+    // соединения закрываются, и клиенты переподключаются уже к нему
+    if (!listeners->pause()) {
+        LOG_ERROR("Cannot stop reading the sockets, handover cancelled");
+        listeners->resume();
+        handover->release();
+        return;
+    }
+    streams->close();
+    {
+        QMutexLocker locker(&queueMutex);
+        dispatchPaused = true;
+    }
+    continueHandover();
+}
+
+void Server::continueHandover()
+{
+    // Выполняемые заявки не передаются: дожидаемся, пока потоки их завершат
+    if (workers->pending() > 0) {
+        QTimer::singleShot(HandoverPollInterval, this, &Server::continueHandover);
+        return;
+    }
+
+    Handover::Snapshot snapshot;
+    {
+        QMutexLocker locker(&queueMutex);
+        const qint64 now = QDeadlineTimer::current().deadline();
+        while (!delayedRequests.isEmpty()) {
+            snapshot.queued.append(delayedRequests.dequeue(now));
+        }
+        deferredRequests.takeAll(snapshot.deferred, snapshot.due);
+    }
+
+    if (!handover->send(listeners->descriptors(), snapshot)) {
+        // Преемник не принял работу: продолжаем сами
+        {
+            QMutexLocker locker(&queueMutex);
+            dispatchPaused = false;
         }
+        restoreSnapshot(snapshot);
+        listeners->resume();
+        if (!listenStreams()) {
+            LOG_ERROR("Cannot listen for stream connections again after the failed handover");
+        }
+        return;
+    }
+
+    // Порядок как в ~Server: тики и уведомления ещё отправляют через слушателей
+    timeThread->stop();
+    timeThread->wait();
+    if (notifier) {
+        notifier->stop();
+    }
+    // Фиксирует последние записи до того, как журнал откроет преемник, и
+    // отправляет ждавшие этого подтверждения, пока сокеты ещё наши
+    delete requestLog;
+    requestLog = nullptr;
+    listeners->stop();  // Сокеты открыты у преемника, закрываются только наши копии
+    handover->release();
+    LOG_INFO("Handed over to the new server instance, shutting down");
+    emit handedOver();
+}
+
+bool Server::isExpired(const QueuedRequest &request, qint64 now)
+{
+    return request.deadline != 0 && request.deadline <= now;
+}
+
+void Server::expireRequest(const QueuedRequest &request)
+{
+    requestIndex.remove(request);
+    if (requestLog && request.sequence != 0) {
+        requestLog->complete(request.sequence);
+    }
+    reportExpired(request);
+}
+
+void Server::reportExpired(const QueuedRequest &request)
+{
+    Metrics::add(Metrics::RequestsExpired);
+    LOG_SAMPLED(Logger::Debug, "Request %1 from %2:%3 expired before processing",
+                request.id, request.client.address.toString(), request.client.port);
+    // Заявка уже подтверждена; клиент узнаёт о снятии по второму ответу с тем же id
+    if (!RequestIndex::isIndexed(request)) {
+        return;
     }
+    QByteArray id;
+    ValueWriter(request.format, id).id(request.id, request.numericId);
+    sendDatagram(ResponseEncoder::forThread().error(id, JsonRpcParser::DeadlineExpired, "Deadline expired", request.format),
+                 request.client);
 }
 
+void Server::wakeForExpiry()
+{
+    const qint64 expiry = delayedRequests.nextExpiry();
+    if (expiry >= 0) {
+        timeThread->wakeAt(expiry);
+    }
+}
 
+void Server::writeDatagram(QByteArrayView data, const ClientInfo &client, DatagramSink &reply)
+{
+    reply.sendDatagram(data, client);
+}
 
+void Server::sendJsonRpcResponse(QByteArrayView response, const ClientInfo &client, DatagramSink &reply)
+{
+    LOG_SAMPLED(Logger::Debug, "Sending response: %1", response);
+    writeDatagram(response, client, reply);
+}
 
+QString Server::idText(WireFormat format, QByteArrayView token)
+{
+    if (format == JsonFormat) {
+        if (JsonRpcParser::isString(token)) {
+            return scalarText(JsonFormat, token);
+        }
+        return JsonRpcParser::isNull(token) ? QString() : QString::fromUtf8(token.data(), token.size());
+    }
+    return scalarText(CborFormat, token);
+}
 
-void Server::startProcessing()
+bool Server::idIsNumber(WireFormat format, QByteArrayView token)
 {
-    hasRequests = true;
-    qDebug() << "Started processing requests";
+    return format == CborFormat ? CborRpcParser::isInteger(token) : JsonRpcParser::isNumber(token);
 }
 
-void Server::stopProcessing()
+bool Server::findParam(const JsonRpcEnvelope &envelope, QByteArrayView key, QByteArrayView &value)
 {
-    hasRequests = false;
-    qDebug() << "Stopped processing requests";
+    if (!envelope.hasParams) {
+        return false;
+    }
+    return envelope.format == CborFormat
+            ? CborRpcParser::findMember(envelope.params, key, value)
+            : JsonRpcParser::findMember(envelope.params, key, value);
 }
 
-void Server::writeDatagram(const QByteArray &data, const QHostAddress &address, quint16 port)
+QString Server::scalarText(WireFormat format, QByteArrayView token)
 {
-    qDebug() << "Sending response:" << data;
-    socket->writeDatagram(data, address, port);
+    if (format == CborFormat) {
+        if (CborRpcParser::isText(token)) {
+            const QByteArrayView text = CborRpcParser::text(token);
+            return QString::fromUtf8(text.data(), text.size());
+        }
+        return CborRpcParser::isInteger(token) ? QString::number(CborRpcParser::integer(token)) : QString();
+    }
+
+    if (JsonRpcParser::isString(token)) {
+        return QString::fromUtf8(JsonRpcParser::unescape(token.sliced(1, token.size() - 2)));
+    }
+    return JsonRpcParser::isNumber(token) ? QString::number(token.toDouble()) : QString::fromUtf8(token.data(), token.size());
 }
 
-void Server::sendJsonRpcResponse(const QJsonObject &response, const QHostAddress &address, quint16 port)
+void Server::statsValue(WireFormat format, QByteArray &out)
 {
-    QJsonDocument jsonDoc(response);
-    QByteArray datagram = jsonDoc.toJson();
-    qDebug() << "Sending response:" << datagram;
-    writeDatagram(datagram, address, port);
+    int ready;
+    int deferred;
+    const int processing = workers->pending();
+    int byPriority[RequestScheduler::PriorityLevels];
+    bool overloaded;
+    int clients;
+    int remembered;
+    {
+        QMutexLocker locker(&queueMutex);
+        ready = delayedRequests.size();
+        deferred = deferredRequests.size();
+        for (int i = 0; i < RequestScheduler::PriorityLevels; ++i) {
+            byPriority[i] = delayedRequests.size(RequestScheduler::HighestPriority + i);
+        }
+        overloaded = admission.isOverloaded();
+        clients = admission.trackedClients();
+        remembered = retries.size();
+    }
+
+    ValueWriter writer(format, out);
+    writer.beginMap();
+    writer.key("uptimeMs");
+    writer.integer(uptime.elapsed());
+    writer.key("streamConnections");
+    writer.integer(streams->connectionCount());
+
+    writer.key("counters");
+    writer.beginMap();
+    for (int c = 0; c < Metrics::CounterCount; ++c) {
+        writer.key(Metrics::counterName(Metrics::Counter(c)));
+        writer.integer(qint64(Metrics::counter(Metrics::Counter(c))));
+    }
+    writer.endMap();
+
+    writer.key("queue");
+    writer.beginMap();
+    writer.key("ready");
+    writer.integer(ready);
+    writer.key("deferred");
+    writer.integer(deferred);
+    writer.key("processing");
+    writer.integer(processing);
+    writer.key("byPriority");
+    writer.beginArray();
+    for (int depth : byPriority) {
+        writer.integer(depth);
+    }
+    writer.endArray();
+    writer.key("overloaded");
+    writer.integer(overloaded ? 1 : 0);
+    writer.key("rateLimitedClients");
+    writer.integer(clients);
+    writer.key("retryCache");
+    writer.integer(remembered);
+    writer.key("unacknowledgedCompletions");
+    writer.integer(notifier ? notifier->unacknowledged() : 0);
+    writer.endMap();
+
+    writer.key("latency");
+    writer.beginMap();
+    for (int h = 0; h < Metrics::HistogramCount; ++h) {
+        const HistogramSummary summary = Metrics::summary(Metrics::Histogram(h));
+        writer.key(Metrics::histogramName(Metrics::Histogram(h)));
+        writer.beginMap();
+        writer.key("count");
+        writer.integer(qint64(summary.count));
+        writer.key("mean");
+        writer.integer(summary.count ? qint64(summary.sum / summary.count) : 0);
+        writer.key("p50");
+        writer.integer(qint64(summary.p50));
+        writer.key("p90");
+        writer.integer(qint64(summary.p90));
+        writer.key("p99");
+        writer.integer(qint64(summary.p99));
+        writer.key("p999");
+        writer.integer(qint64(summary.p999));
+        writer.key("max");
+        writer.integer(qint64(summary.max));
+        writer.endMap();
+    }
+    writer.endMap();
+    writer.endMap();
 }
 
-bool Server::validateConfiguration(const QString &configuration)
+void Server::writeMetricsFile()
 {
-    QStringList validConfigurations = {
-        "одна строка", "две строки", "три строки", "четыре строки",
-        "один столбец", "два столбца", "три столбца", "четыре столбца",
-        "1х1", "1x2", "1x3", "2x3", "2x2", "3x3", "4х4", "8х8"
-    };
+    QByteArray text;
+    Metrics::appendPrometheus(text);
+
+    int ready;
+    int deferred;
+    bool overloaded;
+    {
+        QMutexLocker locker(&queueMutex);
+        ready = delayedRequests.size();
+        deferred = deferredRequests.size();
+        overloaded = admission.isOverloaded();
+    }
+    text.append("# HELP serv_queue_depth Requests waiting in the queue.\n");
+    text.append("# TYPE serv_queue_depth gauge\n");
+    text.append("serv_queue_depth{queue=\"ready\"} ").append(QByteArray::number(ready)).append('\n');
+    text.append("serv_queue_depth{queue=\"deferred\"} ").append(QByteArray::number(deferred)).append('\n');
+    text.append("serv_queue_depth{queue=\"workers\"} ").append(QByteArray::number(workers->pending())).append('\n');
+    text.append("# HELP serv_overloaded 1 while new requests are rejected because the queue is above its high watermark.\n");
+    text.append("# TYPE serv_overloaded gauge\n");
+    text.append("serv_overloaded ").append(overloaded ? '1' : '0').append('\n');
+    text.append("# HELP serv_uptime_seconds Seconds since the server started.\n");
+    text.append("# TYPE serv_uptime_seconds gauge\n");
+    text.append("serv_uptime_seconds ").append(QByteArray::number(uptime.elapsed() / 1000)).append('\n');
+
+    // Коллектор не должен увидеть файл наполовину записанным
+    QSaveFile file(metricsFile);
+    if (!file.open(QIODevice::WriteOnly) || file.write(text) != text.size() || !file.commit()) {
+        LOG_WARNING("Could not write metrics to %1", metricsFile);
+    }
+}
 
-    return validConfigurations.contains(configuration);
+qint64 Server::scalarInteger(WireFormat format, QByteArrayView token, bool *ok)
+{
+    if (format == CborFormat) {
+        if (CborRpcParser::isInteger(token)) {
+            return CborRpcParser::integer(token, ok);
+        }
+    } else if (JsonRpcParser::isNumber(token)) {
+        return QByteArray::fromRawData(token.data(), token.size()).toLongLong(ok);
+    }
+    return scalarText(format, token).toLongLong(ok);
 }
 
-bool Server::validatePriority(const QString &priority)
+bool Server::dueTime(const JsonRpcEnvelope &envelope, qint64 now, qint64 &due)
 {
+    // delay — задержка в мс; executeAt — мс Unix-времени или дата ISO 8601.
+    // Без них заявка выполняется сразу, обоих сразу быть не может
+    due = now;
+    QByteArrayView value;
     bool ok;
-    int p = priority.toInt(&ok);
-    return ok && p >= 1 && p <= 7;
+    const bool hasDelay = findParam(envelope, "delay", value);
+    if (hasDelay) {
+        const qint64 delay = scalarInteger(envelope.format, value, &ok);
+        if (!ok || delay < 0 || delay > MaxDelay) {
+            return false;
+        }
+        due = now + delay;
+    }
+
+    if (findParam(envelope, "executeAt", value)) {
+        if (hasDelay) {
+            return false;
+        }
+        const bool textual = envelope.format == CborFormat ? CborRpcParser::isText(value) : JsonRpcParser::isString(value);
+        qint64 at;
+        if (textual) {
+            const QDateTime dateTime = QDateTime::fromString(scalarText(envelope.format, value), Qt::ISODateWithMs);
+            if (!dateTime.isValid()) {
+                return false;
+            }
+            at = dateTime.toMSecsSinceEpoch();
+        } else {
+            at = scalarInteger(envelope.format, value, &ok);
+            if (!ok) {
+                return false;
+            }
+        }
+        // Настенное время переводится в монотонное; прошедший срок — выполнить сразу
+        const qint64 delay = at - QDateTime::currentMSecsSinceEpoch();
+        if (delay > MaxDelay) {
+            return false;
+        }
+        due = now + qMax<qint64>(0, delay);
+    }
+    return true;
+}
+
+bool Server::stringValue(WireFormat format, QByteArrayView token, QByteArray &storage, QByteArrayView &text)
+{
+    if (format == CborFormat) {
+        if (!CborRpcParser::isText(token)) {
+            return false;
+        }
+        text = CborRpcParser::text(token);
+        return true;
+    }
+
+    if (!JsonRpcParser::isString(token)) {
+        return false;
+    }
+    // Без экранирования строка берётся прямо из датаграммы
+    text = token.sliced(1, token.size() - 2);
+    if (text.contains('\\')) {
+        storage = JsonRpcParser::unescape(text);
+        text = storage;
+    }
+    return true;
+}
+
+bool Server::validatePriority(qint64 priority)
+{
+    return priority >= RequestScheduler::HighestPriority && priority <= RequestScheduler::LowestPriority;
 }
@@ -2,47 +2,112 @@
 #define SERVER_H
 
 #include <QObject>
-#include <QUdpSocket>
 #include <QTimer>
-#include <QQueue>
-#include <QPair>
-#include <QJsonObject>
-#include <QJsonDocument>
 #include <QHostAddress>
 #include <QDateTime>
+#include <QMutex>
+#include <QElapsedTimer>
 #include "time_thread.h"
+#include "request.h"
+#include "request_scheduler.h"
+#include "request_grouper.h"
+#include "timing_wheel.h"
+#include "admission_control.h"
+#include "retry_cache.h"
+#include "request_log.h"
+#include "request_index.h"
+#include "server_options.h"
+#include "listener_pool.h"
+#include "stream_listener.h"
+#include "worker_pool.h"
+#include "completion_notifier.h"
+#include "handover.h"
+#include "jsonrpc_parser.h"
 
-class Server : public QObject
+class Server : public QObject, public DatagramHandler, public RequestHandler, public DatagramSink
 {
     Q_OBJECT
 
 public:
-    explicit Server(quint16 port, QObject *parent = nullptr);
+    explicit Server(quint16 port, const ServerOptions &options = ServerOptions(), QObject *parent = nullptr);
     ~Server();
 
+    // Порт слушателей: заданный или полученный вместе с сокетами предшественника
+    quint16 port() const { return listeners->localPort(); }
+
+    void handleDatagram(QByteArrayView datagram, const ClientInfo &sender, DatagramSink &reply) override;
+    void processBatch(const RequestBatch &batch) override;
+    bool refill() override;
+    // Уведомления: клиенту потокового соединения — в него, остальным — по UDP
+    void sendDatagram(QByteArrayView data, const ClientInfo &client) override;
+
+signals:
+    // Сокеты и очереди переданы новому процессу, этому пора завершаться
+    void handedOver();
+
 private slots:
-    void onReadyRead();
     void processTick(const QDateTime &currentTime);
+    void writeMetricsFile();
+    void onHandoverRequested();
+    void continueHandover();
 
 private:
-    struct ClientInfo {
-        QHostAddress address;
-        quint16 port;
-    };
-
-    void startProcessing();
-    void stopProcessing();
-    void writeDatagram(const QByteArray &data, const QHostAddress &address, quint16 port);
-    void sendJsonRpcResponse(const QJsonObject &response, const QHostAddress &address, quint16 port);
-    bool validateConfiguration(const QString &configuration);
-    bool validatePriority(const QString &priority);
-
-    QUdpSocket *socket;
+    class DurableReply;
+
+    // journaled — заявка записана в журнал, подтверждение ждёт его фиксации
+    QByteArrayView handleRequest(const JsonRpcEnvelope &envelope, JsonRpcParser::Error error, const ClientInfo &sender,
+                                 bool *journaled = nullptr);
+    // getStatus и cancelRequest: заявку ищут по id из params, только свою
+    QByteArrayView handleStatus(const JsonRpcEnvelope &envelope, const ClientInfo &sender, bool cancel);
+    void handleBatch(QByteArrayView datagram, WireFormat format, const ClientInfo &sender, DurableReply &reply);
+    void statsValue(WireFormat format, QByteArray &out);
+    bool dispatchRequests(qint64 now);
+    static bool isExpired(const QueuedRequest &request, qint64 now);
+    // Снимает просроченную заявку из очередей (под queueMutex) и сообщает клиенту
+    void expireRequest(const QueuedRequest &request);
+    void reportExpired(const QueuedRequest &request);
+    // Тик к истечению срока на вершине кучи сроков (под queueMutex)
+    void wakeForExpiry();
+    void writeDatagram(QByteArrayView data, const ClientInfo &client, DatagramSink &reply);
+    void sendJsonRpcResponse(QByteArrayView response, const ClientInfo &client, DatagramSink &reply);
+    static QString idText(WireFormat format, QByteArrayView token);
+    // id пришёл числом: idText у числа 42 и строки "42" одинаков
+    static bool idIsNumber(WireFormat format, QByteArrayView token);
+    static bool findParam(const JsonRpcEnvelope &envelope, QByteArrayView key, QByteArrayView &value);
+    static QString scalarText(WireFormat format, QByteArrayView token);
+    static qint64 scalarInteger(WireFormat format, QByteArrayView token, bool *ok);
+    static bool dueTime(const JsonRpcEnvelope &envelope, qint64 now, qint64 &due);
+    // text — содержимое строки без кавычек; storage хранит его, если понадобилось снять экранирование
+    static bool stringValue(WireFormat format, QByteArrayView token, QByteArray &storage, QByteArrayView &text);
+    static bool validatePriority(qint64 priority);
+    void restoreRequests(const QList<RequestLog::Recovered> &recovered);
+    void restoreSnapshot(const Handover::Snapshot &snapshot);
+    bool listenStreams();
+
+    ListenerPool *listeners;
+    StreamListener *streams;
     TimeThread *timeThread;
-    QQueue<QPair<QJsonObject, ClientInfo>> delayedRequests;
-    bool hasRequests;
-    bool busy;
-    int requestCount;
+    WorkerPool *workers;
+    RequestGrouper grouper;       // Раскладка окна планировщика по пачкам одной конфигурации
+    QMutex queueMutex;  // Защищает delayedRequests, dispatch*, grouper, deferredRequests, admission, retries и requestIndex
+    RequestScheduler delayedRequests;
+    QList<QueuedRequest> dispatchWindow;   // Рабочие списки dispatchRequests, память переиспользуется
+    QList<RequestBatch> dispatchBatches;
+    TimingWheel deferredRequests;  // Заявки с delay/executeAt до наступления срока
+    AdmissionControl admission;
+    RetryCache retries;            // Принятые заявки для распознавания повторов
+    RequestIndex requestIndex;     // Где сейчас заявка с данным id
+    RequestLog *requestLog;        // nullptr — заявки не журналируются
+    bool ackBeforeSync;            // Подтверждать, не дожидаясь фиксации журнала
+    CompletionNotifier *notifier;  // nullptr — о завершении не уведомляем
+    Handover *handover;            // nullptr — без передачи работы при перезапуске
+    bool dispatchPaused;           // Заявки не раздаются потокам: идёт передача работы или остановка (под queueMutex)
+    quint16 streamPort;            // Порт TCP для кадров, 0 — не слушать
+    QString streamSocket;
+    QAtomicInt requestCount;
+    int maxReplySize;
+    QString metricsFile;  // Пусто — метрики в файл не пишутся
+    QElapsedTimer uptime;
 };
 
 #endif // SERVER_H
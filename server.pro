@@ -1,15 +1,66 @@
 QT += core network
 
-CONFIG += c++11
+CONFIG += c++17
 
 SOURCES += \
+    admission_control.cpp \
+    batch_response.cpp \
+    cbor_parser.cpp \
+    completion_notifier.cpp \
+    configuration.cpp \
+    fragment_reassembler.cpp \
+    handover.cpp \
+    jsonrpc_parser.cpp \
+    listener_pool.cpp \
+    logger.cpp \
     main.cpp \
+    metrics.cpp \
+    request_grouper.cpp \
+    request_index.cpp \
+    request_log.cpp \
+    request_pool.cpp \
+    request_scheduler.cpp \
+    response_encoder.cpp \
+    retry_cache.cpp \
     server.cpp \
-    time_thread.cpp
+    stream_listener.cpp \
+    time_thread.cpp \
+    timing_wheel.cpp \
+    udp_transport.cpp \
+    uring_socket.cpp \
+    worker_pool.cpp
 
 HEADERS += \
+    admission_control.h \
+    batch_response.h \
+    cbor_parser.h \
+    completion_notifier.h \
+    configuration.h \
+    datagram.h \
+    flat_hash.h \
+    fragment_reassembler.h \
+    handover.h \
+    jsonrpc_parser.h \
+    listener_pool.h \
+    logger.h \
+    metrics.h \
+    request.h \
+    request_grouper.h \
+    request_index.h \
+    request_log.h \
+    request_pool.h \
+    request_scheduler.h \
+    response_encoder.h \
+    retry_cache.h \
     server.h \
-    time_thread.h
+    server_options.h \
+    stream_listener.h \
+    time_thread.h \
+    timing_wheel.h \
+    udp_transport.h \
+    uring_socket.h \
+    wire_format.h \
+    worker_pool.h
 
 TARGET = server
 TEMPLATE = app
@@ -0,0 +1,44 @@
+#ifndef SERVER_OPTIONS_H
+#define SERVER_OPTIONS_H
+
+#include <QtGlobal>
+#include <QString>
+#include "request_scheduler.h"
+#include "udp_transport.h"
+#include "worker_pool.h"
+
+// Параметры запуска сервера, задаются из командной строки
+struct ServerOptions {
+    qint64 agingInterval = 2000;  // Мс ожидания на подъём заявки на один уровень, 0 — без старения
+    RequestScheduler::Policy scheduling = RequestScheduler::PriorityPolicy;  // Очередь по приоритетам или по срокам (EDF)
+    int batchSize = 64;           // Датаграмм за один recvmmsg
+    UdpTransport::Backend ioBackend = UdpTransport::SocketBackend;  // recvmmsg/sendmmsg или io_uring
+    int listenerCount = 1;        // Потоков приёма с SO_REUSEPORT на одном порту
+    int workerCount = 1;          // Потоков обработки заявок
+    WorkerPool::Affinity workerAffinity = WorkerPool::NoAffinity;  // Привязка заявок к потоку обработки
+    int groupWindow = 16;         // Заявок, раскладываемых по пачкам одной конфигурации за раз, 1 — без пачек
+    int groupShift = 8;           // На сколько заявок пачка может обогнать порядок планировщика
+    int maxReplySize = 1400;      // Предел датаграммы с ответом на пакетный запрос, байт
+    bool streamTcp = false;       // Принимать кадры и по TCP на том же номере порта
+    QString streamSocket;         // Путь Unix-сокета для кадров, пусто — не слушать
+    QString metricsFile;          // Файл метрик в формате Prometheus, пусто — не писать
+    int metricsInterval = 10000;  // Период обновления файла метрик, мс
+    int queueLimit = 100000;      // Верхний порог очереди: выше него новые заявки отклоняются
+    int queueResume = 90000;      // Нижний порог: ниже него приём возобновляется
+    int clientRate = 0;           // Заявок в секунду на клиента, 0 — без лимита
+    int clientBurst = 0;          // Запас токенов клиента, 0 — равен clientRate
+    int fairQuantum = 4;          // Заявок клиента подряд в очереди одного приоритета
+    int retryCacheSize = 65536;   // Записей в кеше повторов, 0 — без кеша
+    qint64 retryTtl = 30000;      // Сколько мс повтор заявки распознаётся как повтор
+    QString logDirectory;         // Каталог журнала заявок, пусто — без журнала
+    int logSyncInterval = 5;      // Период групповой фиксации журнала, мс
+    bool logAckBeforeSync = false; // Подтверждать заявку до фиксации журнала: быстрее, но при сбое она может пропасть
+    qint64 logCheckpointSize = 64 << 20;  // Размер сегмента, после которого делается контрольная точка, байт
+    bool pushCompletions = false; // Уведомлять клиентов о завершении заявок
+    int pushWindow = 5;           // Мс, за которые завершения одного клиента склеиваются в одно уведомление
+    int pushRetryInterval = 200;  // Мс до первого повтора неподтверждённого уведомления
+    int pushAttempts = 5;         // Отправок уведомления, включая первую
+    QString handoverPath;         // Unix-сокет для передачи работы перезапущенному серверу, пусто — без передачи
+};
+
+#endif // SERVER_OPTIONS_H
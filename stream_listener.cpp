@@ -0,0 +1,243 @@
+#include "stream_listener.h"
+#include "logger.h"
+#include "metrics.h"
+#include <QLocalServer>
+#include <QLocalSocket>
+#include <QRandomGenerator>
+#include <QTcpServer>
+#include <QTcpSocket>
+#include <QtEndian>
+
+namespace {
+
+// Байт за одно чтение из сокета
+const qint64 ReadChunk = 64 * 1024;
+
+} // namespace
+
+StreamConnection::StreamConnection(QIODevice *device, const ClientInfo &client, DatagramHandler *handler, QObject *parent)
+    : QObject(parent)
+    , device(device)
+    , peer(client)
+    , handler(handler)
+    , consumed(0)
+    , flushScheduled(false)
+{
+    device->setParent(this);
+    connect(device, &QIODevice::readyRead, this, &StreamConnection::onReadyRead);
+    // Чтение, приостановленное из-за неотправленных ответов, продолжается по мере записи
+    connect(device, &QIODevice::bytesWritten, this, &StreamConnection::onReadyRead);
+    // Без предела Qt дочитывал бы из ядра всё, пока чтение приостановлено,
+    // и окно TCP никогда бы не закрылось
+    if (QTcpSocket *socket = qobject_cast<QTcpSocket *>(device)) {
+        socket->setReadBufferSize(ReadChunk);
+        connect(socket, &QTcpSocket::disconnected, this, &StreamConnection::onDisconnected);
+    } else if (QLocalSocket *socket = qobject_cast<QLocalSocket *>(device)) {
+        socket->setReadBufferSize(ReadChunk);
+        connect(socket, &QLocalSocket::disconnected, this, &StreamConnection::onDisconnected);
+    }
+}
+
+void StreamConnection::sendDatagram(QByteArrayView data, const ClientInfo &client)
+{
+    Q_UNUSED(client);
+    char header[HeaderSize];
+    qToBigEndian<quint32>(quint32(data.size()), header);
+    output.append(header, HeaderSize);
+    output.append(data.data(), data.size());
+    Metrics::add(Metrics::DatagramsSent);
+    if (!flushScheduled) {
+        // Все ответы этого прохода цикла событий — одной записью
+        flushScheduled = true;
+        QMetaObject::invokeMethod(this, &StreamConnection::flush, Qt::QueuedConnection);
+    }
+}
+
+void StreamConnection::flush()
+{
+    flushScheduled = false;
+    if (output.isEmpty() || !device->isOpen()) {
+        output.resize(0);
+        return;
+    }
+    device->write(output);
+    output.resize(0);
+}
+
+void StreamConnection::onReadyRead()
+{
+    forever {
+        // Полные кадры из уже прочитанного
+        while (input.size() - consumed >= HeaderSize) {
+            if (output.size() + device->bytesToWrite() >= MaxPendingOutput) {
+                return;  // Клиент не забирает ответы: не читаем, пока они не уйдут
+            }
+            const quint32 size = qFromBigEndian<quint32>(input.constData() + consumed);
+            if (size > MaxFrameSize) {
+                Metrics::add(Metrics::OversizedFrames);
+                LOG_WARNING("Closing stream from %1:%2: frame of %3 bytes is too large",
+                            peer.address.toString(), peer.port, size);
+                input.clear();
+                consumed = 0;
+                device->close();
+                return;
+            }
+            if (input.size() - consumed - HeaderSize < qsizetype(size)) {
+                break;
+            }
+            handler->handleDatagram(QByteArrayView(input.constData() + consumed + HeaderSize, size), peer, *this);
+            consumed += HeaderSize + size;
+        }
+
+        // Разобранное отбрасывается, неполный кадр переезжает в начало
+        if (consumed > 0) {
+            input.remove(0, consumed);
+            consumed = 0;
+        }
+        const qint64 available = device->bytesAvailable();
+        if (available <= 0) {
+            return;
+        }
+        const qsizetype offset = input.size();
+        input.resize(offset + qsizetype(qMin(available, ReadChunk)));
+        const qint64 read = device->read(input.data() + offset, input.size() - offset);
+        input.resize(offset + qsizetype(qMax<qint64>(0, read)));
+        if (read <= 0) {
+            return;
+        }
+    }
+}
+
+void StreamConnection::onDisconnected()
+{
+    LOG_SAMPLED(Logger::Debug, "Stream from %1:%2 closed", peer.address.toString(), peer.port);
+    emit closed(this);
+    deleteLater();
+}
+
+StreamListener::StreamListener(DatagramHandler *handler, QObject *parent)
+    : QObject(parent)
+    , handler(handler)
+    , tcpServer(nullptr)
+    , localServer(nullptr)
+    , instance(QRandomGenerator::system()->generate64())
+    , nextLocalId(0)
+{
+}
+
+StreamListener::~StreamListener()
+{
+    close();
+}
+
+bool StreamListener::listen(quint16 port)
+{
+    tcpServer = new QTcpServer(this);
+    if (!tcpServer->listen(QHostAddress::Any, port)) {
+        LOG_ERROR("Cannot listen on TCP port %1: %2", port, tcpServer->errorString());
+        return false;
+    }
+    connect(tcpServer, &QTcpServer::newConnection, this, &StreamListener::onNewTcpConnection);
+    return true;
+}
+
+bool StreamListener::listenLocal(const QString &path)
+{
+    localServer = new QLocalServer(this);
+    QLocalServer::removeServer(path);  // Сокет, оставшийся после аварийного завершения
+    if (!localServer->listen(path)) {
+        LOG_ERROR("Cannot listen on %1: %2", path, localServer->errorString());
+        return false;
+    }
+    connect(localServer, &QLocalServer::newConnection, this, &StreamListener::onNewLocalConnection);
+    return true;
+}
+
+void StreamListener::close()
+{
+    delete tcpServer;
+    tcpServer = nullptr;
+    delete localServer;
+    localServer = nullptr;
+    {
+        QMutexLocker locker(&mutex);
+        connections.clear();
+    }
+    qDeleteAll(findChildren<StreamConnection *>(QString(), Qt::FindDirectChildrenOnly));
+}
+
+int StreamListener::connectionCount() const
+{
+    QMutexLocker locker(&mutex);
+    return connections.size();
+}
+
+bool StreamListener::deliver(QByteArrayView data, const ClientInfo &client)
+{
+    QMutexLocker locker(&mutex);
+    StreamConnection *const *found = connections.find(ClientKey::of(client));
+    if (!found) {
+        return false;
+    }
+    // Соединение живёт в потоке слушателя; если оно закроется раньше,
+    // событие удалится вместе с ним
+    StreamConnection *connection = *found;
+    const QByteArray copy = data.toByteArray();
+    QMetaObject::invokeMethod(connection, [connection, copy, client] {
+        connection->sendDatagram(copy, client);
+    }, Qt::QueuedConnection);
+    return true;
+}
+
+void StreamListener::onNewTcpConnection()
+{
+    while (QTcpSocket *socket = tcpServer->nextPendingConnection()) {
+        // Ответы и так склеиваются до записи, Nagle только добавил бы задержку
+        socket->setSocketOption(QAbstractSocket::LowDelayOption, 1);
+        ClientInfo client;
+        client.address = socket->peerAddress();
+        bool isIPv4;
+        const quint32 ipv4 = client.address.toIPv4Address(&isIPv4);
+        if (isIPv4) {
+            client.address.setAddress(ipv4);  // ::ffff:a.b.c.d → a.b.c.d, как у UDP
+        }
+        client.port = socket->peerPort();
+        client.stream = true;
+        add(new StreamConnection(socket, client, handler, this));
+    }
+}
+
+void StreamListener::onNewLocalConnection()
+{
+    while (QLocalSocket *socket = localServer->nextPendingConnection()) {
+        // Номера соединений 64-битные и не переполняются
+        Q_IPV6ADDR address;
+        qToBigEndian(instance, address.c);
+        qToBigEndian(nextLocalId++, address.c + 8);
+        ClientInfo client;
+        client.address = QHostAddress(address);
+        client.port = 0;
+        client.stream = true;
+        add(new StreamConnection(socket, client, handler, this));
+    }
+}
+
+void StreamListener::onClosed(StreamConnection *connection)
+{
+    QMutexLocker locker(&mutex);
+    const ClientKey key = ClientKey::of(connection->client());
+    StreamConnection *const *found = connections.find(key);
+    if (found && *found == connection) {
+        connections.remove(key);
+    }
+}
+
+void StreamListener::add(StreamConnection *connection)
+{
+    Metrics::add(Metrics::ConnectionsAccepted);
+    LOG_SAMPLED(Logger::Debug, "Stream from %1:%2 accepted",
+                connection->client().address.toString(), connection->client().port);
+    connect(connection, &StreamConnection::closed, this, &StreamListener::onClosed);
+    QMutexLocker locker(&mutex);
+    connections.findOrInsert(ClientKey::of(connection->client()), connection) = connection;
+}
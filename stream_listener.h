@@ -0,0 +1,97 @@
+#ifndef STREAM_LISTENER_H
+#define STREAM_LISTENER_H
+
+#include <QObject>
+#include <QByteArray>
+#include <QIODevice>
+#include <QMutex>
+#include <QString>
+#include "datagram.h"
+#include "flat_hash.h"
+
+class QTcpServer;
+class QLocalServer;
+
+// Потоковое соединение (TCP или Unix-сокет). Кадр — 4 байта длины (big-endian)
+// и тело; тело обрабатывается так же, как датаграмма. Клиент может слать
+// кадры, не дожидаясь ответов: все полные кадры разбираются сразу, а ответы
+// копятся и уходят одной записью за проход цикла событий. Пока неотправленных
+// ответов больше MaxPendingOutput, чтение приостанавливается, и клиента
+// сдерживает окно TCP.
+class StreamConnection : public QObject, public DatagramSink
+{
+    Q_OBJECT
+
+public:
+    enum {
+        HeaderSize = 4,
+        MaxFrameSize = 1 << 20,
+        MaxPendingOutput = 4 << 20
+    };
+
+    StreamConnection(QIODevice *device, const ClientInfo &client, DatagramHandler *handler, QObject *parent = nullptr);
+
+    const ClientInfo &client() const { return peer; }
+
+    // Ответ кадром в буфер; запись — в flush() на следующем проходе цикла
+    void sendDatagram(QByteArrayView data, const ClientInfo &client) override;
+
+signals:
+    void closed(StreamConnection *connection);
+
+private slots:
+    void onReadyRead();
+    void flush();
+    void onDisconnected();
+
+private:
+    QIODevice *device;
+    ClientInfo peer;
+    DatagramHandler *handler;
+    QByteArray input;     // Принятые, но ещё не разобранные байты
+    qsizetype consumed;   // Разобрано с начала input
+    QByteArray output;    // Кадры ответов до flush()
+    bool flushScheduled;
+};
+
+// Приём потоковых соединений на TCP-порту и/или Unix-сокете. Работает в
+// потоке, создавшем его, и передаёт кадры тому же обработчику, что и UDP.
+// Как DatagramSink доставляет уведомления из любого потока клиенту,
+// подключённому сейчас с этого адреса.
+class StreamListener : public QObject
+{
+    Q_OBJECT
+
+public:
+    explicit StreamListener(DatagramHandler *handler, QObject *parent = nullptr);
+    ~StreamListener();
+
+    bool listen(quint16 port);
+    bool listenLocal(const QString &path);
+    void close();
+
+    int connectionCount() const;
+
+    // false — такого клиента среди соединений нет
+    bool deliver(QByteArrayView data, const ClientInfo &client);
+
+private slots:
+    void onNewTcpConnection();
+    void onNewLocalConnection();
+    void onClosed(StreamConnection *connection);
+
+private:
+    void add(StreamConnection *connection);
+
+    DatagramHandler *handler;
+    QTcpServer *tcpServer;
+    QLocalServer *localServer;
+    // Unix-клиентам нет адреса: вместо него случайный номер экземпляра
+    // слушателя и номер соединения, поэтому он не повторяется и после перезапуска
+    quint64 instance;
+    quint64 nextLocalId;
+    mutable QMutex mutex;   // Защищает connections
+    FlatHashMap<ClientKey, StreamConnection *> connections;
+};
+
+#endif // STREAM_LISTENER_H
@@ -0,0 +1,45 @@
+#ifndef CHECK_H
+#define CHECK_H
+
+#include <cstdio>
+
+// Проверки для тестов без QtTest: провал печатается и учитывается,
+// тест продолжается; main возвращает Check::result()
+namespace Check {
+
+inline int &failures()
+{
+    static int count = 0;
+    return count;
+}
+
+inline bool record(bool passed, const char *expression, const char *file, int line)
+{
+    if (!passed) {
+        std::fprintf(stderr, "%s:%d: check failed: %s\n", file, line, expression);
+        ++failures();
+    }
+    return passed;
+}
+
+// Проверка невозможна в этом окружении (нет поддержки ядра и т. п.)
+inline void skip(const char *test, const char *reason)
+{
+    std::printf("%s: skipped: %s\n", test, reason);
+}
+
+inline int result(const char *name)
+{
+    if (failures() == 0) {
+        std::printf("%s: all checks passed\n", name);
+        return 0;
+    }
+    std::printf("%s: %d check(s) failed\n", name, failures());
+    return 1;
+}
+
+} // namespace Check
+
+#define CHECK(condition) Check::record(bool(condition), #condition, __FILE__, __LINE__)
+
+#endif // CHECK_H
@@ -0,0 +1,16 @@
+QT = core network
+
+CONFIG += c++17 console testcase
+CONFIG -= app_bundle
+
+TARGET = tst_fragment_reassembler
+INCLUDEPATH += ../..
+
+SOURCES += \
+    tst_fragment_reassembler.cpp \
+    ../../fragment_reassembler.cpp \
+    ../../logger.cpp \
+    ../../metrics.cpp
+
+HEADERS += \
+    ../check.h
@@ -0,0 +1,96 @@
+#include "fragment_reassembler.h"
+#include "../check.h"
+#include <QtEndian>
+
+namespace {
+
+struct Sink : DatagramSink
+{
+    QList<QByteArray> sent;
+
+    void sendDatagram(QByteArrayView data, const ClientInfo &) override { sent.append(data.toByteArray()); }
+};
+
+const ClientInfo client = {QHostAddress(quint32(0x0a000001)), 1000};
+
+QList<QByteArray> split(const QByteArray &message, quint32 id, int count)
+{
+    const quint32 total = quint32(message.size());
+    const quint32 chunk = (total + count - 1) / count;
+    QList<QByteArray> fragments;
+    for (int index = 0; index < count; ++index) {
+        const quint32 offset = chunk * index;
+        const quint32 size = index + 1 < count ? chunk : total - offset;
+        char header[FragmentReassembler::HeaderSize];
+        header[0] = char(FragmentReassembler::Marker);
+        header[1] = char(FragmentReassembler::Data);
+        qToBigEndian<quint16>(quint16(index), header + 2);
+        qToBigEndian<quint16>(quint16(count), header + 4);
+        qToBigEndian<quint32>(id, header + 6);
+        qToBigEndian<quint32>(total, header + 10);
+        QByteArray fragment(header, FragmentReassembler::HeaderSize);
+        fragment.append(message.constData() + offset, size);
+        fragments.append(fragment);
+    }
+    return fragments;
+}
+
+// Фрагменты в любом порядке и с повторами собираются в исходное сообщение
+void reassembly()
+{
+    const QByteArray message(10000, 'x');
+    const QList<QByteArray> fragments = split(message, 1, 10);
+    FragmentReassembler reassembler;
+    for (int index = 9; index > 0; --index) {
+        CHECK(reassembler.add(fragments.at(index), client, 0).isEmpty());
+        CHECK(reassembler.add(fragments.at(index), client, 0).isEmpty());
+    }
+    CHECK(reassembler.add(fragments.at(0), client, 0).toByteArray() == message);
+    CHECK(reassembler.isEmpty());
+    CHECK(reassembler.memoryUsage() == 0);
+}
+
+// Один фрагмент с чужого адреса не вызывает NACK
+void noNackForSingleFragment()
+{
+    FragmentReassembler reassembler;
+    Sink sink;
+    reassembler.add(split(QByteArray(60000, 'x'), 2, 1000).at(5), client, 0);
+    for (qint64 now = 0; now < FragmentReassembler::Timeout; now += 10) {
+        reassembler.expire(now, sink);
+    }
+    CHECK(sink.sent.isEmpty());
+    reassembler.expire(FragmentReassembler::Timeout, sink);
+    CHECK(reassembler.isEmpty());
+}
+
+// NACK не длиннее принятых байт и повторяется не больше MaxNackRounds раз
+void nackLimits()
+{
+    const QList<QByteArray> fragments = split(QByteArray(60000, 'x'), 3, 1000);
+    FragmentReassembler reassembler;
+    Sink sink;
+    reassembler.add(fragments.at(0), client, 0);
+    reassembler.add(fragments.at(1), client, 0);
+    const int received = int(fragments.at(0).size() + fragments.at(1).size());
+
+    for (qint64 now = 0; now < FragmentReassembler::Timeout; now += 10) {
+        reassembler.expire(now, sink);
+    }
+    CHECK(sink.sent.size() == FragmentReassembler::MaxNackRounds);
+    for (const QByteArray &nack : std::as_const(sink.sent)) {
+        CHECK(nack.size() <= received);
+        CHECK(uchar(nack.at(1)) == FragmentReassembler::Nack);
+        CHECK(qFromBigEndian<quint16>(nack.constData() + FragmentReassembler::HeaderSize) == 2);
+    }
+}
+
+} // namespace
+
+int main()
+{
+    reassembly();
+    noNackForSingleFragment();
+    nackLimits();
+    return Check::result("fragment_reassembler");
+}
@@ -0,0 +1,14 @@
+QT = core
+
+CONFIG += c++17 console testcase
+CONFIG -= app_bundle
+
+TARGET = tst_jsonrpc_parser
+INCLUDEPATH += ../..
+
+SOURCES += \
+    tst_jsonrpc_parser.cpp \
+    ../../jsonrpc_parser.cpp
+
+HEADERS += \
+    ../check.h
@@ -0,0 +1,107 @@
+#include "jsonrpc_parser.h"
+#include "../check.h"
+
+namespace {
+
+JsonRpcParser::Error parse(const char *text, JsonRpcEnvelope &envelope)
+{
+    return JsonRpcParser::parse(QByteArrayView(text), envelope);
+}
+
+void validEnvelope()
+{
+    JsonRpcEnvelope envelope;
+    CHECK(parse("{\"jsonrpc\":\"2.0\",\"method\":\"processRequest\",\"id\":\"abc\",\"params\":{\"priority\":3}}",
+                envelope) == JsonRpcParser::NoError);
+    CHECK(envelope.jsonrpc == QByteArrayView("2.0"));
+    CHECK(envelope.method == QByteArrayView("processRequest"));
+    CHECK(envelope.id == QByteArrayView("\"abc\""));
+    CHECK(envelope.params == QByteArrayView("{\"priority\":3}"));
+}
+
+void malformedInput()
+{
+    JsonRpcEnvelope envelope;
+    CHECK(parse("", envelope) == JsonRpcParser::ParseError);
+    CHECK(parse("{\"method\":\"x\"", envelope) == JsonRpcParser::ParseError);
+    CHECK(parse("[1,2]", envelope) == JsonRpcParser::InvalidRequest);
+    CHECK(parse("{\"id\":1}", envelope) == JsonRpcParser::InvalidRequest);
+    CHECK(parse("{\"method\":\"a\",\"jsonrpc\":\"1.0\"}", envelope) == JsonRpcParser::InvalidRequest);
+    CHECK(parse("{\"method\":\"a\",\"params\":3}", envelope) == JsonRpcParser::InvalidRequest);
+}
+
+// Значения не тех типов: раньше из однобайтового токена срезались кавычки,
+// и получался срез отрицательной длины
+void nonStringMembers()
+{
+    const char *requests[] = {
+        "{\"jsonrpc\":\"2.0\",\"method\":1,\"id\":1}",
+        "{\"jsonrpc\":2,\"method\":\"processRequest\",\"id\":1}",
+        "{\"jsonrpc\":\"2.0\",\"method\":null,\"id\":1}",
+        "{\"jsonrpc\":\"2.0\",\"method\":[],\"id\":1}",
+        "{\"jsonrpc\":{},\"method\":\"x\",\"id\":1}",
+        "{\"jsonrpc\":true,\"method\":0}",
+    };
+    for (const char *request : requests) {
+        JsonRpcEnvelope envelope;
+        CHECK(parse(request, envelope) == JsonRpcParser::InvalidRequest);
+        CHECK(envelope.method.isEmpty() || envelope.method == QByteArrayView("processRequest")
+              || envelope.method == QByteArrayView("x"));
+        CHECK(envelope.jsonrpc.isEmpty() || envelope.jsonrpc == QByteArrayView("2.0"));
+        // id всё равно возвращается клиенту в ответе с ошибкой
+        CHECK(!envelope.hasId || envelope.id == QByteArrayView("1"));
+    }
+}
+
+// В ответ на Parse error id не возвращается, даже если успел разобраться
+void parseErrorDropsId()
+{
+    const char *requests[] = {
+        "{\"id\":7,\"method\":\"x\"",
+        "{\"id\":\"abc\",\"method\":\"x\",}",
+        "{\"id\":[1,2],\"method\":}",
+        "{\"id\":1} trailing",
+    };
+    for (const char *request : requests) {
+        JsonRpcEnvelope envelope;
+        CHECK(parse(request, envelope) == JsonRpcParser::ParseError);
+        CHECK(!envelope.hasId && envelope.id.isEmpty());
+    }
+}
+
+// Строки проверяются на корректность UTF-8, в том числе длиннее SIMD-блока
+void utf8Validation()
+{
+    JsonRpcEnvelope envelope;
+    CHECK(parse("{\"method\":\"x\",\"id\":\"\xd0\xbf\xd1\x80\xd0\xb8\xd0\xb2\xd0\xb5\xd1\x82 \xe2\x82\xac \xf0\x9f\x98\x80\"}",
+                envelope) == JsonRpcParser::NoError);
+
+    const char *invalid[] = {
+        "\x80",              // Продолжение без начала
+        "\xc0\xaf",          // Избыточная форма '/'
+        "\xe0\x80\xaf",      // Избыточная форма
+        "\xed\xa0\x80",      // Суррогат
+        "\xf4\x90\x80\x80",  // Больше U+10FFFF
+        "\xd0",              // Обрыв последовательности
+        "\xe2\x82x",         // Не байт продолжения
+        "\xff",
+    };
+    for (const char *bytes : invalid) {
+        for (const QByteArray &padding : {QByteArray(), QByteArray(20, 'a')}) {
+            const QByteArray request = "{\"method\":\"x\",\"params\":[\"" + padding + bytes + "\"]}";
+            CHECK(JsonRpcParser::parse(request, envelope) == JsonRpcParser::ParseError);
+        }
+    }
+}
+
+} // namespace
+
+int main()
+{
+    validEnvelope();
+    malformedInput();
+    nonStringMembers();
+    parseErrorDropsId();
+    utf8Validation();
+    return Check::result("jsonrpc_parser");
+}
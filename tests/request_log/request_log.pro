@@ -0,0 +1,15 @@
+QT = core network
+
+CONFIG += c++17 console testcase
+CONFIG -= app_bundle
+
+TARGET = tst_request_log
+INCLUDEPATH += ../..
+
+SOURCES += \
+    tst_request_log.cpp \
+    ../../logger.cpp \
+    ../../request_log.cpp
+
+HEADERS += \
+    ../check.h
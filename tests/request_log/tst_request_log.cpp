@@ -0,0 +1,269 @@
+#include "request_log.h"
+#include "../check.h"
+#include <QAtomicInt>
+#include <QDir>
+#include <QFile>
+#include <QTemporaryDir>
+#include <QThread>
+
+#ifdef Q_OS_UNIX
+#include <sys/resource.h>
+#include <csignal>
+#endif
+
+namespace {
+
+const ClientInfo Client = {QHostAddress(quint32(0x7f000001)), 50000};
+
+QueuedRequest request(int number)
+{
+    QueuedRequest queued;
+    if (number % 2) {
+        queued.client = {QHostAddress(quint32(0x0a000000 + number)), quint16(1000 + number)};
+    } else {
+        Q_IPV6ADDR address = {};
+        address.c[0] = 0x20;
+        address.c[1] = 0x01;
+        address.c[15] = quint8(number);
+        queued.client = {QHostAddress(address), quint16(1000 + number)};
+    }
+    queued.client.stream = number % 5 == 0;
+    queued.id = QString::number(number);
+    queued.numericId = number % 3 == 0;
+    queued.enqueuedAt = 0;
+    queued.configuration = Grid2x2;
+    queued.priority = quint8(number % 7 + 1);
+    queued.format = number % 4 == 0 ? CborFormat : JsonFormat;
+    return queued;
+}
+
+// Считает подтверждения, отправленные после фиксации группы
+struct Acknowledgements : DatagramSink
+{
+    QAtomicInt count;
+
+    void sendDatagram(QByteArrayView, const ClientInfo &) override { count.fetchAndAddRelaxed(1); }
+};
+
+// Дожидается, пока на диске окажется всё, добавленное до вызова
+bool synced(RequestLog &log, Acknowledgements &acks)
+{
+    const int before = acks.count.loadRelaxed();
+    log.sendAfterSync("ack", Client);
+    for (int waited = 0; acks.count.loadRelaxed() == before && waited < 5000; ++waited) {
+        QThread::msleep(1);
+    }
+    return acks.count.loadRelaxed() > before;
+}
+
+bool sameRequest(const QueuedRequest &a, const QueuedRequest &b)
+{
+    return a.id == b.id && a.numericId == b.numericId && a.client.address == b.client.address
+            && a.client.port == b.client.port && a.client.stream == b.client.stream
+            && a.configuration == b.configuration && a.priority == b.priority && a.format == b.format;
+}
+
+QList<RequestLog::Recovered> reopen(const QString &directory, qint64 checkpointSize = qint64(1) << 30)
+{
+    RequestLog log(directory, 1, checkpointSize);
+    QList<RequestLog::Recovered> recovered;
+    CHECK(log.open(recovered));
+    return recovered;
+}
+
+// Незавершённые заявки возвращаются в порядке приёма со всеми полями
+void replay()
+{
+    QTemporaryDir directory;
+    QList<quint64> sequences;
+    {
+        RequestLog log(directory.path(), 1, qint64(1) << 30);
+        QList<RequestLog::Recovered> recovered;
+        CHECK(log.open(recovered));
+        CHECK(recovered.isEmpty());
+        for (int i = 0; i < 100; ++i) {
+            sequences.append(log.append(request(i), 0));
+        }
+        for (int i = 0; i < 100; i += 3) {
+            log.complete(sequences.at(i));
+        }
+    }
+
+    const QList<RequestLog::Recovered> recovered = reopen(directory.path());
+    CHECK(recovered.size() == 66);
+    int next = 0;
+    for (const RequestLog::Recovered &entry : recovered) {
+        if (next % 3 == 0) {
+            ++next;
+        }
+        CHECK(entry.request.sequence == sequences.value(next));
+        CHECK(sameRequest(entry.request, request(next)));
+        CHECK(entry.dueAt == 0 && entry.expiresAt == 0);
+        ++next;
+    }
+
+    // Новые номера не совпадают с номерами незавершённых заявок
+    RequestLog log(directory.path(), 1, qint64(1) << 30);
+    QList<RequestLog::Recovered> again;
+    CHECK(log.open(again));
+    CHECK(!again.isEmpty() && log.append(request(100), 0) > again.last().request.sequence);
+}
+
+// Сроки отсрочки и актуальности переживают перезапуск
+void dueAndExpiry()
+{
+    QTemporaryDir directory;
+    {
+        RequestLog log(directory.path(), 1, qint64(1) << 30);
+        QList<RequestLog::Recovered> recovered;
+        CHECK(log.open(recovered));
+        log.append(request(1), 0, 0);
+        log.append(request(2), 1700000000000, 0);
+        log.append(request(3), 0, 1700000005000);
+        log.append(request(4), 1700000001000, 1700000002000);
+    }
+
+    const QList<RequestLog::Recovered> recovered = reopen(directory.path());
+    CHECK(recovered.size() == 4);
+    if (recovered.size() == 4) {
+        CHECK(recovered.at(0).dueAt == 0 && recovered.at(0).expiresAt == 0);
+        CHECK(recovered.at(1).dueAt == 1700000000000 && recovered.at(1).expiresAt == 0);
+        CHECK(recovered.at(2).dueAt == 0 && recovered.at(2).expiresAt == 1700000005000);
+        CHECK(recovered.at(3).dueAt == 1700000001000 && recovered.at(3).expiresAt == 1700000002000);
+        CHECK(sameRequest(recovered.at(3).request, request(4)));
+    }
+}
+
+// Оборванная при сбое запись в конце сегмента отбрасывается, всё до неё цело
+void tornTail()
+{
+    QTemporaryDir directory;
+    {
+        RequestLog log(directory.path(), 1, qint64(1) << 30);
+        QList<RequestLog::Recovered> recovered;
+        CHECK(log.open(recovered));
+        for (int i = 0; i < 10; ++i) {
+            log.append(request(i), 0);
+        }
+    }
+    const QStringList segments = QDir(directory.path()).entryList(QStringList("*.wal"), QDir::Files);
+    CHECK(!segments.isEmpty());
+    QFile last(directory.filePath(segments.value(segments.size() - 1)));
+    CHECK(last.open(QIODevice::WriteOnly | QIODevice::Append));
+    // Заголовок записи обещает больше, чем есть в файле
+    last.write(QByteArray("\x40\x00\x00\x00\x12\x34\x56\x78\x01\x02", 10));
+    last.close();
+
+    QList<RequestLog::Recovered> recovered = reopen(directory.path());
+    CHECK(recovered.size() == 10);
+
+    // Новые записи идут в новый сегмент и не теряются за повреждённым хвостом
+    {
+        RequestLog log(directory.path(), 1, qint64(1) << 30);
+        CHECK(log.open(recovered));
+        log.append(request(10), 0);
+    }
+    recovered = reopen(directory.path());
+    CHECK(recovered.size() == 11);
+    CHECK(sameRequest(recovered.value(10).request, request(10)));
+}
+
+// Группа, которую не удалось дописать, не заслоняет следующие
+void failedWrite()
+{
+#ifdef Q_OS_UNIX
+    QTemporaryDir directory;
+    rlimit original;
+    getrlimit(RLIMIT_FSIZE, &original);
+    signal(SIGXFSZ, SIG_IGN);  // Вместо сигнала write вернёт EFBIG
+    {
+        Acknowledgements acks;
+        RequestLog log(directory.path(), 1, qint64(1) << 30, &acks);
+        QList<RequestLog::Recovered> recovered;
+        CHECK(log.open(recovered));
+        for (int i = 0; i < 10; ++i) {
+            log.append(request(i), 0);
+        }
+        CHECK(synced(log, acks));
+
+        // Сегмент может вырасти лишь на 1000 байт: группа записывается частично
+        QFile segment(directory.filePath(QDir(directory.path()).entryList(QStringList("*.wal"), QDir::Files).value(0)));
+        rlimit limited = original;
+        limited.rlim_cur = rlim_t(segment.size() + 1000);
+        setrlimit(RLIMIT_FSIZE, &limited);
+        for (int i = 100; i < 300; ++i) {
+            log.append(request(i), 0);
+        }
+        QThread::msleep(50);
+        setrlimit(RLIMIT_FSIZE, &original);
+
+        for (int i = 10; i < 20; ++i) {
+            log.append(request(i), 0);
+        }
+        CHECK(synced(log, acks));
+    }
+    signal(SIGXFSZ, SIG_DFL);
+
+    // Из неудавшейся группы могли уцелеть только записи, ушедшие раньше неё
+    const QList<RequestLog::Recovered> recovered = reopen(directory.path());
+    CHECK(recovered.size() >= 20);
+    const int later = int(recovered.size()) - 10;
+    for (int i = 0; i < 10 && later >= 10; ++i) {
+        CHECK(sameRequest(recovered.at(i).request, request(i)));
+        CHECK(sameRequest(recovered.at(later + i).request, request(10 + i)));
+    }
+#else
+    Check::skip("failedWrite", "RLIMIT_FSIZE is Unix-only");
+#endif
+}
+
+// Переросший порог сегмент сжимается в контрольную точку: остаются только
+// незавершённые заявки, старые сегменты удаляются
+void checkpointCompaction()
+{
+    QTemporaryDir directory;
+    QList<quint64> kept;
+    {
+        Acknowledgements acks;
+        RequestLog log(directory.path(), 1, 4096, &acks);
+        QList<RequestLog::Recovered> recovered;
+        CHECK(log.open(recovered));
+        for (int round = 0; round < 20; ++round) {
+            for (int i = 0; i < 50; ++i) {
+                const int number = round * 50 + i;
+                const quint64 sequence = log.append(request(number), 0);
+                if (number % 10 == 0) {
+                    kept.append(sequence);
+                } else {
+                    log.complete(sequence);
+                }
+            }
+            CHECK(synced(log, acks));
+        }
+    }
+    const QDir dir(directory.path());
+    CHECK(dir.entryList(QStringList("*.checkpoint"), QDir::Files).size() == 1);
+    CHECK(dir.entryList(QStringList("*.wal"), QDir::Files).size() < 20);
+
+    // При запуске остаток сегментов тоже сжимается
+    QList<RequestLog::Recovered> recovered = reopen(directory.path(), 4096);
+    CHECK(recovered.size() == kept.size());
+    for (int i = 0; i < recovered.size(); ++i) {
+        CHECK(recovered.at(i).request.sequence == kept.value(i));
+        CHECK(sameRequest(recovered.at(i).request, request(i * 10)));
+    }
+    recovered = reopen(directory.path(), 4096);
+    CHECK(recovered.size() == kept.size());
+}
+
+} // namespace
+
+int main()
+{
+    replay();
+    dueAndExpiry();
+    tornTail();
+    failedWrite();
+    checkpointCompaction();
+    return Check::result("request_log");
+}
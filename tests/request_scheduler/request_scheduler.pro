@@ -0,0 +1,16 @@
+QT = core network
+
+CONFIG += c++17 console testcase
+CONFIG -= app_bundle
+
+TARGET = tst_request_scheduler
+INCLUDEPATH += ../..
+
+SOURCES += \
+    tst_request_scheduler.cpp \
+    ../../configuration.cpp \
+    ../../request_pool.cpp \
+    ../../request_scheduler.cpp
+
+HEADERS += \
+    ../check.h
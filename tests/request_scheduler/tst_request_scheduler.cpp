@@ -0,0 +1,248 @@
+#include "request_scheduler.h"
+#include "../check.h"
+
+namespace {
+
+QueuedRequest request(int priority, const char *id, quint16 port = 1000)
+{
+    QueuedRequest queued = {{QHostAddress(quint32(0x7f000001)), port}, QString(id), 0,
+                            NoConfiguration, quint8(priority), JsonFormat};
+    return queued;
+}
+
+QueuedRequest timed(const char *id, qint64 deadline, int priority = RequestScheduler::LowestPriority)
+{
+    QueuedRequest queued = request(priority, id);
+    queued.deadline = deadline;
+    return queued;
+}
+
+// Корзины выдаются от самой срочной к самой низкой
+void priorityOrder()
+{
+    RequestScheduler scheduler;
+    const int priorities[] = {5, 1, 7, 3, 2, 6, 4};
+    for (int priority : priorities) {
+        scheduler.enqueue(request(priority, "r"), 0);
+    }
+    CHECK(scheduler.size() == 7);
+    for (int expected = RequestScheduler::HighestPriority; expected <= RequestScheduler::LowestPriority; ++expected) {
+        CHECK(scheduler.nextPriority(0) == expected);
+        CHECK(scheduler.dequeue(0).priority == expected);
+    }
+    CHECK(scheduler.isEmpty());
+}
+
+// Внутри уровня заявки одного клиента выходят в порядке постановки
+void fifoWithinLevel()
+{
+    RequestScheduler scheduler(0, 4);
+    const char *ids[] = {"a", "b", "c", "d", "e", "f"};
+    for (const char *id : ids) {
+        scheduler.enqueue(request(3, id), 0);
+    }
+    for (const char *id : ids) {
+        CHECK(scheduler.dequeue(0).id == QString(id));
+    }
+    CHECK(scheduler.isEmpty());
+}
+
+// Каждые agingInterval мс ожидания поднимают заявку на уровень
+void agingPromotion()
+{
+    RequestScheduler scheduler(100, 1);
+    scheduler.enqueue(request(7, "old"), 0);
+    scheduler.enqueue(request(1, "new"), 650);
+
+    // Через 650 мс старая заявка поднялась на 6 уровней — до уровня новой,
+    // при равенстве первой остаётся более срочная корзина
+    CHECK(scheduler.nextPriority(650) == 1);
+    // Через 700 мс старая поднялась на 7 уровней, а новая ещё ни на один
+    CHECK(scheduler.nextPriority(700) == 7);
+    CHECK(scheduler.dequeue(700).id == QString("old"));
+    CHECK(scheduler.dequeue(700).id == QString("new"));
+
+    // Без старения порядок определяется только приоритетом
+    RequestScheduler plain(0, 1);
+    plain.enqueue(request(7, "old"), 0);
+    plain.enqueue(request(1, "new"), 1000000);
+    CHECK(plain.dequeue(2000000).id == QString("new"));
+}
+
+// Опустевшая корзина снимается с битовой карты, и выбор переходит к следующей
+void emptyBucketBitmap()
+{
+    RequestScheduler scheduler;
+    scheduler.enqueue(request(1, "a"), 0);
+    scheduler.enqueue(request(1, "b"), 0);
+    scheduler.enqueue(request(3, "c"), 0);
+    scheduler.dequeue(0);
+    scheduler.dequeue(0);
+    CHECK(scheduler.size(1) == 0);
+    CHECK(scheduler.nextPriority(0) == 3);
+    CHECK(scheduler.dequeue(0).id == QString("c"));
+    CHECK(scheduler.isEmpty());
+
+    // Отменённая запись пропускается при извлечении, её корзина тоже освобождается
+    const quint32 cancelled = scheduler.enqueue(request(2, "x"), 0);
+    scheduler.enqueue(request(4, "y"), 0);
+    scheduler.cancel(cancelled);
+    CHECK(scheduler.size(2) == 0);
+    CHECK(scheduler.size() == 1);
+    CHECK(scheduler.dequeue(0).id == QString("y"));
+    CHECK(scheduler.isEmpty());
+    scheduler.enqueue(request(6, "z"), 0);
+    CHECK(scheduler.nextPriority(0) == 6);
+
+    // Все заявки отменены — очередь пуста сразу
+    RequestScheduler single;
+    single.cancel(single.enqueue(request(5, "w"), 0));
+    CHECK(single.isEmpty());
+    single.enqueue(request(7, "v"), 0);
+    CHECK(single.nextPriority(0) == 7);
+}
+
+// Куча сроков выдаёт заявки по возрастанию срока, заявки без срока — последними
+void deadlineOrder()
+{
+    RequestScheduler scheduler(0, 1, RequestScheduler::DeadlinePolicy);
+    scheduler.enqueue(timed("none", 0), 0);
+    const qint64 deadlines[] = {50, 10, 30, 20, 40};
+    for (qint64 deadline : deadlines) {
+        scheduler.enqueue(timed(QByteArray::number(deadline).constData(), deadline), 0);
+    }
+    CHECK(scheduler.size() == 6);
+    CHECK(scheduler.nextPriority(0) == RequestScheduler::HighestPriority);
+    const char *expected[] = {"10", "20", "30", "40", "50", "none"};
+    for (const char *id : expected) {
+        const QueuedRequest next = scheduler.dequeue(0);
+        CHECK(next.id == QString(id));
+    }
+    CHECK(scheduler.isEmpty());
+}
+
+// Равные сроки выходят в порядке постановки, в том числе вперемешку с другими
+void equalDeadlinesFifo()
+{
+    RequestScheduler scheduler(0, 1, RequestScheduler::DeadlinePolicy);
+    const char *ids[] = {"a", "b", "c", "d", "e", "f", "g", "h"};
+    for (int i = 0; i < 8; ++i) {
+        scheduler.enqueue(timed(ids[i], 100), 0);
+        scheduler.enqueue(timed("later", 200 + i), 0);
+    }
+    for (const char *id : ids) {
+        CHECK(scheduler.dequeue(0).id == QString(id));
+    }
+    CHECK(scheduler.size() == 8);
+    CHECK(scheduler.dequeue(0).deadline == 200);
+}
+
+// Отмена из середины кучи — настоящее удаление: остальные выходят по порядку
+void cancelFromMiddle()
+{
+    RequestScheduler scheduler(0, 1, RequestScheduler::DeadlinePolicy);
+    QList<quint32> slots;
+    QList<qint64> deadlines;
+    quint32 seed = 12345;
+    for (int i = 0; i < 100; ++i) {
+        // Сроки вразброс, чтобы на место удалённого вставал элемент из другой ветви
+        seed = seed * 1103515245u + 12345u;
+        const qint64 deadline = 1 + (seed >> 16) % 1000;
+        deadlines.append(deadline);
+        slots.append(scheduler.enqueue(timed(QByteArray::number(i).constData(), deadline), 0));
+    }
+    // Отменяются все, кроме вершины: каждая третья и последняя поставленная
+    bool cancelled[100] = {};
+    for (int i = 1; i < 100; i += 3) {
+        if (scheduler.at(slots.at(i)).next == 0) {
+            continue;
+        }
+        scheduler.cancel(slots.at(i));
+        cancelled[i] = true;
+    }
+    int remaining = 0;
+    for (bool c : cancelled) {
+        remaining += c ? 0 : 1;
+    }
+    CHECK(scheduler.size() == remaining);
+
+    qint64 previous = 0;
+    int taken = 0;
+    while (!scheduler.isEmpty()) {
+        const QueuedRequest next = scheduler.dequeue(0);
+        const int i = next.id.toInt();
+        CHECK(i >= 0 && i < 100 && !cancelled[i]);
+        CHECK(next.deadline == deadlines.at(i));
+        CHECK(next.deadline >= previous);
+        previous = next.deadline;
+        ++taken;
+    }
+    CHECK(taken == remaining);
+
+    // Последний элемент кучи, вставший на место удалённого, меньше его родителя
+    // и должен подняться: куча 1, 60, 50, 61, 62, 70, 55 без 61
+    RequestScheduler small(0, 1, RequestScheduler::DeadlinePolicy);
+    const qint64 order[] = {1, 60, 50, 61, 62, 70, 55};
+    quint32 middle = RequestPool::None;
+    for (qint64 deadline : order) {
+        const quint32 slot = small.enqueue(timed("r", deadline), 0);
+        if (deadline == 61) {
+            middle = slot;
+        }
+    }
+    small.cancel(middle);
+    const qint64 sorted[] = {1, 50, 55, 60, 62, 70};
+    for (qint64 deadline : sorted) {
+        CHECK(small.dequeue(0).deadline == deadline);
+    }
+    CHECK(small.isEmpty());
+}
+
+// Заявка без срока не истекает и, оказавшись на вершине, заслоняет остальные
+void expiryWithoutDeadline()
+{
+    // Без старения заявка без срока уходит в самый конец кучи
+    RequestScheduler plain(0, 1, RequestScheduler::DeadlinePolicy);
+    plain.enqueue(timed("none", 0), 0);
+    CHECK(plain.nextExpiry() == -1);
+    plain.enqueue(timed("due", 100), 0);
+    CHECK(plain.nextExpiry() == 100);
+    QList<QueuedRequest> expired;
+    plain.takeExpired(99, expired);
+    CHECK(expired.isEmpty());
+    plain.takeExpired(100, expired);
+    CHECK(expired.size() == 1 && expired.first().id == QString("due"));
+    CHECK(plain.nextExpiry() == -1);
+    expired.clear();
+    plain.takeExpired(1000000, expired);
+    CHECK(expired.isEmpty());
+    CHECK(plain.size() == 1);
+
+    // Со старением условный срок заявки без срока может оказаться раньше настоящих
+    RequestScheduler aging(10, 1, RequestScheduler::DeadlinePolicy);
+    aging.enqueue(timed("none", 0, RequestScheduler::HighestPriority), 0);  // Условный срок 10
+    aging.enqueue(timed("due", 100), 0);
+    CHECK(aging.nextExpiry() == -1);
+    aging.takeExpired(200, expired);
+    CHECK(expired.isEmpty());
+    CHECK(aging.dequeue(200).id == QString("none"));
+    CHECK(aging.nextExpiry() == 100);
+    aging.takeExpired(200, expired);
+    CHECK(expired.size() == 1 && expired.first().id == QString("due"));
+    CHECK(aging.isEmpty());
+}
+
+} // namespace
+
+int main()
+{
+    priorityOrder();
+    fifoWithinLevel();
+    agingPromotion();
+    emptyBucketBitmap();
+    deadlineOrder();
+    equalDeadlinesFifo();
+    cancelFromMiddle();
+    expiryWithoutDeadline();
+    return Check::result("request_scheduler");
+}
@@ -0,0 +1,8 @@
+TEMPLATE = subdirs
+
+SUBDIRS = \
+    fragment_reassembler \
+    jsonrpc_parser \
+    request_log \
+    request_scheduler \
+    udp_transport
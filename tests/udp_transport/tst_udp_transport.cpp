@@ -0,0 +1,260 @@
+#include "udp_transport.h"
+#include "uring_socket.h"
+#include "../check.h"
+#include <QCoreApplication>
+#include <QDeadlineTimer>
+
+#ifdef Q_OS_LINUX
+#include <QSet>
+#include <linux/filter.h>
+#include <linux/seccomp.h>
+#include <sys/prctl.h>
+#include <sys/socket.h>
+#include <sys/syscall.h>
+#include <netinet/in.h>
+#include <poll.h>
+#include <unistd.h>
+#include <cerrno>
+#include <cstddef>
+#include <cstring>
+
+namespace {
+
+// Неблокирующий UDP-сокет на 127.0.0.1 со случайным портом
+int loopbackSocket(quint16 &port)
+{
+    const int fd = socket(AF_INET, SOCK_DGRAM | SOCK_NONBLOCK, 0);
+    sockaddr_in address;
+    memset(&address, 0, sizeof(address));
+    address.sin_family = AF_INET;
+    address.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+    socklen_t size = sizeof(address);
+    if (fd < 0 || bind(fd, reinterpret_cast<sockaddr *>(&address), size) != 0
+            || getsockname(fd, reinterpret_cast<sockaddr *>(&address), &size) != 0) {
+        return -1;
+    }
+    port = ntohs(address.sin_port);
+    return fd;
+}
+
+sockaddr_in loopback(quint16 port)
+{
+    sockaddr_in address;
+    memset(&address, 0, sizeof(address));
+    address.sin_family = AF_INET;
+    address.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+    address.sin_port = htons(port);
+    return address;
+}
+
+bool sendTo(int fd, quint16 port, const QByteArray &data)
+{
+    const sockaddr_in address = loopback(port);
+    return sendto(fd, data.constData(), size_t(data.size()), 0,
+                  reinterpret_cast<const sockaddr *>(&address), sizeof(address)) == data.size();
+}
+
+// Отвечает отправителю тем же телом
+struct Echo : DatagramHandler
+{
+    QList<QByteArray> received;
+
+    void handleDatagram(QByteArrayView data, const ClientInfo &sender, DatagramSink &reply) override
+    {
+        received.append(data.toByteArray());
+        reply.sendDatagram(data, sender);
+    }
+};
+
+// Каждому отправителю два ответа, а между ними — ответ на порт 0, который ядро отвергает
+struct SplitReply : DatagramHandler
+{
+    void handleDatagram(QByteArrayView data, const ClientInfo &sender, DatagramSink &reply) override
+    {
+        reply.sendDatagram(data, sender);
+        ClientInfo invalid = sender;
+        invalid.port = 0;
+        reply.sendDatagram("lost", invalid);
+        reply.sendDatagram("after", sender);
+    }
+};
+
+// Ядро «без io_uring»: io_uring_setup отвечает ENOSYS до конца процесса
+bool disableIoUring()
+{
+#ifdef __NR_io_uring_setup
+    sock_filter filter[] = {
+        BPF_STMT(BPF_LD | BPF_W | BPF_ABS, offsetof(seccomp_data, nr)),
+        BPF_JUMP(BPF_JMP | BPF_JEQ | BPF_K, __NR_io_uring_setup, 0, 1),
+        BPF_STMT(BPF_RET | BPF_K, SECCOMP_RET_ERRNO | ENOSYS),
+        BPF_STMT(BPF_RET | BPF_K, SECCOMP_RET_ALLOW),
+    };
+    sock_fprog program = {sizeof(filter) / sizeof(filter[0]), filter};
+    return prctl(PR_SET_NO_NEW_PRIVS, 1, 0, 0, 0) == 0
+            && prctl(PR_SET_SECCOMP, SECCOMP_MODE_FILTER, &program) == 0;
+#else
+    return true;  // Номера вызова нет — io_uring недоступен и так
+#endif
+}
+
+// Приём и отправка через настоящее кольцо на петлевом интерфейсе
+void uringLoopback()
+{
+#ifdef HAVE_IO_URING
+    quint16 serverPort, clientPort;
+    const int server = loopbackSocket(serverPort);
+    const int client = loopbackSocket(clientPort);
+    CHECK(server >= 0 && client >= 0);
+
+    {
+        UringSocket uring(server);
+        // Буферов меньше, чем датаграмм: приём перезаряжается после ENOBUFS
+        if (!uring.start(16, UdpTransport::MaxDatagramSize)) {
+            Check::skip("uringLoopback", "io_uring is unavailable");
+        } else {
+            const int count = 100;
+            for (int i = 0; i < count; ++i) {
+                CHECK(sendTo(client, serverPort, "request " + QByteArray::number(i)));
+            }
+            CHECK(sendTo(client, serverPort, QByteArray(UdpTransport::MaxDatagramSize + 1, 'x')));
+
+            QSet<QByteArray> bodies;
+            int truncated = 0;
+            const QDeadlineTimer deadline(5000);
+            while (bodies.size() + truncated < count + 1 && !deadline.hasExpired()) {
+                pollfd ready = {uring.descriptor(), POLLIN, 0};
+                poll(&ready, 1, 10);
+                QList<UringSocket::Received> received;
+                uring.receive(received);
+                for (const UringSocket::Received &datagram : std::as_const(received)) {
+                    if (datagram.truncated) {
+                        ++truncated;
+                        continue;
+                    }
+                    bodies.insert(datagram.data.toByteArray());
+                    const sockaddr_in &sender = reinterpret_cast<const sockaddr_in &>(datagram.sender);
+                    CHECK(ntohs(sender.sin_port) == clientPort);
+                }
+                uring.recycle();
+            }
+            CHECK(bodies.size() == count);
+            CHECK(bodies.contains("request 0") && bodies.contains("request 99"));
+            CHECK(truncated == 1);
+
+            // Ответы уходят цепочкой и все доходят
+            sockaddr_in to = loopback(clientPort);
+            QByteArray replies[8];
+            iovec parts[8];
+            mmsghdr messages[8];
+            for (int i = 0; i < 8; ++i) {
+                replies[i] = "reply " + QByteArray::number(i);
+                parts[i].iov_base = replies[i].data();
+                parts[i].iov_len = size_t(replies[i].size());
+                memset(&messages[i], 0, sizeof(messages[i]));
+                messages[i].msg_hdr.msg_name = &to;
+                messages[i].msg_hdr.msg_namelen = sizeof(to);
+                messages[i].msg_hdr.msg_iov = &parts[i];
+                messages[i].msg_hdr.msg_iovlen = 1;
+            }
+            CHECK(uring.send(messages, 8) == 8);
+            char buffer[64];
+            int delivered = 0;
+            while (recv(client, buffer, sizeof(buffer), 0) > 0) {
+                ++delivered;
+            }
+            CHECK(delivered == 8);
+        }
+    }
+    close(server);
+    close(client);
+#else
+    Check::skip("uringLoopback", "built without io_uring support");
+#endif
+}
+
+// Без io_uring транспорт сам переходит на recvmmsg и продолжает отвечать
+void fallbackToRecvmmsg()
+{
+    if (!disableIoUring()) {
+        Check::skip("fallbackToRecvmmsg", "cannot install a seccomp filter");
+        return;
+    }
+#ifdef HAVE_IO_URING
+    quint16 unused;
+    const int socket = loopbackSocket(unused);
+    {
+        UringSocket uring(socket);
+        CHECK(!uring.start(16, UdpTransport::MaxDatagramSize));
+    }
+    close(socket);
+#endif
+
+    Echo echo;
+    UdpTransport transport(&echo, UdpTransport::DefaultBatchSize, UdpTransport::IoUringBackend);
+    CHECK(transport.bind(0));
+    CHECK(transport.activeBackend() == UdpTransport::SocketBackend);
+
+    sockaddr_in address;
+    socklen_t size = sizeof(address);
+    CHECK(getsockname(transport.descriptor(), reinterpret_cast<sockaddr *>(&address), &size) == 0);
+    const quint16 serverPort = ntohs(address.sin_port);
+
+    quint16 clientPort;
+    const int client = loopbackSocket(clientPort);
+    CHECK(sendTo(client, serverPort, "{\"ping\":1}"));
+
+    char buffer[64];
+    qint64 length = -1;
+    const QDeadlineTimer deadline(5000);
+    while (length < 0 && !deadline.hasExpired()) {
+        QCoreApplication::processEvents(QEventLoop::AllEvents, 10);
+        length = recv(client, buffer, sizeof(buffer), 0);
+    }
+    CHECK(echo.received.size() == 1);
+    CHECK(QByteArray(buffer, int(qMax<qint64>(0, length))) == "{\"ping\":1}");
+    close(client);
+}
+
+// Ошибка отправки одного сообщения пачки не теряет следующие за ним
+void sendErrorSkipsMessage()
+{
+    SplitReply handler;
+    UdpTransport transport(&handler);
+    CHECK(transport.bind(0));
+
+    quint16 clientPort;
+    const int client = loopbackSocket(clientPort);
+    CHECK(sendTo(client, transport.localPort(), "first"));
+
+    QList<QByteArray> replies;
+    char buffer[64];
+    const QDeadlineTimer deadline(5000);
+    while (replies.size() < 2 && !deadline.hasExpired()) {
+        QCoreApplication::processEvents(QEventLoop::AllEvents, 10);
+        const qint64 length = recv(client, buffer, sizeof(buffer), 0);
+        if (length >= 0) {
+            replies.append(QByteArray(buffer, int(length)));
+        }
+    }
+    CHECK(replies.size() == 2);
+    CHECK(replies.value(0) == "first");
+    CHECK(replies.value(1) == "after");
+    close(client);
+}
+
+} // namespace
+#endif
+
+int main(int argc, char *argv[])
+{
+    QCoreApplication application(argc, argv);
+#ifdef Q_OS_LINUX
+    uringLoopback();
+    sendErrorSkipsMessage();
+    // Последним: фильтр seccomp не снимается
+    fallbackToRecvmmsg();
+#else
+    Check::skip("udp_transport", "recvmmsg and io_uring are Linux-only");
+#endif
+    return Check::result("udp_transport");
+}
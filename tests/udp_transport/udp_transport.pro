@@ -0,0 +1,19 @@
+QT = core network
+
+CONFIG += c++17 console testcase
+CONFIG -= app_bundle
+
+TARGET = tst_udp_transport
+INCLUDEPATH += ../..
+
+SOURCES += \
+    tst_udp_transport.cpp \
+    ../../fragment_reassembler.cpp \
+    ../../logger.cpp \
+    ../../metrics.cpp \
+    ../../udp_transport.cpp \
+    ../../uring_socket.cpp
+
+HEADERS += \
+    ../check.h \
+    ../../udp_transport.h
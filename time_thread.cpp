@@ -1,25 +1,56 @@
 #include "time_thread.h"
 #include <QThread>
 #include <QDateTime>
+#include <QDeadlineTimer>
+#include <limits>
+
+namespace {
+
+const qint64 Forever = std::numeric_limits<qint64>::max();
+
+} // namespace
 
 TimeThread::TimeThread(QObject *parent)
-    : QThread(parent), running(true)
+    : QThread(parent), deadline(Forever), running(true)
 {
 }
 
 void TimeThread::run()
 {
+    QMutexLocker locker(&mutex);
     while (running) {
-        QThread::sleep(1); // Таймер 1 секунда
+        if (deadline == Forever) {
+            condition.wait(&mutex);  // Работы нет — спим до wakeAt() или stop()
+            continue;
+        }
 
-        if (running) {
-            QDateTime currentTime = QDateTime::currentDateTime();
-            emit tick(currentTime);
+        if (QDeadlineTimer::current(Qt::PreciseTimer).deadline() < deadline) {
+            QDeadlineTimer timer(Qt::PreciseTimer);
+            timer.setDeadline(deadline, Qt::PreciseTimer);
+            condition.wait(&mutex, timer);  // Срок мог сдвинуться раньше — проверяем заново
+            continue;
         }
+
+        deadline = Forever;
+        locker.unlock();
+        QDateTime currentTime = QDateTime::currentDateTime();
+        emit tick(currentTime);
+        locker.relock();
     }
 }
 
 void TimeThread::stop()
 {
+    QMutexLocker locker(&mutex);
     running = false;
+    condition.wakeOne();
+}
+
+void TimeThread::wakeAt(qint64 at)
+{
+    QMutexLocker locker(&mutex);
+    if (at < deadline) {
+        deadline = at;
+        condition.wakeOne();
+    }
 }
@@ -3,7 +3,12 @@
 
 #include <QThread>
 #include <QDateTime>
+#include <QMutex>
+#include <QWaitCondition>
 
+// Поток времени: спит, пока ему не назначен срок, и испускает tick ровно
+// в назначенный момент (монотонные мс, как у QDeadlineTimer::current()).
+// Между сроками тиков нет — простаивающий сервер не просыпается.
 class TimeThread : public QThread
 {
     Q_OBJECT
@@ -13,10 +18,16 @@ public:
     void run() override;
     void stop(); // Добавьте эту строку
 
+    // Назначает тик на момент at, если он раньше уже назначенного
+    void wakeAt(qint64 at);
+
 signals:
     void tick(const QDateTime &currentTime);
 
 private:
+    QMutex mutex;
+    QWaitCondition condition;
+    qint64 deadline;  // Срок ближайшего тика, Forever — тик не назначен
     bool running;
 };
 
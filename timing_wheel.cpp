@@ -0,0 +1,147 @@
+#include "timing_wheel.h"
+#include <QtAlgorithms>
+#include <utility>
+
+TimingWheel::TimingWheel(qint64 now)
+    : current(qMax<qint64>(0, now))
+    , count(0)
+    , cancelled(0)
+{
+    for (quint64 &bits : occupied)
+        bits = 0;
+}
+
+quint32 TimingWheel::schedule(const QueuedRequest &request, qint64 due)
+{
+    const quint32 slot = pool.acquire(request);
+    place(Entry{qMax(due, current), slot});
+    ++count;
+    return slot;
+}
+
+void TimingWheel::cancel(quint32 slot)
+{
+    PooledRequest &record = pool.at(slot);
+    if (record.flags & PooledRequest::Cancelled)
+        return;
+    record.flags |= PooledRequest::Cancelled;
+    // Остались одни отменённые — колесо сбрасывается, не дожидаясь их сроков
+    if (++cancelled == count)
+        clear();
+}
+
+void TimingWheel::place(const Entry &entry)
+{
+    // Уровень — самый нижний, в чей интервал вместе с current попадает срок
+    for (int level = 0; level < Levels; ++level) {
+        const int shift = level * SlotBits;
+        if ((entry.due >> (shift + SlotBits)) == (current >> (shift + SlotBits))) {
+            const int slot = int(entry.due >> shift) & SlotMask;
+            wheel[level][slot].append(entry);
+            occupied[level] |= quint64(1) << slot;
+            return;
+        }
+    }
+    overflow.append(entry);
+}
+
+void TimingWheel::cascade(QList<Entry> &entries)
+{
+    QList<Entry> moved;
+    moved.swap(entries);
+    for (const Entry &entry : std::as_const(moved))
+        place(entry);
+}
+
+qint64 TimingWheel::nextDeadline() const
+{
+    if (count == 0)
+        return -1;
+
+    // События нижнего уровня всегда раньше событий верхних,
+    // поэтому достаточно первого непустого уровня
+    for (int level = 0; level < Levels; ++level) {
+        const int shift = level * SlotBits;
+        const int position = int(current >> shift) & SlotMask;
+        // На нулевом уровне срок может совпадать с current, на верхних —
+        // только следующие интервалы: текущий уже спущен вниз
+        const int first = level == 0 ? position : position + 1;
+        if (first >= Slots)
+            continue;
+        const quint64 pending = occupied[level] & (~quint64(0) << first);
+        if (pending == 0)
+            continue;
+        const qint64 base = current >> (shift + SlotBits) << (shift + SlotBits);
+        return base + (qint64(qCountTrailingZeroBits(pending)) << shift);
+    }
+    return ((current >> SpanBits) + 1) << SpanBits;
+}
+
+void TimingWheel::advance(qint64 now, QList<QueuedRequest> &expired)
+{
+    while (count > 0) {
+        const qint64 next = nextDeadline();
+        if (next > now)
+            break;
+
+        // Пустые интервалы между current и next пропускаются целиком
+        current = next;
+        if ((current & ((qint64(1) << SpanBits) - 1)) == 0)
+            cascade(overflow);
+        for (int level = Levels - 1; level > 0; --level) {
+            const int shift = level * SlotBits;
+            if ((current & ((qint64(1) << shift) - 1)) != 0)
+                continue;
+            const int slot = int(current >> shift) & SlotMask;
+            occupied[level] &= ~(quint64(1) << slot);
+            cascade(wheel[level][slot]);
+        }
+
+        const int slot = int(current) & SlotMask;
+        occupied[0] &= ~(quint64(1) << slot);
+        QList<Entry> &due = wheel[0][slot];
+        for (const Entry &entry : std::as_const(due)) {
+            if (pool.at(entry.request).flags & PooledRequest::Cancelled) {
+                pool.release(entry.request);
+                --cancelled;
+            } else {
+                expired.append(pool.take(entry.request));
+            }
+        }
+        count -= int(due.size());
+        due.clear();
+    }
+    if (now > current)
+        current = now;
+}
+
+void TimingWheel::takeAll(QList<QueuedRequest> &requests, QList<qint64> &due)
+{
+    const auto take = [&](const QList<Entry> &entries) {
+        for (const Entry &entry : entries) {
+            if (!(pool.at(entry.request).flags & PooledRequest::Cancelled)) {
+                requests.append(pool.take(entry.request));
+                due.append(entry.due);
+            }
+        }
+    };
+    for (int level = 0; level < Levels; ++level) {
+        for (const QList<Entry> &slot : wheel[level])
+            take(slot);
+    }
+    take(overflow);
+    clear();
+}
+
+void TimingWheel::clear()
+{
+    for (int level = 0; level < Levels; ++level) {
+        for (QList<Entry> &slot : wheel[level])
+            slot.clear();
+        occupied[level] = 0;
+    }
+    overflow.clear();
+    pool.clear();
+    count = 0;
+    cancelled = 0;
+}
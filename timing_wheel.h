@@ -0,0 +1,65 @@
+#ifndef TIMING_WHEEL_H
+#define TIMING_WHEEL_H
+
+#include <QList>
+#include "request.h"
+#include "request_pool.h"
+
+// Иерархическое колесо таймеров для отложенных заявок с точностью 1 мс.
+// Четыре уровня по 64 слота охватывают 2^24 мс (около 4,6 часа) вперёд,
+// более дальние заявки ждут в отдельном списке. Вставка — O(1); при
+// продвижении времени пустые интервалы пропускаются по битовым картам,
+// а заявки верхних уровней спускаются вниз, когда начинается их интервал.
+// Время — монотонные миллисекунды, как у QDeadlineTimer::current().
+// Слоты хранят только срок и номер заявки в RequestPool, поэтому спуск
+// между уровнями не копирует сами заявки.
+class TimingWheel
+{
+public:
+    explicit TimingWheel(qint64 now = 0);
+
+    // Возвращает номер записи для at() и cancel(); он действителен до срока
+    quint32 schedule(const QueuedRequest &request, qint64 due);
+    // Отменённая заявка остаётся в слоте и отбрасывается, когда наступит её срок
+    void cancel(quint32 slot);
+    // Переносит в expired все заявки со сроком не позже now
+    void advance(qint64 now, QList<QueuedRequest> &expired);
+    // Ближайший момент, когда колесу нужно продвижение, или -1, если оно пусто.
+    // Это может быть и момент спуска заявок с верхнего уровня — он не позже их срока.
+    qint64 nextDeadline() const;
+    // Забирает все неотменённые заявки вместе со сроками и очищает колесо
+    void takeAll(QList<QueuedRequest> &requests, QList<qint64> &due);
+    void clear();
+
+    bool isEmpty() const { return count == cancelled; }
+    int size() const { return count - cancelled; }
+
+    const PooledRequest &at(quint32 slot) const { return pool.at(slot); }
+
+private:
+    enum {
+        Levels = 4,
+        SlotBits = 6,
+        Slots = 1 << SlotBits,
+        SlotMask = Slots - 1,
+        SpanBits = Levels * SlotBits
+    };
+
+    struct Entry {
+        qint64 due;
+        quint32 request;  // Номер записи в pool
+    };
+
+    void place(const Entry &entry);
+    void cascade(QList<Entry> &entries);
+
+    RequestPool pool;
+    QList<Entry> wheel[Levels][Slots];
+    QList<Entry> overflow;       // Сроки дальше охвата колеса
+    quint64 occupied[Levels];    // Бит i установлен, если слот i уровня не пуст
+    qint64 current;              // Всё со сроком раньше current уже выдано
+    int count;                   // Записей, включая отменённые
+    int cancelled;
+};
+
+#endif // TIMING_WHEEL_H
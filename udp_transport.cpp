@@ -0,0 +1,699 @@
+#include "udp_transport.h"
+#include "logger.h"
+#include "metrics.h"
+#include <QDeadlineTimer>
+
+#ifdef Q_OS_LINUX
+#include <QVarLengthArray>
+#include <sys/socket.h>
+#include <netinet/in.h>
+#include <netinet/udp.h>
+#include <unistd.h>
+#include <cerrno>
+#include <cstring>
+#include <utility>
+
+#ifndef UDP_SEGMENT
+#define UDP_SEGMENT 103
+#endif
+
+namespace {
+
+const int MaxRoundsPerWakeup = 16;  // Пачек за одно пробуждение, чтобы не голодал цикл событий
+const int MaxSendBatch = 1024;      // UIO_MAXIOV
+const int MaxGsoSegments = 64;      // UDP_MAX_SEGMENTS в ядре
+const int MaxGsoPayload = 65000;    // Суммарный размер склеенного сообщения
+const int MaxBlockedReplies = 65536;  // Ответов, ждущих готовности переполненного сокета к записи
+
+union ControlBuffer {
+    char data[CMSG_SPACE(sizeof(quint16))];
+    cmsghdr align;
+};
+
+// Счётчик отброшенных ядром датаграмм (SO_RXQ_OVFL) при каждом сообщении
+union DropsBuffer {
+    char data[CMSG_SPACE(sizeof(quint32))];
+    cmsghdr align;
+};
+
+ClientInfo toClientInfo(const sockaddr_storage &address)
+{
+    ClientInfo client;
+    client.address.setAddress(reinterpret_cast<const sockaddr *>(&address));
+    bool isIPv4;
+    const quint32 ipv4 = client.address.toIPv4Address(&isIPv4);
+    if (isIPv4) {
+        client.address.setAddress(ipv4);  // ::ffff:a.b.c.d → a.b.c.d
+    }
+    client.port = address.ss_family == AF_INET6
+            ? ntohs(reinterpret_cast<const sockaddr_in6 &>(address).sin6_port)
+            : ntohs(reinterpret_cast<const sockaddr_in &>(address).sin_port);
+    return client;
+}
+
+// Возвращает 0, если адрес клиента нельзя выразить в семействе сокета
+socklen_t toSockaddr(const ClientInfo &client, int family, sockaddr_storage &address)
+{
+    memset(&address, 0, sizeof(address));
+    bool isIPv4;
+    const quint32 ipv4 = client.address.toIPv4Address(&isIPv4);
+
+    if (family == AF_INET) {
+        if (!isIPv4) {
+            return 0;
+        }
+        sockaddr_in &in = reinterpret_cast<sockaddr_in &>(address);
+        in.sin_family = AF_INET;
+        in.sin_port = htons(client.port);
+        in.sin_addr.s_addr = htonl(ipv4);
+        return sizeof(in);
+    }
+
+    sockaddr_in6 &in6 = reinterpret_cast<sockaddr_in6 &>(address);
+    in6.sin6_family = AF_INET6;
+    in6.sin6_port = htons(client.port);
+    if (isIPv4) {
+        const quint32 networkOrder = htonl(ipv4);
+        in6.sin6_addr.s6_addr[10] = 0xff;
+        in6.sin6_addr.s6_addr[11] = 0xff;
+        memcpy(in6.sin6_addr.s6_addr + 12, &networkOrder, sizeof(networkOrder));
+    } else {
+        const Q_IPV6ADDR ipv6 = client.address.toIPv6Address();
+        memcpy(in6.sin6_addr.s6_addr, ipv6.c, sizeof(in6.sin6_addr.s6_addr));
+    }
+    return sizeof(in6);
+}
+
+} // namespace
+#endif
+
+UdpTransport::UdpTransport(DatagramHandler *handler, int batchSize, Backend backend, QObject *parent)
+    : QObject(parent)
+    , handler(handler)
+    , batchSize(qBound(1, batchSize, 1024))
+    , backend(backend)
+    , inBatch(false)
+    , socket(nullptr)
+    , reassemblyTimer(new QTimer(this))
+#ifdef Q_OS_LINUX
+    , fd(-1)
+    , family(AF_INET6)
+    , gso(true)
+    , socketDrops(0)
+    , notifier(nullptr)
+    , writeNotifier(nullptr)
+#endif
+#ifdef HAVE_IO_URING
+    , uring(nullptr)
+#endif
+{
+    reassemblyTimer->setInterval(FragmentReassembler::NackDelay / 2);
+    connect(reassemblyTimer, &QTimer::timeout, this, &UdpTransport::onReassemblyTimer);
+}
+
+UdpTransport::~UdpTransport()
+{
+    close();
+}
+
+bool UdpTransport::bind(quint16 port, bool reusePort)
+{
+#ifdef Q_OS_LINUX
+    return bindNative(port, reusePort);
+#else
+    socket = new QUdpSocket(this);
+    QAbstractSocket::BindMode mode = QAbstractSocket::DefaultForPlatform;
+    if (reusePort) {
+        mode = QAbstractSocket::ShareAddress | QAbstractSocket::ReuseAddressHint;
+    }
+    if (!socket->bind(QHostAddress::Any, port, mode)) {
+        return false;
+    }
+    connect(socket, &QUdpSocket::readyRead, this, &UdpTransport::onReadyRead);
+    return true;
+#endif
+}
+
+bool UdpTransport::adopt(int descriptor)
+{
+#ifdef Q_OS_LINUX
+    int type = 0;
+    socklen_t typeSize = sizeof(type);
+    sockaddr_storage address;
+    socklen_t addressSize = sizeof(address);
+    if (getsockopt(descriptor, SOL_SOCKET, SO_TYPE, &type, &typeSize) != 0 || type != SOCK_DGRAM
+            || getsockname(descriptor, reinterpret_cast<sockaddr *>(&address), &addressSize) != 0) {
+        return false;
+    }
+    fd = descriptor;
+    family = address.ss_family;
+    const int on = 1;
+    setsockopt(fd, SOL_SOCKET, SO_RXQ_OVFL, &on, sizeof(on));
+    startReceiving();
+    return true;
+#else
+    socket = new QUdpSocket(this);
+    if (!socket->setSocketDescriptor(descriptor, QAbstractSocket::BoundState)) {
+        return false;
+    }
+    connect(socket, &QUdpSocket::readyRead, this, &UdpTransport::onReadyRead);
+    return true;
+#endif
+}
+
+bool UdpTransport::pause()
+{
+    flush();
+#ifdef Q_OS_LINUX
+#ifdef HAVE_IO_URING
+    if (uring) {
+        // Датаграммы, уже снятые кольцом с сокета, обрабатываются здесь:
+        // у преемника их не будет
+        if (!uring->cancelReceive()) {
+            return false;
+        }
+        do {
+            receiveCompletions();
+        } while (uring->hasPending());
+    }
+#endif
+    delete notifier;
+    notifier = nullptr;
+#ifdef HAVE_IO_URING
+    delete uring;
+    uring = nullptr;
+#endif
+#else
+    disconnect(socket, &QUdpSocket::readyRead, this, &UdpTransport::onReadyRead);
+#endif
+    return true;
+}
+
+void UdpTransport::resume()
+{
+#ifdef Q_OS_LINUX
+    if (fd >= 0 && !notifier) {
+        startReceiving();
+    }
+#else
+    connect(socket, &QUdpSocket::readyRead, this, &UdpTransport::onReadyRead, Qt::UniqueConnection);
+#endif
+    // Датаграммы, пришедшие за паузу, уведомления могут уже не дать
+    if (descriptor() >= 0) {
+        QMetaObject::invokeMethod(this, &UdpTransport::onReadyRead, Qt::QueuedConnection);
+    }
+}
+
+int UdpTransport::descriptor() const
+{
+#ifdef Q_OS_LINUX
+    return fd;
+#else
+    return socket ? int(socket->socketDescriptor()) : -1;
+#endif
+}
+
+quint16 UdpTransport::localPort() const
+{
+#ifdef Q_OS_LINUX
+    sockaddr_storage address;
+    socklen_t length = sizeof(address);
+    if (fd < 0 || ::getsockname(fd, reinterpret_cast<sockaddr *>(&address), &length) != 0) {
+        return 0;
+    }
+    if (address.ss_family == AF_INET6) {
+        return ntohs(reinterpret_cast<const sockaddr_in6 *>(&address)->sin6_port);
+    }
+    return ntohs(reinterpret_cast<const sockaddr_in *>(&address)->sin_port);
+#else
+    return socket ? socket->localPort() : 0;
+#endif
+}
+
+void UdpTransport::close()
+{
+#ifdef Q_OS_LINUX
+    // Последняя попытка отправить ответы, ждавшие переполненного сокета
+    delete writeNotifier;
+    writeNotifier = nullptr;
+#endif
+    flush();
+#ifdef Q_OS_LINUX
+    if (!pending.isEmpty()) {
+        LOG_WARNING("Socket closed with %1 unsent datagram(s)", pending.size());
+        pending.resize(0);
+        outgoing.resize(0);
+    }
+    delete notifier;
+    notifier = nullptr;
+#ifdef HAVE_IO_URING
+    delete uring;  // До закрытия сокета: кольцо ещё ссылается на него
+    uring = nullptr;
+#endif
+    if (fd >= 0) {
+        ::close(fd);
+        fd = -1;
+    }
+#endif
+    if (socket) {
+        socket->close();
+    }
+}
+
+void UdpTransport::sendDatagram(QByteArrayView data, const ClientInfo &client)
+{
+#ifdef Q_OS_LINUX
+    if (writeNotifier && writeNotifier->isEnabled() && pending.size() >= MaxBlockedReplies) {
+        LOG_SAMPLED(Logger::Warning, "Send buffer is full, dropping datagram to %1:%2",
+                    client.address.toString(), client.port);
+        return;
+    }
+#endif
+    const Reply reply = {outgoing.size(), data.size(), client};
+    outgoing.append(data.data(), data.size());
+    pending.append(reply);
+    if (!inBatch) {
+        flush();
+    }
+}
+
+void UdpTransport::flush()
+{
+    if (pending.isEmpty()) {
+        return;
+    }
+#ifdef Q_OS_LINUX
+    if (fd >= 0) {
+        if (writeNotifier && writeNotifier->isEnabled()) {
+            return;  // Сокет переполнен: очередь уйдёт целиком, когда он примет запись
+        }
+        const int sent = sendBatch(0, int(pending.size()));
+        if (sent < pending.size()) {
+            // EAGAIN: остаток, в том же порядке, ждёт готовности сокета к записи
+            Metrics::add(Metrics::DatagramsSent, quint64(sent));
+            removeSent(sent);
+            if (!writeNotifier) {
+                writeNotifier = new QSocketNotifier(fd, QSocketNotifier::Write, this);
+                connect(writeNotifier, &QSocketNotifier::activated, this, [this] {
+                    writeNotifier->setEnabled(false);
+                    flush();
+                });
+            }
+            writeNotifier->setEnabled(true);
+            return;
+        }
+    }
+#else
+    for (const Reply &reply : pending) {
+        socket->writeDatagram(outgoing.constData() + reply.offset, reply.size, reply.client.address, reply.client.port);
+    }
+#endif
+    Metrics::add(Metrics::DatagramsSent, quint64(pending.size()));
+    pending.resize(0);   // Ёмкость обоих буферов сохраняется между пачками
+    outgoing.resize(0);
+}
+
+bool UdpTransport::backendFromName(const QString &name, Backend &backend)
+{
+    static const char *const names[] = {"sockets", "io_uring"};
+    for (int i = SocketBackend; i <= IoUringBackend; ++i) {
+        if (name.compare(QLatin1String(names[i]), Qt::CaseInsensitive) == 0) {
+            backend = Backend(i);
+            return true;
+        }
+    }
+    return false;
+}
+
+void UdpTransport::onReadyRead()
+{
+#ifdef HAVE_IO_URING
+    if (uring) {
+        for (int round = 0; round < MaxRoundsPerWakeup; ++round) {
+            if (receiveCompletions() == 0) {
+                break;
+            }
+        }
+        if (uring->hasPending()) {
+            // Завершения, снятые во время отправки, кольцо уже не просигналит
+            QMetaObject::invokeMethod(this, &UdpTransport::onReadyRead, Qt::QueuedConnection);
+        }
+        return;
+    }
+#endif
+#ifdef Q_OS_LINUX
+    for (int round = 0; round < MaxRoundsPerWakeup; ++round) {
+        if (receiveBatch() < batchSize) {
+            break;
+        }
+    }
+#else
+    inBatch = true;
+    while (socket->hasPendingDatagrams()) {
+        QByteArray data;
+        data.resize(socket->pendingDatagramSize());
+        ClientInfo sender;
+        socket->readDatagram(data.data(), data.size(), &sender.address, &sender.port);
+        deliver(data, sender);
+    }
+    inBatch = false;
+    flush();
+#endif
+}
+
+void UdpTransport::deliver(QByteArrayView data, const ClientInfo &sender)
+{
+    if (!FragmentReassembler::isFragment(data)) {
+        handler->handleDatagram(data, sender, *this);
+        return;
+    }
+    const QByteArrayView message = reassembler.add(data, sender, QDeadlineTimer::current().deadline());
+    if (!message.isEmpty()) {
+        handler->handleDatagram(message, sender, *this);
+    }
+    if (!reassembler.isEmpty() && !reassemblyTimer->isActive()) {
+        reassemblyTimer->start();
+    }
+}
+
+void UdpTransport::onReassemblyTimer()
+{
+    // NACK всех затихших сборок уходят одной пачкой
+    inBatch = true;
+    reassembler.expire(QDeadlineTimer::current().deadline(), *this);
+    inBatch = false;
+    flush();
+    if (reassembler.isEmpty()) {
+        reassemblyTimer->stop();
+    }
+}
+
+#ifdef Q_OS_LINUX
+bool UdpTransport::bindNative(quint16 port, bool reusePort)
+{
+    const int on = 1;
+
+    // Двойной стек, как QHostAddress::Any у QUdpSocket
+    fd = ::socket(AF_INET6, SOCK_DGRAM | SOCK_NONBLOCK | SOCK_CLOEXEC, 0);
+    if (fd >= 0) {
+        const int off = 0;
+        setsockopt(fd, IPPROTO_IPV6, IPV6_V6ONLY, &off, sizeof(off));
+        if (reusePort) {
+            setsockopt(fd, SOL_SOCKET, SO_REUSEPORT, &on, sizeof(on));
+        }
+
+        sockaddr_in6 any;
+        memset(&any, 0, sizeof(any));
+        any.sin6_family = AF_INET6;
+        any.sin6_addr = in6addr_any;
+        any.sin6_port = htons(port);
+        if (::bind(fd, reinterpret_cast<sockaddr *>(&any), sizeof(any)) == 0) {
+            family = AF_INET6;
+        } else {
+            ::close(fd);
+            fd = -1;
+        }
+    }
+
+    if (fd < 0) {
+        // IPv6 недоступен — только IPv4
+        fd = ::socket(AF_INET, SOCK_DGRAM | SOCK_NONBLOCK | SOCK_CLOEXEC, 0);
+        if (fd < 0) {
+            return false;
+        }
+        if (reusePort) {
+            setsockopt(fd, SOL_SOCKET, SO_REUSEPORT, &on, sizeof(on));
+        }
+
+        sockaddr_in any;
+        memset(&any, 0, sizeof(any));
+        any.sin_family = AF_INET;
+        any.sin_addr.s_addr = htonl(INADDR_ANY);
+        any.sin_port = htons(port);
+        if (::bind(fd, reinterpret_cast<sockaddr *>(&any), sizeof(any)) != 0) {
+            ::close(fd);
+            fd = -1;
+            return false;
+        }
+        family = AF_INET;
+    }
+
+    setsockopt(fd, SOL_SOCKET, SO_RXQ_OVFL, &on, sizeof(on));
+    startReceiving();
+    return true;
+}
+
+void UdpTransport::startReceiving()
+{
+#ifdef HAVE_IO_URING
+    if (backend == IoUringBackend) {
+        // Буферов с запасом на несколько пачек: они возвращаются ядру только после обработки
+        uring = new UringSocket(fd);
+        if (uring->start(batchSize * 8, MaxDatagramSize)) {
+            notifier = new QSocketNotifier(uring->descriptor(), QSocketNotifier::Read, this);
+            connect(notifier, &QSocketNotifier::activated, this, &UdpTransport::onReadyRead);
+            return;
+        }
+        LOG_WARNING("io_uring is unavailable, falling back to recvmmsg");
+        delete uring;
+        uring = nullptr;
+        backend = SocketBackend;
+    }
+#else
+    if (backend == IoUringBackend) {
+        LOG_WARNING("Built without io_uring support, using recvmmsg");
+        backend = SocketBackend;
+    }
+#endif
+    receiveBuffer.resize(qsizetype(batchSize) * MaxDatagramSize);
+    notifier = new QSocketNotifier(fd, QSocketNotifier::Read, this);
+    connect(notifier, &QSocketNotifier::activated, this, &UdpTransport::onReadyRead);
+}
+
+int UdpTransport::receiveBatch()
+{
+    QVarLengthArray<mmsghdr, DefaultBatchSize> messages(batchSize);
+    QVarLengthArray<iovec, DefaultBatchSize> buffers(batchSize);
+    QVarLengthArray<sockaddr_storage, DefaultBatchSize> senders(batchSize);
+    QVarLengthArray<DropsBuffer, DefaultBatchSize> controls(batchSize);
+    char *base = receiveBuffer.data();
+
+    for (int i = 0; i < batchSize; ++i) {
+        buffers[i].iov_base = base + qsizetype(i) * MaxDatagramSize;
+        buffers[i].iov_len = MaxDatagramSize;
+        memset(&messages[i], 0, sizeof(mmsghdr));
+        messages[i].msg_hdr.msg_name = &senders[i];
+        messages[i].msg_hdr.msg_namelen = sizeof(sockaddr_storage);
+        messages[i].msg_hdr.msg_iov = &buffers[i];
+        messages[i].msg_hdr.msg_iovlen = 1;
+        messages[i].msg_hdr.msg_control = controls[i].data;
+        messages[i].msg_hdr.msg_controllen = sizeof(controls[i].data);
+    }
+
+    int received;
+    do {
+        received = recvmmsg(fd, messages.data(), batchSize, MSG_DONTWAIT, nullptr);
+    } while (received < 0 && errno == EINTR);
+
+    if (received <= 0) {
+        if (received < 0 && errno != EAGAIN && errno != EWOULDBLOCK) {
+            LOG_WARNING("recvmmsg failed: %1", strerror(errno));
+        }
+        return 0;
+    }
+
+    inBatch = true;
+    for (int i = 0; i < received; ++i) {
+        if (messages[i].msg_hdr.msg_flags & MSG_TRUNC) {
+            Metrics::add(Metrics::OversizedDatagrams);
+            LOG_SAMPLED(Logger::Warning, "Dropping datagram larger than %1 bytes", int(MaxDatagramSize));
+            continue;
+        }
+        deliver(QByteArrayView(base + qsizetype(i) * MaxDatagramSize, messages[i].msg_len), toClientInfo(senders[i]));
+    }
+    inBatch = false;
+    flush();
+    updateSocketDrops(messages.data(), received);
+    return received;
+}
+
+void UdpTransport::updateSocketDrops(const mmsghdr *messages, int count)
+{
+    // Счётчик накопительный, поэтому достаточно самого свежего значения
+    for (int i = count - 1; i >= 0; --i) {
+        msghdr header = messages[i].msg_hdr;
+        for (cmsghdr *control = CMSG_FIRSTHDR(&header); control; control = CMSG_NXTHDR(&header, control)) {
+            if (control->cmsg_level != SOL_SOCKET || control->cmsg_type != SO_RXQ_OVFL) {
+                continue;
+            }
+            quint32 drops;
+            memcpy(&drops, CMSG_DATA(control), sizeof(drops));
+            Metrics::add(Metrics::SocketDrops, drops - socketDrops);  // Переполнение quint32 учитывается само
+            socketDrops = drops;
+            return;
+        }
+    }
+}
+
+int UdpTransport::sendBatch(int from, int to, bool segment)
+{
+    const int total = to - from;
+    QVarLengthArray<mmsghdr, DefaultBatchSize> messages(total);
+    QVarLengthArray<iovec, DefaultBatchSize> buffers(total);
+    QVarLengthArray<sockaddr_storage, DefaultBatchSize> targets(total);
+    QVarLengthArray<ControlBuffer, DefaultBatchSize> controls(total);
+    QVarLengthArray<int, DefaultBatchSize> firstReply(total);  // Индекс в pending для каждого сообщения
+
+    int count = 0;
+    for (int i = from; i < to; ) {
+        const Reply &head = pending.at(i);
+        const socklen_t length = toSockaddr(head.client, family, targets[count]);
+        if (length == 0 || head.size == 0) {
+            ++i;
+            continue;
+        }
+
+        // Подряд идущие ответы одному адресату склеиваются в одно GSO-сообщение:
+        // все сегменты, кроме последнего, должны быть одного размера
+        const qsizetype segmentSize = head.size;
+        qsizetype payload = segmentSize;
+        int segments = 1;
+        if (gso && segment) {
+            while (i + segments < to && segments < MaxGsoSegments) {
+                const Reply &next = pending.at(i + segments);
+                const qsizetype size = next.size;
+                if (size == 0 || size > segmentSize || payload + size > MaxGsoPayload
+                        || next.client.port != head.client.port || next.client.address != head.client.address) {
+                    break;
+                }
+                payload += size;
+                ++segments;
+                if (size < segmentSize) {
+                    break;
+                }
+            }
+        }
+
+        for (int s = 0; s < segments; ++s) {
+            const Reply &reply = pending.at(i + s);
+            buffers[i - from + s].iov_base = outgoing.data() + reply.offset;
+            buffers[i - from + s].iov_len = reply.size;
+        }
+
+        mmsghdr &message = messages[count];
+        memset(&message, 0, sizeof(message));
+        message.msg_hdr.msg_name = &targets[count];
+        message.msg_hdr.msg_namelen = length;
+        message.msg_hdr.msg_iov = &buffers[i - from];
+        message.msg_hdr.msg_iovlen = segments;
+        if (segments > 1) {
+            message.msg_hdr.msg_control = controls[count].data;
+            message.msg_hdr.msg_controllen = sizeof(controls[count].data);
+            cmsghdr *control = CMSG_FIRSTHDR(&message.msg_hdr);
+            control->cmsg_level = SOL_UDP;
+            control->cmsg_type = UDP_SEGMENT;
+            control->cmsg_len = CMSG_LEN(sizeof(quint16));
+            const quint16 gsoSize = quint16(segmentSize);
+            memcpy(CMSG_DATA(control), &gsoSize, sizeof(gsoSize));
+        }
+        firstReply[count] = i;
+        ++count;
+        i += segments;
+    }
+
+    // sendmmsg останавливается на первом неудачном сообщении, и errno относится к нему
+    int sent = 0;
+    while (sent < count) {
+        const int result = sendMessages(messages.data() + sent, qMin(count - sent, MaxSendBatch));
+        if (result > 0) {
+            sent += result;
+            continue;
+        }
+        const int error = errno;
+        if (error == EINTR) {
+            continue;
+        }
+        if (error == EAGAIN || error == EWOULDBLOCK) {
+            return firstReply[sent];
+        }
+        const int first = firstReply[sent];
+        const int segments = int(messages[sent].msg_hdr.msg_iovlen);
+        if (messages[sent].msg_hdr.msg_controllen != 0
+                && (error == EIO || error == EINVAL || error == ENOPROTOOPT)) {
+            // Склейку не принял драйвер или сетевая карта: это сообщение уходит
+            // по одной датаграмме, следующие пачки снова склеиваются. Без
+            // UDP_SEGMENT в ядре склейка выключается насовсем
+            if (error == ENOPROTOOPT) {
+                LOG_INFO("UDP GSO unavailable, falling back to plain sendmmsg");
+                gso = false;
+            } else {
+                LOG_SAMPLED(Logger::Info, "UDP GSO send failed: %1 - resending %2 datagrams one by one",
+                            strerror(error), segments);
+            }
+            const int resent = sendBatch(first, first + segments, false);
+            if (resent < first + segments) {
+                return resent;
+            }
+        } else {
+            // Адресат недоступен или запрещён: теряется только это сообщение
+            LOG_SAMPLED(Logger::Warning, "sendmmsg failed: %1 - %2 datagram(s) to %3:%4 dropped",
+                        strerror(error), segments, pending.at(first).client.address.toString(),
+                        pending.at(first).client.port);
+        }
+        ++sent;
+    }
+    return to;
+}
+
+void UdpTransport::removeSent(int count)
+{
+    const qsizetype base = count < pending.size() ? pending.at(count).offset : outgoing.size();
+    pending.remove(0, count);
+    outgoing.remove(0, base);
+    for (Reply &reply : pending) {
+        reply.offset -= base;
+    }
+}
+
+int UdpTransport::sendMessages(mmsghdr *messages, int count)
+{
+#ifdef HAVE_IO_URING
+    if (uring) {
+        return uring->send(messages, count);
+    }
+#endif
+    return sendmmsg(fd, messages, count, 0);
+}
+#endif
+
+#ifdef HAVE_IO_URING
+int UdpTransport::receiveCompletions()
+{
+    received.resize(0);
+    const int count = uring->receive(received);
+    inBatch = true;
+    for (const UringSocket::Received &datagram : std::as_const(received)) {
+        if (datagram.truncated) {
+            Metrics::add(Metrics::OversizedDatagrams);
+            LOG_SAMPLED(Logger::Warning, "Dropping datagram larger than %1 bytes", int(MaxDatagramSize));
+            continue;
+        }
+        deliver(datagram.data, toClientInfo(datagram.sender));
+    }
+    inBatch = false;
+    flush();
+
+    // Счётчик накопительный, поэтому достаточно самого свежего значения
+    for (qsizetype i = received.size() - 1; i >= 0; --i) {
+        if (received.at(i).hasDrops) {
+            Metrics::add(Metrics::SocketDrops, received.at(i).drops - socketDrops);
+            socketDrops = received.at(i).drops;
+            break;
+        }
+    }
+    // Буферы возвращаются ядру только здесь: data ссылалась на них
+    uring->recycle();
+    return count;
+}
+#endif
+
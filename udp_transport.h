@@ -0,0 +1,120 @@
+#ifndef UDP_TRANSPORT_H
+#define UDP_TRANSPORT_H
+
+#include <QObject>
+#include <QUdpSocket>
+#include <QSocketNotifier>
+#include <QTimer>
+#include <QByteArray>
+#include <QList>
+#include "datagram.h"
+#include "fragment_reassembler.h"
+#include "uring_socket.h"
+
+#ifdef Q_OS_LINUX
+struct mmsghdr;
+#endif
+
+// UDP-сокет сервера. На Linux датаграммы читаются пачками через recvmmsg,
+// а ответы, накопленные за пачку, уходят одним sendmmsg (ответы одному
+// адресату склеиваются через UDP_SEGMENT). На остальных платформах —
+// обычный QUdpSocket. С IoUringBackend на Linux приём и отправка идут через
+// io_uring (UringSocket); если ядро его не поддерживает — через recvmmsg.
+// Фрагменты больших запросов собираются здесь же, до передачи обработчику:
+// ядро направляет датаграммы одного клиента всегда в один сокет.
+class UdpTransport : public QObject, public DatagramSink
+{
+    Q_OBJECT
+
+public:
+    enum {
+        DefaultBatchSize = 64,
+        MaxDatagramSize = 9216
+    };
+
+    enum Backend {
+        SocketBackend,
+        IoUringBackend
+    };
+
+    explicit UdpTransport(DatagramHandler *handler, int batchSize = DefaultBatchSize,
+                          Backend backend = SocketBackend, QObject *parent = nullptr);
+    ~UdpTransport();
+
+    bool bind(quint16 port, bool reusePort = false);
+    // Уже привязанный сокет, полученный от предыдущего процесса при передаче работы
+    bool adopt(int descriptor);
+    void close();
+
+    // Перестаёт читать сокет: новые датаграммы копятся в буфере ядра.
+    // Всё, что уже принято, к возврату обработано и ответы отправлены
+    bool pause();
+    void resume();
+    // Дескриптор сокета для передачи преемнику, -1 — сокет не открыт
+    int descriptor() const;
+    // Порт, к которому привязан сокет, в том числе полученный от предыдущего процесса
+    quint16 localPort() const;
+    // Фактический способ приёма: после отказа io_uring — SocketBackend
+    Backend activeBackend() const { return backend; }
+
+    // Внутри пачки ответ откладывается до flush(), вне пачки уходит сразу
+    void sendDatagram(QByteArrayView data, const ClientInfo &client) override;
+    void flush();
+
+    static bool backendFromName(const QString &name, Backend &backend);
+
+private slots:
+    void onReadyRead();
+    void onReassemblyTimer();
+
+private:
+    struct Reply {
+        qsizetype offset;  // Смещение в outgoing
+        qsizetype size;
+        ClientInfo client;
+    };
+
+    void deliver(QByteArrayView data, const ClientInfo &sender);
+
+#ifdef Q_OS_LINUX
+    bool bindNative(quint16 port, bool reusePort);
+    void startReceiving();
+    int receiveBatch();
+    // Отправляет pending[from, to) и возвращает, до какого ответа дошла;
+    // меньше to — сокет переполнен (EAGAIN). segment — склеивать ответы через GSO
+    int sendBatch(int from, int to, bool segment = true);
+    // Убирает из очереди первые count ответов
+    void removeSent(int count);
+    void updateSocketDrops(const mmsghdr *messages, int count);
+    int sendMessages(mmsghdr *messages, int count);
+#endif
+#ifdef HAVE_IO_URING
+    int receiveCompletions();
+#endif
+
+    DatagramHandler *handler;
+    int batchSize;
+    Backend backend;
+    bool inBatch;
+    QByteArray outgoing;   // Тела ответов, ожидающих flush(), подряд
+    QList<Reply> pending;
+    QUdpSocket *socket;
+    FragmentReassembler reassembler;
+    QTimer *reassemblyTimer;  // Работает, пока есть незавершённые сборки
+
+#ifdef Q_OS_LINUX
+    int fd;
+    int family;
+    bool gso;  // Ядро принимает UDP_SEGMENT
+    quint32 socketDrops;  // Последнее значение SO_RXQ_OVFL
+    QSocketNotifier *notifier;
+    QSocketNotifier *writeNotifier;  // Включён, пока переполненный сокет не примет запись
+    QByteArray receiveBuffer;  // batchSize слотов по MaxDatagramSize байт
+#endif
+#ifdef HAVE_IO_URING
+    UringSocket *uring;  // nullptr — recvmmsg/sendmmsg
+    QList<UringSocket::Received> received;
+#endif
+};
+
+#endif // UDP_TRANSPORT_H
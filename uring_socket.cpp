@@ -0,0 +1,458 @@
+#include "uring_socket.h"
+
+#ifdef HAVE_IO_URING
+#include <QVarLengthArray>
+#include "logger.h"
+#include <linux/io_uring.h>
+#include <sys/mman.h>
+#include <sys/syscall.h>
+#include <unistd.h>
+#include <cerrno>
+#include <cstring>
+#include <utility>
+
+namespace {
+
+const quint64 ReceiveTag = 0;
+const quint64 SendTag = 1;        // + номер сообщения в send()
+const quint64 CancelTag = ~quint64(0);
+const unsigned RingEntries = 256;
+const quint16 BufferGroup = 0;
+const int MaxBuffers = 32768;     // Предел ядра для кольца буферов
+
+union DropsControl {
+    char data[CMSG_SPACE(sizeof(quint32))];
+    cmsghdr align;
+};
+
+template<typename T>
+T loadAcquire(const T *value)
+{
+    return __atomic_load_n(value, __ATOMIC_ACQUIRE);
+}
+
+template<typename T>
+void storeRelease(T *value, T next)
+{
+    __atomic_store_n(value, next, __ATOMIC_RELEASE);
+}
+
+void *mapRing(int fd, size_t size, off_t offset)
+{
+    void *ring = mmap(nullptr, size, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE, fd, offset);
+    return ring == MAP_FAILED ? nullptr : ring;
+}
+
+void *mapAnonymous(size_t size)
+{
+    void *area = mmap(nullptr, size, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+    return area == MAP_FAILED ? nullptr : area;
+}
+
+} // namespace
+
+UringSocket::UringSocket(int socket)
+    : socket(socket)
+    , ringFd(-1)
+    , sqEntries(0)
+    , sqHead(nullptr)
+    , sqTail(nullptr)
+    , sqMask(nullptr)
+    , sqArray(nullptr)
+    , sqLocalTail(0)
+    , submitted(0)
+    , sqes(nullptr)
+    , cqHead(nullptr)
+    , cqTail(nullptr)
+    , cqMask(nullptr)
+    , cqes(nullptr)
+    , sqRing(nullptr)
+    , sqRingSize(0)
+    , cqRing(nullptr)
+    , cqRingSize(0)
+    , sqesSize(0)
+    , bufferRing(nullptr)
+    , bufferRingSize(0)
+    , buffers(nullptr)
+    , buffersSize(0)
+    , bufferCount(0)
+    , bufferSize(0)
+    , bufferTail(0)
+    , receiving(false)
+    , cancelled(false)
+{
+    memset(&receiveHeader, 0, sizeof(receiveHeader));
+    receiveHeader.msg_namelen = sizeof(sockaddr_storage);
+    receiveHeader.msg_controllen = sizeof(DropsControl);
+}
+
+UringSocket::~UringSocket()
+{
+    release();
+}
+
+bool UringSocket::start(int count, int size)
+{
+    bufferCount = 1;
+    while (bufferCount < qBound(1, count, MaxBuffers)) {
+        bufferCount *= 2;
+    }
+    // Заголовок recvmsg, адрес и служебные данные лежат в буфере перед датаграммой
+    bufferSize = int(sizeof(io_uring_recvmsg_out) + receiveHeader.msg_namelen + receiveHeader.msg_controllen) + size;
+
+    io_uring_params params;
+    memset(&params, 0, sizeof(params));
+    params.flags = IORING_SETUP_CQSIZE;
+    // Многоразовый приём может выложить завершения сразу для всех буферов
+    params.cq_entries = qMax(2 * RingEntries, 2 * unsigned(bufferCount));
+    ringFd = int(syscall(__NR_io_uring_setup, RingEntries, &params));
+    if (ringFd < 0) {
+        LOG_WARNING("io_uring_setup failed: %1", strerror(errno));
+        return false;
+    }
+
+    sqEntries = params.sq_entries;
+    sqRingSize = params.sq_off.array + params.sq_entries * sizeof(unsigned);
+    cqRingSize = params.cq_off.cqes + params.cq_entries * sizeof(io_uring_cqe);
+    if (params.features & IORING_FEAT_SINGLE_MMAP) {
+        sqRingSize = cqRingSize = qMax(sqRingSize, cqRingSize);
+    }
+    sqRing = mapRing(ringFd, sqRingSize, IORING_OFF_SQ_RING);
+    cqRing = (params.features & IORING_FEAT_SINGLE_MMAP) ? sqRing : mapRing(ringFd, cqRingSize, IORING_OFF_CQ_RING);
+    sqesSize = params.sq_entries * sizeof(io_uring_sqe);
+    sqes = static_cast<io_uring_sqe *>(mapRing(ringFd, sqesSize, IORING_OFF_SQES));
+    if (!sqRing || !cqRing || !sqes) {
+        LOG_WARNING("Cannot map io_uring rings: %1", strerror(errno));
+        release();
+        return false;
+    }
+
+    char *sq = static_cast<char *>(sqRing);
+    sqHead = reinterpret_cast<unsigned *>(sq + params.sq_off.head);
+    sqTail = reinterpret_cast<unsigned *>(sq + params.sq_off.tail);
+    sqMask = reinterpret_cast<unsigned *>(sq + params.sq_off.ring_mask);
+    sqArray = reinterpret_cast<unsigned *>(sq + params.sq_off.array);
+    sqLocalTail = submitted = *sqTail;
+    char *cq = static_cast<char *>(cqRing);
+    cqHead = reinterpret_cast<unsigned *>(cq + params.cq_off.head);
+    cqTail = reinterpret_cast<unsigned *>(cq + params.cq_off.tail);
+    cqMask = reinterpret_cast<unsigned *>(cq + params.cq_off.ring_mask);
+    cqes = reinterpret_cast<io_uring_cqe *>(cq + params.cq_off.cqes);
+
+    bufferRingSize = size_t(bufferCount) * sizeof(io_uring_buf);
+    bufferRing = static_cast<io_uring_buf_ring *>(mapAnonymous(bufferRingSize));
+    buffersSize = size_t(bufferCount) * size_t(bufferSize);
+    buffers = static_cast<char *>(mapAnonymous(buffersSize));
+    if (!bufferRing || !buffers) {
+        LOG_WARNING("Cannot allocate io_uring receive buffers: %1", strerror(errno));
+        release();
+        return false;
+    }
+
+    io_uring_buf_reg registration;
+    memset(&registration, 0, sizeof(registration));
+    registration.ring_addr = quint64(quintptr(bufferRing));
+    registration.ring_entries = unsigned(bufferCount);
+    registration.bgid = BufferGroup;
+    if (syscall(__NR_io_uring_register, ringFd, IORING_REGISTER_PBUF_RING, &registration, 1) < 0) {
+        LOG_WARNING("io_uring provided buffer rings are unavailable: %1", strerror(errno));
+        release();
+        return false;
+    }
+    for (int i = 0; i < bufferCount; ++i) {
+        lent.append(quint16(i));
+    }
+
+    // recycle() отдаёт кольцу все буферы и заряжает приём; ядро без
+    // многоразового recvmsg отвечает ошибкой сразу
+    recycle();
+    Completion completion;
+    while (reap(completion)) {
+        if (completion.tag == ReceiveTag && completion.result < 0 && !(completion.flags & IORING_CQE_F_MORE)) {
+            LOG_WARNING("io_uring multishot recvmsg is unavailable: %1", strerror(-completion.result));
+            release();
+            return false;
+        }
+        deferred.append(completion);
+    }
+    return true;
+}
+
+int UringSocket::receive(QList<Received> &out)
+{
+    const qsizetype before = out.size();
+    for (const Completion &completion : std::as_const(deferred)) {
+        handleReceive(completion, out);
+    }
+    deferred.resize(0);
+
+    Completion completion;
+    while (reap(completion)) {
+        if (completion.tag == ReceiveTag) {
+            handleReceive(completion, out);
+        }
+    }
+    return int(out.size() - before);
+}
+
+void UringSocket::recycle()
+{
+    // Не bufs[]: в C++ __DECLARE_FLEX_ARRAY сдвигает его на 8 байт, а
+    // кольцо — просто массив io_uring_buf, хвост лежит в resv первого
+    io_uring_buf *entries = reinterpret_cast<io_uring_buf *>(bufferRing);
+    const unsigned mask = unsigned(bufferCount) - 1;
+    for (quint16 bid : std::as_const(lent)) {
+        io_uring_buf &buffer = entries[bufferTail & mask];
+        buffer.addr = quint64(quintptr(buffers + size_t(bid) * size_t(bufferSize)));
+        buffer.len = unsigned(bufferSize);
+        buffer.bid = bid;
+        ++bufferTail;
+    }
+    lent.resize(0);
+    storeRelease(&bufferRing->tail, bufferTail);
+
+    if (!receiving && !cancelled) {
+        // Многоразовый приём завершился, например, когда кончились буферы
+        armReceive();
+        enter(0);
+    }
+}
+
+int UringSocket::send(mmsghdr *messages, int count)
+{
+    int queued = 0;
+    io_uring_sqe *last = nullptr;
+    for (; queued < count; ++queued) {
+        io_uring_sqe *sqe = nextSqe();
+        if (!sqe) {
+            break;
+        }
+        sqe->opcode = IORING_OP_SENDMSG;
+        sqe->fd = socket;
+        sqe->addr = quint64(quintptr(&messages[queued].msg_hdr));
+        sqe->len = 1;
+        // Цепочка: после первой ошибки остальные отменяются, как у sendmmsg
+        sqe->flags = IOSQE_IO_LINK;
+        sqe->user_data = SendTag + quint64(queued);
+        last = sqe;
+    }
+    if (!last) {
+        errno = EAGAIN;
+        return -1;
+    }
+    last->flags = 0;
+
+    QVarLengthArray<int, 64> results(queued);
+    int done = 0;
+    while (done < queued) {
+        if (enter(unsigned(queued - done)) < 0) {
+            return -1;
+        }
+        Completion completion;
+        while (reap(completion)) {
+            if (completion.tag >= SendTag && completion.tag < SendTag + quint64(queued)) {
+                results[int(completion.tag - SendTag)] = completion.result;
+                ++done;
+            } else {
+                deferred.append(completion);
+            }
+        }
+    }
+
+    for (int i = 0; i < queued; ++i) {
+        if (results[i] < 0) {
+            if (i == 0) {
+                errno = -results[i];
+                return -1;
+            }
+            return i;
+        }
+        messages[i].msg_len = unsigned(results[i]);
+    }
+    return queued;
+}
+
+bool UringSocket::cancelReceive()
+{
+    cancelled = true;
+    // Последнее завершение приёма могло уже попасть в отложенные
+    for (const Completion &completion : std::as_const(deferred)) {
+        if (completion.tag == ReceiveTag && !(completion.flags & IORING_CQE_F_MORE)) {
+            receiving = false;
+        }
+    }
+    if (!receiving) {
+        return true;
+    }
+
+    io_uring_sqe *sqe = nextSqe();
+    if (!sqe) {
+        return false;
+    }
+    sqe->opcode = IORING_OP_ASYNC_CANCEL;
+    sqe->addr = ReceiveTag;
+    sqe->user_data = CancelTag;
+    while (receiving) {
+        if (enter(1) < 0) {
+            return false;
+        }
+        Completion completion;
+        while (reap(completion)) {
+            if (completion.tag != ReceiveTag) {
+                continue;
+            }
+            // receiving сбросит и handleReceive(), но ждать нужно уже сейчас
+            if (!(completion.flags & IORING_CQE_F_MORE)) {
+                receiving = false;
+            }
+            deferred.append(completion);
+        }
+    }
+    return true;
+}
+
+io_uring_sqe *UringSocket::nextSqe()
+{
+    if (sqLocalTail - loadAcquire(sqHead) >= sqEntries) {
+        return nullptr;
+    }
+    const unsigned index = sqLocalTail & *sqMask;
+    io_uring_sqe *sqe = &sqes[index];
+    memset(sqe, 0, sizeof(io_uring_sqe));
+    sqArray[index] = index;
+    ++sqLocalTail;
+    return sqe;
+}
+
+int UringSocket::enter(unsigned wait)
+{
+    storeRelease(sqTail, sqLocalTail);
+    forever {
+        const unsigned submit = sqLocalTail - submitted;
+        const int result = int(syscall(__NR_io_uring_enter, ringFd, submit, wait,
+                                       wait > 0 ? IORING_ENTER_GETEVENTS : 0, nullptr, 0));
+        if (result >= 0) {
+            submitted += unsigned(result);
+            return result;
+        }
+        if (errno != EINTR) {
+            LOG_SAMPLED(Logger::Warning, "io_uring_enter failed: %1", strerror(errno));
+            return -1;
+        }
+    }
+}
+
+bool UringSocket::reap(Completion &completion)
+{
+    const unsigned head = *cqHead;
+    if (head == loadAcquire(cqTail)) {
+        return false;
+    }
+    const io_uring_cqe &cqe = cqes[head & *cqMask];
+    completion.tag = cqe.user_data;
+    completion.result = cqe.res;
+    completion.flags = cqe.flags;
+    storeRelease(cqHead, head + 1);
+    return true;
+}
+
+void UringSocket::armReceive()
+{
+    io_uring_sqe *sqe = nextSqe();
+    if (!sqe) {
+        return;  // Зарядим при следующем recycle()
+    }
+    sqe->opcode = IORING_OP_RECVMSG;
+    sqe->fd = socket;
+    sqe->addr = quint64(quintptr(&receiveHeader));
+    sqe->len = 1;
+    sqe->ioprio = IORING_RECV_MULTISHOT;
+    sqe->flags = IOSQE_BUFFER_SELECT;
+    sqe->buf_group = BufferGroup;
+    sqe->user_data = ReceiveTag;
+    receiving = true;
+}
+
+void UringSocket::handleReceive(const Completion &completion, QList<Received> &out)
+{
+    if (!(completion.flags & IORING_CQE_F_MORE)) {
+        receiving = false;
+    }
+    if (completion.result < 0) {
+        if (completion.result != -ENOBUFS && completion.result != -ECANCELED) {
+            LOG_SAMPLED(Logger::Warning, "io_uring recvmsg failed: %1", strerror(-completion.result));
+        }
+        return;
+    }
+    if (!(completion.flags & IORING_CQE_F_BUFFER)) {
+        return;
+    }
+    const quint16 bid = quint16(completion.flags >> IORING_CQE_BUFFER_SHIFT);
+    lent.append(bid);
+
+    // Буфер: io_uring_recvmsg_out, место под адрес, под служебные данные, датаграмма
+    const char *buffer = buffers + size_t(bid) * size_t(bufferSize);
+    io_uring_recvmsg_out header;
+    memcpy(&header, buffer, sizeof(header));
+    const size_t nameOffset = sizeof(io_uring_recvmsg_out);
+    const size_t controlOffset = nameOffset + receiveHeader.msg_namelen;
+    const size_t payloadOffset = controlOffset + receiveHeader.msg_controllen;
+    if (size_t(completion.result) < payloadOffset) {
+        return;
+    }
+
+    Received received;
+    memset(&received.sender, 0, sizeof(received.sender));
+    memcpy(&received.sender, buffer + nameOffset, qMin<size_t>(header.namelen, sizeof(received.sender)));
+    received.truncated = header.flags & MSG_TRUNC;
+    received.data = QByteArrayView(buffer + payloadOffset,
+                                   qMin<qsizetype>(header.payloadlen, qsizetype(completion.result) - qsizetype(payloadOffset)));
+    received.hasDrops = false;
+    received.drops = 0;
+
+    msghdr control;
+    memset(&control, 0, sizeof(control));
+    control.msg_control = const_cast<char *>(buffer + controlOffset);
+    control.msg_controllen = qMin<size_t>(header.controllen, receiveHeader.msg_controllen);
+    for (cmsghdr *message = CMSG_FIRSTHDR(&control); message; message = CMSG_NXTHDR(&control, message)) {
+        if (message->cmsg_level == SOL_SOCKET && message->cmsg_type == SO_RXQ_OVFL) {
+            memcpy(&received.drops, CMSG_DATA(message), sizeof(received.drops));
+            received.hasDrops = true;
+        }
+    }
+    out.append(received);
+}
+
+void UringSocket::release()
+{
+    // Закрытие кольца отменяет заряженный приём и снимает регистрацию буферов
+    if (ringFd >= 0) {
+        ::close(ringFd);
+        ringFd = -1;
+    }
+    if (sqes) {
+        munmap(sqes, sqesSize);
+        sqes = nullptr;
+    }
+    if (cqRing && cqRing != sqRing) {
+        munmap(cqRing, cqRingSize);
+    }
+    cqRing = nullptr;
+    if (sqRing) {
+        munmap(sqRing, sqRingSize);
+        sqRing = nullptr;
+    }
+    if (bufferRing) {
+        munmap(bufferRing, bufferRingSize);
+        bufferRing = nullptr;
+    }
+    if (buffers) {
+        munmap(buffers, buffersSize);
+        buffers = nullptr;
+    }
+    lent.clear();
+    deferred.clear();
+    receiving = false;
+}
+
+#endif // HAVE_IO_URING
@@ -0,0 +1,109 @@
+#ifndef URING_SOCKET_H
+#define URING_SOCKET_H
+
+#include <QtGlobal>
+
+#if defined(Q_OS_LINUX) && __has_include(<linux/io_uring.h>)
+#define HAVE_IO_URING
+
+#include <QByteArrayView>
+#include <QList>
+#include <sys/socket.h>
+
+struct io_uring_sqe;
+struct io_uring_cqe;
+struct io_uring_buf_ring;
+
+// Приём и отправка UDP через io_uring без liburing, прямыми системными
+// вызовами. Один многоразовый (multishot) recvmsg остаётся заряженным
+// постоянно и пишет датаграммы в буферы из зарегистрированного кольца
+// (provided buffer ring); их завершения разбираются из общей памяти без
+// системных вызовов. Ответы уходят цепочкой SENDMSG за один io_uring_enter.
+// Дескриптор кольца становится читаемым, когда есть завершения, и
+// ставится в QSocketNotifier вместо самого сокета.
+// Не потокобезопасен: вызывается только из потока сокета.
+class UringSocket
+{
+public:
+    struct Received {
+        QByteArrayView data;       // В буфере кольца, действительна до recycle()
+        sockaddr_storage sender;
+        bool truncated;            // Датаграмма больше буфера
+        bool hasDrops;
+        quint32 drops;             // SO_RXQ_OVFL, если hasDrops
+    };
+
+    explicit UringSocket(int socket);
+    ~UringSocket();
+
+    // bufferCount округляется до степени двойки; false — ядро не умеет
+    // нужного, сокет остаётся как был
+    bool start(int bufferCount, int bufferSize);
+    int descriptor() const { return ringFd; }
+
+    // Принятые датаграммы, без системных вызовов. Буферы возвращаются
+    // ядру только в recycle()
+    int receive(QList<Received> &out);
+    void recycle();
+    // Завершения приёма, отложенные отправкой: descriptor() о них уже не сообщит
+    bool hasPending() const { return !deferred.isEmpty(); }
+    // Отменяет приём и ждёт его последнего завершения. Уже принятое выдаст
+    // receive(), остальные датаграммы остаются в сокете; больше приём не заряжается
+    bool cancelReceive();
+
+    // Как sendmmsg: отправленных подряд с начала, при ошибке первого -1 и errno.
+    // Возвращает после отправки, буферы сообщений можно переиспользовать
+    int send(mmsghdr *messages, int count);
+
+private:
+    struct Completion {
+        quint64 tag;
+        qint32 result;
+        quint32 flags;
+    };
+
+    io_uring_sqe *nextSqe();
+    int enter(unsigned wait);
+    bool reap(Completion &completion);
+    void armReceive();
+    void handleReceive(const Completion &completion, QList<Received> &out);
+    void release();
+
+    int socket;
+    int ringFd;
+    unsigned sqEntries;
+    unsigned *sqHead;
+    unsigned *sqTail;
+    unsigned *sqMask;
+    unsigned *sqArray;
+    unsigned sqLocalTail;  // Добавленные, но ещё не отданные ядру SQE
+    unsigned submitted;    // Хвост SQ, уже отданный ядру
+    io_uring_sqe *sqes;
+    unsigned *cqHead;
+    unsigned *cqTail;
+    unsigned *cqMask;
+    io_uring_cqe *cqes;
+    void *sqRing;
+    size_t sqRingSize;
+    void *cqRing;          // Совпадает с sqRing при IORING_FEAT_SINGLE_MMAP
+    size_t cqRingSize;
+    size_t sqesSize;
+
+    io_uring_buf_ring *bufferRing;
+    size_t bufferRingSize;
+    char *buffers;
+    size_t buffersSize;
+    int bufferCount;
+    int bufferSize;
+    quint16 bufferTail;
+    QList<quint16> lent;   // Буферы, отданные в последнем receive()
+
+    msghdr receiveHeader;  // Размеры адреса и служебных данных для multishot recvmsg
+    bool receiving;        // recvmsg заряжен
+    bool cancelled;        // Приём отменён cancelReceive()
+    QList<Completion> deferred;
+};
+
+#endif // HAVE_IO_URING
+
+#endif // URING_SOCKET_H
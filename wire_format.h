@@ -0,0 +1,19 @@
+#ifndef WIRE_FORMAT_H
+#define WIRE_FORMAT_H
+
+#include <QByteArrayView>
+
+// Кодировка конверта JSON-RPC в датаграмме
+enum WireFormat : quint8 {
+    JsonFormat,
+    CborFormat
+};
+
+// JSON-текст всегда начинается с ASCII, а CBOR-массив, словарь или тег —
+// с байта 0x80 и выше, поэтому формат определяется по первому байту
+inline WireFormat detectWireFormat(QByteArrayView data)
+{
+    return !data.isEmpty() && uchar(data.at(0)) >= 0x80 ? CborFormat : JsonFormat;
+}
+
+#endif // WIRE_FORMAT_H
@@ -0,0 +1,194 @@
+#include "worker_pool.h"
+#include "flat_hash.h"
+#include "logger.h"
+#include "metrics.h"
+#include <QMutex>
+#include <QThread>
+#include <QWaitCondition>
+#include <utility>
+
+struct WorkerPool::Worker {
+    QMutex mutex;             // Защищает jobs, running, sleeping и poked
+    QWaitCondition wakeUp;
+    QList<RequestBatch> jobs;
+    QThread *thread = nullptr;
+    bool running = true;
+    bool sleeping = false;
+    bool poked = false;       // Разбужен, чтобы перехватить чужую пачку
+};
+
+WorkerPool::WorkerPool(RequestHandler *handler, int workers, Affinity affinity)
+    : handler(handler)
+    , affinity(affinity)
+    , limit(qMax(1, workers) * Backlog)
+{
+    for (int i = 0; i < qMax(1, workers); ++i) {
+        this->workers.append(new Worker);
+    }
+}
+
+WorkerPool::~WorkerPool()
+{
+    stop();
+    qDeleteAll(workers);
+}
+
+void WorkerPool::start()
+{
+    for (int i = 0; i < workers.size(); ++i) {
+        Worker *worker = workers.at(i);
+        if (worker->thread) {
+            continue;
+        }
+        worker->running = true;
+        worker->thread = QThread::create([this, worker] { run(worker); });
+        worker->thread->setObjectName(QString("worker-%1").arg(i));
+        worker->thread->start();
+    }
+}
+
+void WorkerPool::stop()
+{
+    for (Worker *worker : std::as_const(workers)) {
+        QMutexLocker locker(&worker->mutex);
+        worker->running = false;
+        worker->wakeUp.wakeOne();
+    }
+    int dropped = 0;
+    for (Worker *worker : std::as_const(workers)) {
+        if (worker->thread) {
+            worker->thread->wait();
+            delete worker->thread;
+            worker->thread = nullptr;
+        }
+        for (const RequestBatch &batch : std::as_const(worker->jobs)) {
+            dropped += int(batch.size());
+            requests.fetchAndSubRelaxed(int(batch.size()));
+        }
+        inFlight.fetchAndSubRelaxed(int(worker->jobs.size()));
+        worker->jobs.clear();
+    }
+    if (dropped > 0) {
+        LOG_WARNING("%1 request(s) left unprocessed in worker queues", dropped);
+    }
+}
+
+void WorkerPool::submit(const RequestBatch &batch)
+{
+    Q_ASSERT(!batch.isEmpty());
+    Worker *worker = target(batch.first());
+    inFlight.fetchAndAddRelaxed(1);
+    requests.fetchAndAddRelaxed(int(batch.size()));
+    bool idle;
+    {
+        QMutexLocker locker(&worker->mutex);
+        worker->jobs.append(batch);
+        idle = worker->sleeping;
+        if (idle) {
+            worker->wakeUp.wakeOne();
+        }
+    }
+    if (idle || affinity != NoAffinity || sleepers.loadRelaxed() == 0) {
+        return;
+    }
+
+    // Адресат занят — будим любой спящий поток, он перехватит пачку
+    for (Worker *other : std::as_const(workers)) {
+        QMutexLocker locker(&other->mutex);
+        if (other->sleeping && !other->poked) {
+            other->poked = true;
+            other->wakeUp.wakeOne();
+            return;
+        }
+    }
+}
+
+WorkerPool::Worker *WorkerPool::target(const QueuedRequest &request)
+{
+    quint64 key;
+    switch (affinity) {
+    case ClientAffinity:
+        key = hashOf(ClientKey::of(request.client));
+        break;
+    case ConfigurationAffinity:
+        key = request.configuration;
+        break;
+    default:
+        return workers.at(quint32(nextWorker.fetchAndAddRelaxed(1)) % quint32(workers.size()));
+    }
+    return workers.at(int(hashMix(key) % quint64(workers.size())));
+}
+
+void WorkerPool::run(Worker *worker)
+{
+    forever {
+        RequestBatch batch;
+        bool found = false;
+        {
+            QMutexLocker locker(&worker->mutex);
+            if (!worker->running) {
+                return;
+            }
+            if (!worker->jobs.isEmpty()) {
+                batch = worker->jobs.takeFirst();
+                found = true;
+            }
+        }
+        if (!found && affinity == NoAffinity && steal(worker, batch)) {
+            Metrics::add(Metrics::RequestsStolen, quint64(batch.size()));
+            found = true;
+        }
+        if (found) {
+            handler->processBatch(batch);
+            requests.fetchAndSubRelaxed(int(batch.size()));
+            inFlight.fetchAndSubRelaxed(1);
+            continue;
+        }
+
+        // Ни своих, ни чужих пачек — берём новые заявки из планировщика,
+        // а если и там пусто, ждём submit
+        if (handler->refill()) {
+            continue;
+        }
+        QMutexLocker locker(&worker->mutex);
+        if (worker->jobs.isEmpty() && worker->running) {
+            worker->sleeping = true;
+            sleepers.fetchAndAddRelaxed(1);
+            while (worker->jobs.isEmpty() && worker->running && !worker->poked) {
+                worker->wakeUp.wait(&worker->mutex);
+            }
+            sleepers.fetchAndSubRelaxed(1);
+            worker->sleeping = false;
+        }
+        worker->poked = false;
+    }
+}
+
+bool WorkerPool::steal(Worker *thief, RequestBatch &batch)
+{
+    // Обход начинается с соседа, чтобы потоки не грабили одну и ту же очередь
+    const int count = int(workers.size());
+    const int self = int(workers.indexOf(thief));
+    for (int i = 1; i < count; ++i) {
+        Worker *victim = workers.at((self + i) % count);
+        QMutexLocker locker(&victim->mutex);
+        // Из хвоста: голову владелец возьмёт сам следующей
+        if (!victim->jobs.isEmpty()) {
+            batch = victim->jobs.takeLast();
+            return true;
+        }
+    }
+    return false;
+}
+
+bool WorkerPool::affinityFromName(const QString &name, Affinity &affinity)
+{
+    static const char *const names[] = {"none", "client", "configuration"};
+    for (int i = NoAffinity; i <= ConfigurationAffinity; ++i) {
+        if (name.compare(QLatin1String(names[i]), Qt::CaseInsensitive) == 0) {
+            affinity = Affinity(i);
+            return true;
+        }
+    }
+    return false;
+}
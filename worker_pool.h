@@ -0,0 +1,74 @@
+#ifndef WORKER_POOL_H
+#define WORKER_POOL_H
+
+#include <QAtomicInt>
+#include <QList>
+#include <QString>
+#include "request.h"
+
+// Исполнитель заявок для WorkerPool; оба метода вызываются из потоков пула
+class RequestHandler
+{
+public:
+    virtual ~RequestHandler() {}
+    virtual void processBatch(const RequestBatch &batch) = 0;
+    // У потока кончилась работа: обработчик может добавить пачки через
+    // submit. true — что-то добавлено, иначе поток засыпает до submit
+    virtual bool refill() = 0;
+};
+
+// Пул потоков обработки с перехватом работы (work stealing). У каждого
+// потока своя очередь: пачки заявок раздаются по кругу, поток берёт их из
+// головы своей очереди, а освободившийся поток забирает пачку из хвоста чужой.
+// При привязке по клиенту или конфигурации пачки с одним ключом (ключ берётся
+// по первой заявке пачки) всегда идут в один поток и не перехватываются —
+// так сохраняется их порядок и тёплый кеш потока. В пуле не больше
+// capacity() пачек, остальные заявки ждут в планировщике, где на них
+// действуют приоритеты и старение.
+class WorkerPool
+{
+public:
+    enum Affinity {
+        NoAffinity,
+        ClientAffinity,
+        ConfigurationAffinity
+    };
+
+    // На поток приходится до Backlog пачек, включая выполняемую
+    enum { Backlog = 4 };
+
+    WorkerPool(RequestHandler *handler, int workers, Affinity affinity);
+    ~WorkerPool();
+
+    void start();
+    // Дожидается выполняемых заявок; ожидающие в очередях потоков
+    // отбрасываются (с журналом заявок они вернутся при запуске)
+    void stop();
+
+    bool hasRoom() const { return inFlight.loadRelaxed() < limit; }
+    void submit(const RequestBatch &batch);
+
+    int size() const { return int(workers.size()); }
+    int capacity() const { return limit; }  // Пачек
+    int pending() const { return requests.loadRelaxed(); }  // Заявок, ждущих в очередях и выполняемых
+
+    static bool affinityFromName(const QString &name, Affinity &affinity);
+
+private:
+    struct Worker;
+
+    void run(Worker *worker);
+    bool steal(Worker *thief, RequestBatch &batch);
+    Worker *target(const QueuedRequest &request);
+
+    RequestHandler *handler;
+    Affinity affinity;
+    QList<Worker *> workers;
+    QAtomicInt inFlight;  // Пачек в очередях и в работе
+    QAtomicInt requests;  // Заявок в них
+    QAtomicInt sleepers;  // Потоков, ждущих работу
+    QAtomicInt nextWorker;
+    int limit;
+};
+
+#endif // WORKER_POOL_H